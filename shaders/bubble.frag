@@ -0,0 +1,18 @@
+R"glsl(#version 330 core
+in vec2 TexCoords;
+in vec3 BubbleColor;
+in float WindowY;
+flat in float ClipY;
+out vec4 color;
+
+uniform sampler2D image;
+
+void main()
+{
+    if (WindowY < ClipY)
+    {
+        discard;
+    }
+    color = vec4(BubbleColor, 1.0) * texture(image, TexCoords);
+}
+)glsl"
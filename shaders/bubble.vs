@@ -0,0 +1,23 @@
+R"glsl(#version 330 core
+layout (location = 0) in vec2 corner; // <corner of the unit quad>
+layout (location = 1) in vec4 rect; // <vec2 window position, vec2 size>, per instance
+layout (location = 2) in vec4 texRect; // <vec2 atlas origin, vec2 atlas size>, per instance
+layout (location = 3) in vec4 colorClip; // <vec3 colour, window y to clip above>, per instance
+
+out vec2 TexCoords;
+out vec3 BubbleColor;
+out float WindowY;
+flat out float ClipY;
+
+uniform mat4 projection;
+
+void main()
+{
+    vec2 position = rect.xy + corner * rect.zw;
+    TexCoords = texRect.xy + corner * texRect.zw;
+    BubbleColor = colorClip.rgb;
+    WindowY = position.y;
+    ClipY = colorClip.a;
+    gl_Position = projection * vec4(position, 0.0, 1.0);
+}
+)glsl"
@@ -1,4 +1,4 @@
-#version 330 core
+R"glsl(#version 330 core
 layout (location = 0) in vec3 vertex;
 
 out vec2 position;
@@ -7,4 +7,5 @@ void main()
 {
     gl_Position = vec4(vertex, 1.0f);
 	position = gl_Position.xy;
-}
\ No newline at end of file
+}
+)glsl"
@@ -1,4 +1,4 @@
-#version 330 core
+R"glsl(#version 330 core
 in vec2 TexCoords;
 in vec4 gl_FragCoord;
 out vec4 color;
@@ -17,4 +17,5 @@ void main()
     {
         discard;
     }
-}
\ No newline at end of file
+}
+)glsl"
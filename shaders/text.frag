@@ -1,4 +1,4 @@
-#version 330 core
+R"glsl(#version 330 core
 in vec2 TexCoords;
 out vec4 color;
 
@@ -7,6 +7,7 @@ uniform vec3 textColor;
 
 void main()
 {    
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
+    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).a);
     color = vec4(textColor, 1.0) * sampled;
-}  
\ No newline at end of file
+}
+)glsl"
@@ -0,0 +1,437 @@
+#include <string.h>
+#include <algorithm>
+#include "board.h"
+
+static const uint8_t GHOST_CELL = GHOST + 1;
+
+// A bool for each cell of the mode's grid.
+template<typename Rules>
+using CellFlags = bool[Rules::COLUMNS][Rules::ROWS];
+// Grid positions, each stored as (x * Rules::ROWS) + y.
+template<typename Rules>
+using CellGroup = uint8_t[Rules::COLUMNS * Rules::ROWS];
+
+// Every placement in the mode's grid, in the order placementFromIndex numbers them.
+template<typename Rules>
+struct PlacementTable
+{
+    static const uint8_t SIZE = (Rules::COLUMNS * 2) + ((Rules::COLUMNS - 1) * 2);
+    Placement placements[SIZE];
+
+    PlacementTable();
+};
+
+template<typename Rules> static const PlacementTable<Rules> &placementTable();
+template<typename Rules> static uint8_t columnHeight(const Board &board, const uint8_t column);
+template<typename Rules> static bool applyPlacement(Board &board, const Placement &placement, const std::pair<BubbleColor, BubbleColor> &colors, uint8_t &numEnemyBubbles, MoveResult &result);
+template<typename Rules> static bool dropBubble(Board &board, const uint8_t column, const uint8_t cell);
+template<typename Rules> static bool settleBoard(Board &board, uint8_t &numEnemyBubbles, MoveResult &result);
+template<typename Rules> static uint8_t floodFill(const Board &board, CellFlags<Rules> &visited, const uint8_t x, const uint8_t y, CellGroup<Rules> &group);
+template<typename Rules> static void collapseColumns(Board &board);
+template<typename Rules> static bool settleChains(Board &board, MoveResult &result);
+
+void clearBoard(Board &board, const MatchMode mode)
+{
+    memset(board.cells, CELL_EMPTY, sizeof(board.cells));
+    board.mode = mode;
+}
+
+void boardFromGrid(GridCell const (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const MatchMode mode, Board &board)
+{
+    // The cells past the mode's grid are left empty, so boards of a mode compare and copy the same.
+    clearBoard(board, mode);
+    const GridShape &shape = MODE_GRIDS[mode];
+    for (uint8_t col = 0; col < shape.columns; col++)
+    {
+        for (uint8_t row = 0; row < shape.rows; row++)
+        {
+            board.cells[col][row] = cellState(grid[col][row]) == BubbleState::DEAD ? CELL_EMPTY : cellColor(grid[col][row]) + 1;
+        }
+    }
+}
+
+uint8_t numPlacements(const MatchMode mode)
+{
+    switch (mode)
+    {
+    case MODE_THREE_MATCH:
+        return PlacementTable<ThreeMatchRules>::SIZE;
+    case MODE_WIDE:
+        return PlacementTable<WideRules>::SIZE;
+    default:
+        return PlacementTable<ClassicRules>::SIZE;
+    }
+}
+
+Placement placementFromIndex(const MatchMode mode, const uint8_t index)
+{
+    switch (mode)
+    {
+    case MODE_THREE_MATCH:
+        return placementTable<ThreeMatchRules>().placements[index];
+    case MODE_WIDE:
+        return placementTable<WideRules>().placements[index];
+    default:
+        return placementTable<ClassicRules>().placements[index];
+    }
+}
+
+template<typename Rules>
+PlacementTable<Rules>::PlacementTable()
+{
+    for (uint8_t index = 0; index < SIZE; index++)
+    {
+        Placement &result = placements[index];
+        if (index < Rules::COLUMNS)
+        {
+            result.column = index;
+            result.buddyDirection = SOUTH;
+        }
+        else if (index < Rules::COLUMNS * 2)
+        {
+            result.column = index - Rules::COLUMNS;
+            result.buddyDirection = NORTH;
+        }
+        else if (index < (Rules::COLUMNS * 2) + (Rules::COLUMNS - 1))
+        {
+            // Buddy to the right, so main bubble can't be in the last column.
+            result.column = index - (Rules::COLUMNS * 2);
+            result.buddyDirection = EAST;
+        }
+        else
+        {
+            // Buddy to the left, so main bubble can't be in the first column.
+            result.column = index - (Rules::COLUMNS * 2) - (Rules::COLUMNS - 1) + 1;
+            result.buddyDirection = WEST;
+        }
+    }
+}
+
+// Built on first use. The bot's threads can get here together, which a function static is safe for.
+template<typename Rules>
+static const PlacementTable<Rules> &placementTable()
+{
+    static const PlacementTable<Rules> table;
+    return table;
+}
+
+uint8_t columnHeight(const Board &board, const uint8_t column)
+{
+    switch (board.mode)
+    {
+    case MODE_THREE_MATCH:
+        return columnHeight<ThreeMatchRules>(board, column);
+    case MODE_WIDE:
+        return columnHeight<WideRules>(board, column);
+    default:
+        return columnHeight<ClassicRules>(board, column);
+    }
+}
+
+// Bubbles always settle on top of each other, so the height is the run of occupied cells from the bottom.
+template<typename Rules>
+static uint8_t columnHeight(const Board &board, const uint8_t column)
+{
+    uint8_t height = 0;
+    while (height < Rules::ROWS && board.cells[column][Rules::ROWS - 1 - height] != CELL_EMPTY)
+    {
+        height++;
+    }
+    return height;
+}
+
+bool applyPlacement(Board &board, const Placement &placement, const std::pair<BubbleColor, BubbleColor> &colors, uint8_t &numEnemyBubbles, MoveResult &result)
+{
+    switch (board.mode)
+    {
+    case MODE_THREE_MATCH:
+        return applyPlacement<ThreeMatchRules>(board, placement, colors, numEnemyBubbles, result);
+    case MODE_WIDE:
+        return applyPlacement<WideRules>(board, placement, colors, numEnemyBubbles, result);
+    default:
+        return applyPlacement<ClassicRules>(board, placement, colors, numEnemyBubbles, result);
+    }
+}
+
+/*
+ * Drops the pair, then any waiting enemy bubbles, then plays out the chain reaction (see settleBoard).
+ * Returns false if the move ended the game.
+**/
+template<typename Rules>
+static bool applyPlacement(Board &board, const Placement &placement, const std::pair<BubbleColor, BubbleColor> &colors, uint8_t &numEnemyBubbles, MoveResult &result)
+{
+    result.chain = 0;
+    result.score = 0;
+    result.garbage = 0;
+    result.gameOver = false;
+
+    const uint8_t mainCell = colors.first + 1;
+    const uint8_t buddyCell = colors.second + 1;
+    bool alive;
+    switch (placement.buddyDirection)
+    {
+    case SOUTH:
+        // Buddy is underneath so lands first.
+        alive = dropBubble<Rules>(board, placement.column, buddyCell);
+        alive = dropBubble<Rules>(board, placement.column, mainCell) && alive;
+        break;
+    case NORTH:
+        alive = dropBubble<Rules>(board, placement.column, mainCell);
+        alive = dropBubble<Rules>(board, placement.column, buddyCell) && alive;
+        break;
+    case EAST:
+        alive = dropBubble<Rules>(board, placement.column, mainCell);
+        alive = dropBubble<Rules>(board, placement.column + 1, buddyCell) && alive;
+        break;
+    case WEST:
+    default:
+        alive = dropBubble<Rules>(board, placement.column, mainCell);
+        alive = dropBubble<Rules>(board, placement.column - 1, buddyCell) && alive;
+        break;
+    }
+
+    if (!alive)
+    {
+        result.gameOver = true;
+        return false;
+    }
+    return settleBoard<Rules>(board, numEnemyBubbles, result);
+}
+
+bool settleBoard(Board &board, uint8_t &numEnemyBubbles, MoveResult &result)
+{
+    switch (board.mode)
+    {
+    case MODE_THREE_MATCH:
+        return settleBoard<ThreeMatchRules>(board, numEnemyBubbles, result);
+    case MODE_WIDE:
+        return settleBoard<WideRules>(board, numEnemyBubbles, result);
+    default:
+        return settleBoard<ClassicRules>(board, numEnemyBubbles, result);
+    }
+}
+
+/*
+ * Drops any waiting enemy bubbles then plays out the chain reaction. Results are added to result.
+ * numEnemyBubbles is updated with the number of enemy bubbles consumed.
+ * Returns false if the game ended.
+**/
+template<typename Rules>
+static bool settleBoard(Board &board, uint8_t &numEnemyBubbles, MoveResult &result)
+{
+    const uint8_t columns = Rules::COLUMNS;
+    bool alive = true;
+    // Enemy bubbles are dropped a row at a time, starting from the left, before looking for chains.
+    while (alive && numEnemyBubbles > 0)
+    {
+        uint8_t numBubblesToDrop = std::min(numEnemyBubbles, columns);
+        for (uint8_t x = 0; x < numBubblesToDrop; x++)
+        {
+            alive = dropBubble<Rules>(board, x, GHOST_CELL) && alive;
+        }
+        numEnemyBubbles -= numBubblesToDrop;
+    }
+
+    if (!alive)
+    {
+        result.gameOver = true;
+        return false;
+    }
+    return settleChains<Rules>(board, result);
+}
+
+// Plays out the chain reaction under the mode's rules.
+template<typename Rules>
+static bool settleChains(Board &board, MoveResult &result)
+{
+    CellGroup<Rules> group;
+    for (;;)
+    {
+        CellFlags<Rules> visited = {};
+        CellFlags<Rules> dying = {};
+        uint8_t totalDeaths = 0;
+
+        for (uint8_t y = 0; y < Rules::ROWS; y++)
+        {
+            for (uint8_t x = 0; x < Rules::COLUMNS; x++)
+            {
+                const uint8_t cell = board.cells[x][y];
+                if (cell == CELL_EMPTY || cell == GHOST_CELL || visited[x][y])
+                {
+                    continue;
+                }
+                uint8_t chainLength = floodFill<Rules>(board, visited, x, y, group);
+                if (chainLength >= Rules::CHAIN_DEATH_LENGTH)
+                {
+                    totalDeaths += chainLength;
+                    result.score += ((chainLength - (Rules::CHAIN_DEATH_LENGTH - 1)) * 100);
+                    for (uint8_t i = 0; i < chainLength; i++)
+                    {
+                        dying[group[i] / Rules::ROWS][group[i] % Rules::ROWS] = true;
+                    }
+                }
+            }
+        }
+
+        if (totalDeaths == 0)
+        {
+            break;
+        }
+
+        // Ghost chains die if any of their bubbles touch a dying bubble of another colour.
+        for (uint8_t y = 0; y < Rules::ROWS; y++)
+        {
+            for (uint8_t x = 0; x < Rules::COLUMNS; x++)
+            {
+                if (board.cells[x][y] != GHOST_CELL || visited[x][y])
+                {
+                    continue;
+                }
+                uint8_t chainLength = floodFill<Rules>(board, visited, x, y, group);
+                bool killGhostChain = false;
+                for (uint8_t i = 0; i < chainLength && !killGhostChain; i++)
+                {
+                    const uint8_t gx = group[i] / Rules::ROWS;
+                    const uint8_t gy = group[i] % Rules::ROWS;
+                    killGhostChain =
+                        (gy > 0 && board.cells[gx][gy - 1] != GHOST_CELL && dying[gx][gy - 1]) ||
+                        (gy < Rules::ROWS - 1 && board.cells[gx][gy + 1] != GHOST_CELL && dying[gx][gy + 1]) ||
+                        (gx > 0 && board.cells[gx - 1][gy] != GHOST_CELL && dying[gx - 1][gy]) ||
+                        (gx < Rules::COLUMNS - 1 && board.cells[gx + 1][gy] != GHOST_CELL && dying[gx + 1][gy]);
+                }
+                if (killGhostChain)
+                {
+                    for (uint8_t i = 0; i < chainLength; i++)
+                    {
+                        dying[group[i] / Rules::ROWS][group[i] % Rules::ROWS] = true;
+                    }
+                }
+            }
+        }
+
+        for (uint8_t x = 0; x < Rules::COLUMNS; x++)
+        {
+            for (uint8_t y = 0; y < Rules::ROWS; y++)
+            {
+                if (dying[x][y])
+                {
+                    board.cells[x][y] = CELL_EMPTY;
+                }
+            }
+        }
+
+        if (totalDeaths >= Rules::CHAIN_MIN_SEND_LENGTH)
+        {
+            result.garbage += (totalDeaths - (Rules::CHAIN_MIN_SEND_LENGTH - 1)) * 2;
+        }
+        result.chain++;
+
+        collapseColumns<Rules>(board);
+    }
+
+    return true;
+}
+
+uint32_t nextRandom(uint32_t &state)
+{
+    // xorshift32, state must never be zero.
+    if (state == 0)
+    {
+        state = 0x9E3779B9;
+    }
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+BubbleColor randomColor(uint32_t &state)
+{
+    return static_cast<BubbleColor>(nextRandom(state) % (MAX_SPAWN_COLOR + 1));
+}
+
+/*
+ * Returns false if the bubble settled on the top row (or the column was already full), which is game over.
+**/
+bool dropBubble(Board &board, const uint8_t column, const uint8_t cell)
+{
+    switch (board.mode)
+    {
+    case MODE_THREE_MATCH:
+        return dropBubble<ThreeMatchRules>(board, column, cell);
+    case MODE_WIDE:
+        return dropBubble<WideRules>(board, column, cell);
+    default:
+        return dropBubble<ClassicRules>(board, column, cell);
+    }
+}
+
+template<typename Rules>
+static bool dropBubble(Board &board, const uint8_t column, const uint8_t cell)
+{
+    uint8_t height = columnHeight<Rules>(board, column);
+    if (height >= Rules::ROWS)
+    {
+        return false;
+    }
+    const uint8_t row = Rules::ROWS - 1 - height;
+    board.cells[column][row] = cell;
+    return row != 0;
+}
+
+// Finds all touching cells with the same value as (x, y). Cells are written to group as (x * Rules::ROWS) + y.
+template<typename Rules>
+static uint8_t floodFill(const Board &board, CellFlags<Rules> &visited, const uint8_t x, const uint8_t y, CellGroup<Rules> &group)
+{
+    const uint8_t cell = board.cells[x][y];
+    uint8_t count = 0;
+    uint8_t next = 0;
+    visited[x][y] = true;
+    group[count++] = (x * Rules::ROWS) + y;
+
+    // The group doubles as the work queue.
+    while (next < count)
+    {
+        const uint8_t cx = group[next] / Rules::ROWS;
+        const uint8_t cy = group[next] % Rules::ROWS;
+        next++;
+
+        const int8_t neighbours[4][2] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            const int8_t nx = cx + neighbours[i][0];
+            const int8_t ny = cy + neighbours[i][1];
+            if (nx < 0 || ny < 0 || nx > Rules::COLUMNS - 1 || ny > Rules::ROWS - 1)
+            {
+                continue;
+            }
+            if (!visited[nx][ny] && board.cells[nx][ny] == cell)
+            {
+                visited[nx][ny] = true;
+                group[count++] = (nx * Rules::ROWS) + ny;
+            }
+        }
+    }
+    return count;
+}
+
+// Moves every bubble down to fill empty space below it.
+template<typename Rules>
+static void collapseColumns(Board &board)
+{
+    for (uint8_t x = 0; x < Rules::COLUMNS; x++)
+    {
+        int8_t writeRow = Rules::ROWS - 1;
+        for (int8_t y = Rules::ROWS - 1; y >= 0; y--)
+        {
+            if (board.cells[x][y] != CELL_EMPTY)
+            {
+                board.cells[x][writeRow--] = board.cells[x][y];
+            }
+        }
+        while (writeRow >= 0)
+        {
+            board.cells[x][writeRow--] = CELL_EMPTY;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <utility>
+#include "defs.h"
+#include "match_rules.h"
+
+/* A compact copy of the play field used to simulate whole moves without rendering or timing.
+ * The rules are the same as the frame by frame state machine in game_logic.cpp, but a move is
+ * resolved in one call: the pair lands, enemy bubbles drop and every chain reaction is played out.
+ * Boards hold no pointers, so they can be copied freely and used from any thread. As with the match step, each
+ * function is built once for each mode's rules and picks the copy by board.mode.
+ */
+
+// Cell values. Any other value is a BubbleColor + 1.
+const uint8_t CELL_EMPTY = 0;
+
+struct Board
+{
+    // Only the mode's COLUMNS by ROWS corner is played in.
+    uint8_t cells[MAX_GRID_COLUMNS][MAX_GRID_ROWS];
+    // Rules chains are settled under.
+    MatchMode mode;
+};
+
+// Where the player pair is dropped. Column is the grid column of the main bubble.
+struct Placement
+{
+    uint8_t column;
+    Direction buddyDirection;
+};
+
+struct MoveResult
+{
+    // Number of scans in the chain reaction that killed something.
+    uint8_t chain;
+    uint32_t score;
+    // Number of ghost bubbles that would be sent to the other player.
+    uint8_t garbage;
+    bool gameOver;
+};
+
+void clearBoard(Board &board, const MatchMode mode = MODE_CLASSIC);
+void boardFromGrid(GridCell const (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const MatchMode mode, Board &board);
+// Every column for a vertical pair (both orders) plus every pair of neighbouring columns for a horizontal pair (both orders).
+uint8_t numPlacements(const MatchMode mode);
+// Placements are numbered from 0 to numPlacements(mode) - 1, from the mode's own table.
+Placement placementFromIndex(const MatchMode mode, const uint8_t index);
+uint8_t columnHeight(const Board &board, const uint8_t column);
+bool applyPlacement(Board &board, const Placement &placement, const std::pair<BubbleColor, BubbleColor> &colors, uint8_t &numEnemyBubbles, MoveResult &result);
+bool dropBubble(Board &board, const uint8_t column, const uint8_t cell);
+bool settleBoard(Board &board, uint8_t &numEnemyBubbles, MoveResult &result);
+
+// Small xorshift generator so simulations do not share the global rand() state.
+uint32_t nextRandom(uint32_t &state);
+BubbleColor randomColor(uint32_t &state);
+
+#endif
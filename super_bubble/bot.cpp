@@ -0,0 +1,347 @@
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "bot.h"
+#include "evaluator.h"
+
+// Value of a line of play that loses. Losing later is better than losing sooner.
+static const int32_t LOST_VALUE = INT32_MIN / 2;
+// Value of each bubble sent to the other player, compared to score.
+static const int32_t GARBAGE_VALUE = 50;
+
+static BotStats stats;
+static uint32_t rng = 1;
+
+// Position being searched. pairs[0] is the falling pair, pairs[1] the next pair and the rest are sampled.
+static bool hasRoot = false;
+static bool rootSpeculative = false;
+static Board rootBoard;
+static uint8_t rootEnemyBubbles = 0;
+static std::pair<BubbleColor, BubbleColor> pairs[BOT_MAX_SEARCH_DEPTH];
+
+// Iterative deepening state. choice[] is a counter over the placements at each level of the current depth,
+// and path[level] is the board after choice[0..level-1] have been played. Only levels above validLevels need rebuilding.
+static uint8_t depth = 1;
+static bool searchComplete = false;
+static uint8_t choice[BOT_MAX_SEARCH_DEPTH];
+static uint8_t validLevels = 0;
+static Board path[BOT_MAX_SEARCH_DEPTH + 1];
+static uint8_t pathEnemyBubbles[BOT_MAX_SEARCH_DEPTH + 1];
+static int32_t pathValue[BOT_MAX_SEARCH_DEPTH + 1];
+static int32_t depthBestValue = INT32_MIN;
+static uint8_t depthBestMove = 0;
+
+// Result of the deepest depth that has been completely searched.
+static int8_t bestMove = -1;
+static uint8_t bestDepth = 0;
+
+static void startDepth(const uint8_t newDepth);
+static void searchLeaf();
+static void advance(uint8_t level);
+static void record(const int32_t value);
+static bool isRedundant(const uint8_t placement, const std::pair<BubbleColor, BubbleColor> &colors);
+static Direction getBuddyDirection(const glm::ivec2 &mainBubble, const glm::ivec2 &buddyBubble);
+static Direction rotateCW(const Direction direction);
+static Direction rotateACW(const Direction direction);
+
+void resetBot()
+{
+    memset(&stats, 0, sizeof(stats));
+    hasRoot = false;
+    bestMove = -1;
+    bestDepth = 0;
+    searchComplete = false;
+}
+
+void startBotSearch(const Board &board, const std::pair<BubbleColor, BubbleColor> &colors, const std::pair<BubbleColor, BubbleColor> &nextColors, const uint8_t numEnemyBubbles, const bool speculative)
+{
+    if (hasRoot &&
+        memcmp(board.cells, rootBoard.cells, sizeof(board.cells)) == 0 &&
+        board.mode == rootBoard.mode &&
+        colors == pairs[0] &&
+        numEnemyBubbles == rootEnemyBubbles)
+    {
+        if (rootSpeculative && !speculative)
+        {
+            stats.speculativeHits++;
+            rootSpeculative = false;
+        }
+        // The next pair isn't known while speculating, so a sampled one is used until it is.
+        if (speculative || nextColors == pairs[1])
+        {
+            return;
+        }
+        pairs[1] = nextColors;
+        // Results for the falling pair on its own still hold, so keep the move and search deeper from there.
+        if (bestDepth >= 1)
+        {
+            bestDepth = 1;
+            stats.depthReached = 1;
+            startDepth(2);
+        }
+        return;
+    }
+
+    hasRoot = true;
+    rootSpeculative = speculative;
+    rootBoard = board;
+    rootEnemyBubbles = numEnemyBubbles;
+    pairs[0] = colors;
+    for (uint8_t i = 1; i < BOT_MAX_SEARCH_DEPTH; i++)
+    {
+        pairs[i] = std::make_pair(randomColor(rng), randomColor(rng));
+    }
+    if (!speculative)
+    {
+        pairs[1] = nextColors;
+    }
+    path[0] = rootBoard;
+    pathEnemyBubbles[0] = rootEnemyBubbles;
+    pathValue[0] = 0;
+    bestMove = -1;
+    bestDepth = 0;
+    stats.depthReached = 0;
+    stats.searches++;
+    if (speculative)
+    {
+        stats.speculativeSearches++;
+    }
+    startDepth(1);
+}
+
+bool continueBotSearch(const double budgetSeconds)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const std::chrono::steady_clock::time_point deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(budgetSeconds));
+    stats.frames++;
+
+    while (hasRoot && !searchComplete && std::chrono::steady_clock::now() < deadline)
+    {
+        searchLeaf();
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed > budgetSeconds + BOT_DEADLINE_SLACK_SECONDS)
+    {
+        stats.deadlineMisses++;
+        stats.worstOverrunSeconds = std::max(stats.worstOverrunSeconds, elapsed - budgetSeconds);
+    }
+    return searchComplete;
+}
+
+void predictSettledBoard(const MatchState &match, Board &board)
+{
+    boardFromGrid(match.grid, match.mode, board);
+
+    // Drop the lowest bubbles first, as they will land first.
+    const FallingBubbles &falling = match.falling;
+    uint8_t fallers[MAX_FALLING_BUBBLES];
+    for (uint8_t i = 0; i < falling.size; i++)
+    {
+        fallers[i] = i;
+    }
+    std::sort(fallers, fallers + falling.size, [&falling](const uint8_t a, const uint8_t b) { return falling.y[a] > falling.y[b]; });
+    for (uint8_t i = 0; i < falling.size; i++)
+    {
+        dropBubble(board, falling.x[fallers[i]] / GRID_SIZE, falling.colors[fallers[i]] + 1);
+    }
+
+    uint8_t enemyBubbles = match.numEnemyBubbles;
+    MoveResult result;
+    memset(&result, 0, sizeof(result));
+    settleBoard(board, enemyBubbles, result);
+}
+
+void steerBot(const MatchState &match, Controls &controls)
+{
+    controls.left = false;
+    controls.right = false;
+    controls.rotateCW = false;
+    controls.rotateACW = false;
+    controls.drop = false;
+
+    if (bestMove < 0 || !match.falling.pair)
+    {
+        return;
+    }
+
+    const glm::ivec2 buddyBubble = fallingPosition(match.falling, PAIR_BUDDY);
+    const glm::ivec2 mainBubble = fallingPosition(match.falling, PAIR_MAIN);
+    const Placement target = placementFromIndex(match.mode, bestMove);
+    const Direction direction = getBuddyDirection(mainBubble, buddyBubble);
+    const uint8_t column = mainBubble.x / GRID_SIZE;
+
+    if (direction != target.buddyDirection)
+    {
+        // Turn the shortest way, but the buddy can't be turned into a wall, so step away from it first.
+        const uint8_t stepsCW = (target.buddyDirection - direction + 4) % 4;
+        const bool useCW = stepsCW == 1 || (stepsCW == 2 && column > 0);
+        const Direction nextDirection = useCW ? rotateCW(direction) : rotateACW(direction);
+        if (nextDirection == WEST && column == 0)
+        {
+            controls.right = true;
+        }
+        else if (nextDirection == EAST && column == MODE_GRIDS[match.mode].columns - 1)
+        {
+            controls.left = true;
+        }
+        else if (useCW)
+        {
+            controls.rotateCW = true;
+        }
+        else
+        {
+            controls.rotateACW = true;
+        }
+    }
+    else if (column < target.column)
+    {
+        controls.right = true;
+    }
+    else if (column > target.column)
+    {
+        controls.left = true;
+    }
+    else if (searchComplete || bestDepth >= 2)
+    {
+        controls.drop = true;
+    }
+}
+
+void botMoveFinished()
+{
+    stats.movesMade++;
+    stats.depthTotal += bestDepth;
+}
+
+const BotStats &getBotStats()
+{
+    return stats;
+}
+
+static void startDepth(const uint8_t newDepth)
+{
+    depth = newDepth;
+    memset(choice, 0, sizeof(choice));
+    validLevels = 0;
+    depthBestValue = INT32_MIN;
+    depthBestMove = 0;
+    searchComplete = false;
+}
+
+// Evaluates the line of play given by choice[], then moves choice[] on to the next line.
+static void searchLeaf()
+{
+    uint8_t level = validLevels;
+    while (level < depth)
+    {
+        if (isRedundant(choice[level], pairs[level]))
+        {
+            advance(level);
+            return;
+        }
+
+        path[level + 1] = path[level];
+        pathEnemyBubbles[level + 1] = pathEnemyBubbles[level];
+        MoveResult result;
+        if (!applyPlacement(path[level + 1], placementFromIndex(rootBoard.mode, choice[level]), pairs[level], pathEnemyBubbles[level + 1], result))
+        {
+            // Nothing below a losing move needs searching.
+            stats.nodes++;
+            record(LOST_VALUE + level);
+            advance(level);
+            return;
+        }
+        pathValue[level + 1] = pathValue[level] + static_cast<int32_t>(result.score) + (result.garbage * GARBAGE_VALUE);
+        level++;
+        validLevels = level;
+    }
+
+    stats.nodes++;
+    record(pathValue[depth] + evaluateBoard(path[depth]));
+    advance(depth - 1);
+}
+
+// Steps the counter at level, resetting every level below it. Finishes the depth when the counter wraps.
+static void advance(uint8_t level)
+{
+    for (uint8_t i = level + 1; i < depth; i++)
+    {
+        choice[i] = 0;
+    }
+    for (;;)
+    {
+        choice[level]++;
+        if (choice[level] < numPlacements(rootBoard.mode))
+        {
+            validLevels = std::min(validLevels, level);
+            return;
+        }
+        choice[level] = 0;
+        if (level == 0)
+        {
+            break;
+        }
+        level--;
+    }
+
+    bestMove = depthBestMove;
+    bestDepth = depth;
+    stats.depthReached = depth;
+    if (depth < BOT_MAX_SEARCH_DEPTH)
+    {
+        startDepth(depth + 1);
+    }
+    else
+    {
+        searchComplete = true;
+    }
+}
+
+static void record(const int32_t value)
+{
+    if (value > depthBestValue)
+    {
+        depthBestValue = value;
+        depthBestMove = choice[0];
+    }
+}
+
+// When both bubbles are the same colour, north/south and east/west placements give the same board.
+static bool isRedundant(const uint8_t placement, const std::pair<BubbleColor, BubbleColor> &colors)
+{
+    if (colors.first != colors.second)
+    {
+        return false;
+    }
+    Direction direction = placementFromIndex(rootBoard.mode, placement).buddyDirection;
+    return direction == NORTH || direction == WEST;
+}
+
+static Direction getBuddyDirection(const glm::ivec2 &mainBubble, const glm::ivec2 &buddyBubble)
+{
+    if (buddyBubble.x > mainBubble.x)
+    {
+        return EAST;
+    }
+    else if (buddyBubble.x < mainBubble.x)
+    {
+        return WEST;
+    }
+    else if (buddyBubble.y > mainBubble.y)
+    {
+        return SOUTH;
+    }
+    return NORTH;
+}
+
+static Direction rotateCW(const Direction direction)
+{
+    return static_cast<Direction>((direction + 1) % 4);
+}
+
+static Direction rotateACW(const Direction direction)
+{
+    return static_cast<Direction>((direction + 3) % 4);
+}
@@ -0,0 +1,60 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <utility>
+#include "defs.h"
+#include "board.h"
+#include "game_logic.h"
+
+/* Computer player.
+ *
+ * The bot runs an iterative deepening search over placements of the falling pair, the next pair and
+ * then sampled pairs, scoring leaves with evaluateBoard under the match's rules. The search is resumable:
+ * each call to continueBotSearch works until its time budget runs out and picks up where it left off on
+ * the next frame, always keeping the best move from the deepest fully searched depth.
+ */
+
+// Time the bot may use per frame. Leaves the rest of the frame for game logic and rendering.
+const double BOT_FRAME_BUDGET_SECONDS = TARGET_FRAME_SECONDS * 0.25;
+// The search stops on the first leaf after its budget runs out. Going over by more than this counts as a deadline miss.
+const double BOT_DEADLINE_SLACK_SECONDS = 0.0005;
+// Search depth in pairs. Depths past the next pair use pairs sampled at the start of the search.
+const uint8_t BOT_MAX_SEARCH_DEPTH = 4;
+
+struct BotStats
+{
+    // Calls to continueBotSearch.
+    uint32_t frames;
+    // Calls that ran past their time budget (plus BOT_DEADLINE_SLACK_SECONDS).
+    uint32_t deadlineMisses;
+    double worstOverrunSeconds;
+    // Searches started on a new position, and how many of those began speculatively.
+    uint32_t searches;
+    uint32_t speculativeSearches;
+    // Speculative searches that matched the real position and so were kept.
+    uint32_t speculativeHits;
+    // Deepest completed depth of the current search, and the total over all finished pairs (for an average).
+    uint8_t depthReached;
+    uint32_t depthTotal;
+    uint32_t movesMade;
+    uint64_t nodes;
+};
+
+void resetBot();
+/*
+ * Sets the position to search. If it matches the position already being searched the search carries on
+ * (with results for the falling pair kept even if the next pair has changed), otherwise it starts again.
+ * Set speculative when the board is a prediction of where the game will be once the current pair has settled.
+**/
+void startBotSearch(const Board &board, const std::pair<BubbleColor, BubbleColor> &colors, const std::pair<BubbleColor, BubbleColor> &nextColors, const uint8_t numEnemyBubbles, const bool speculative);
+// Searches until the budget is used or the search is complete. Returns true when complete.
+bool continueBotSearch(const double budgetSeconds);
+// Works out the board once the bubbles that are still falling, and any waiting enemy bubbles, have settled.
+void predictSettledBoard(const MatchState &match, Board &board);
+// Presses the controls needed to move the player pair towards the best placement found so far.
+void steerBot(const MatchState &match, Controls &controls);
+// Called when the player pair has settled, to record stats for the move.
+void botMoveFinished();
+const BotStats &getBotStats();
+
+#endif
@@ -0,0 +1,95 @@
+#include <string.h>
+#include "bubble_batch.h"
+#include "stream_buffer.h"
+#include "render_queue.h"
+
+// Window rectangle, atlas rectangle, then colour with the clip line in alpha. Laid out as the instance attributes.
+struct BubbleInstance
+{
+    GLfloat rect[4];
+    GLfloat texRect[4];
+    GLfloat colorClip[4];
+};
+static_assert(sizeof(BubbleInstance) == BUBBLE_INSTANCE_VERTICES * STREAM_VERTEX_SIZE, "Instances are streamed as whole vertices");
+
+// Corners of the unit quad, as a triangle strip.
+static const GLfloat QUAD_CORNERS[8] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+
+static Shader shader;
+static GLuint VAO = 0;
+static GLuint cornerVBO = 0;
+static BubbleInstance instances[MAX_BATCHED_BUBBLES];
+static uint16_t numInstances = 0;
+// All bubbles in the batch share this.
+static GLuint batchTexture = 0;
+
+void initBubbleBatch(Shader &shaderToUse)
+{
+    shader = shaderToUse;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &cornerVBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_CORNERS), QUAD_CORNERS, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    // The render queue points the instance attributes at the stream buffer when each batch is drawn.
+    for (GLuint i = 1; i <= 3; i++)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    numInstances = 0;
+}
+
+void deleteBubbleBatch()
+{
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &cornerVBO);
+    VAO = 0;
+    cornerVBO = 0;
+}
+
+void addBatchedBubble(const AtlasRegion &region, const GLuint atlasColumn, const GLuint atlasRow, const glm::vec2 windowPosition,
+    const float size, const glm::vec3 color, const float clipY)
+{
+    if (numInstances >= MAX_BATCHED_BUBBLES)
+    {
+        return;
+    }
+    batchTexture = region.Texture.ID;
+    BubbleInstance &instance = instances[numInstances++];
+    instance.rect[0] = windowPosition.x;
+    instance.rect[1] = windowPosition.y;
+    instance.rect[2] = size;
+    instance.rect[3] = size;
+    instance.texRect[0] = region.Origin.x + region.CellSize.x * atlasColumn;
+    instance.texRect[1] = region.Origin.y + region.CellSize.y * atlasRow;
+    instance.texRect[2] = region.CellSize.x;
+    instance.texRect[3] = region.CellSize.y;
+    instance.colorClip[0] = color.r;
+    instance.colorClip[1] = color.g;
+    instance.colorClip[2] = color.b;
+    instance.colorClip[3] = clipY;
+}
+
+void drawBubbleBatch()
+{
+    if (numInstances == 0)
+    {
+        return;
+    }
+    GLint first;
+    GLfloat *data = allocateStreamVertices(numInstances * BUBBLE_INSTANCE_VERTICES, first);
+    memcpy(data, instances, numInstances * sizeof(BubbleInstance));
+    finishStreamVertices();
+
+    RenderCommand command = makeRenderCommand(PASS_SPRITES, shader.ID, batchTexture, VAO, GL_TRIANGLE_STRIP, 0, 4);
+    command.instances = numInstances;
+    command.instanceFirst = first;
+    command.instanceVec4s = BUBBLE_INSTANCE_VERTICES;
+    submitRenderCommand(command);
+    numInstances = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef BUBBLE_BATCH_H
+#define BUBBLE_BATCH_H
+
+#include "defs.h"
+#include "shader.h"
+#include "resource_manager.h"
+
+/* Instanced bubble drawing.
+ *
+ * Bubbles are added to a batch as they are found and drawn together with one instanced draw of a unit quad.
+ * Each instance is its window rectangle, its cell of the atlas and its colour, streamed through the stream
+ * buffer like sprite vertices. Every bubble in a batch has to come from the same atlas texture.
+ */
+
+// Each instance takes this many stream buffer vertices.
+const GLuint BUBBLE_INSTANCE_VERTICES = 3;
+// Bubbles in one batch. Sixteen full boards, with everything falling, are well under this.
+const uint16_t MAX_BATCHED_BUBBLES = 4096;
+
+void initBubbleBatch(Shader &shaderToUse);
+void deleteBubbleBatch();
+/*
+ * Adds a bubble drawn from a cell of the atlas region. Bubbles are clipped above clipY, in window space.
+ * Bubbles past MAX_BATCHED_BUBBLES are dropped.
+**/
+void addBatchedBubble(const AtlasRegion &region, const GLuint atlasColumn, const GLuint atlasRow, const glm::vec2 windowPosition,
+    const float size, const glm::vec3 color, const float clipY = 0.0f);
+// Queues one draw of every bubble added since the last call, then empties the batch.
+void drawBubbleBatch();
+
+#endif
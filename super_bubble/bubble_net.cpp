@@ -13,6 +13,8 @@ static ENetHost *server = nullptr;
 static ENetHost *client = nullptr;
 static ENetPeer *peer = nullptr;
 static bool connected = false;
+// Rules the server plays by, sent to the client in the hello.
+static MatchMode hostMode = MODE_CLASSIC;
 
 static void disconnect();
 static bool sendHello();
@@ -30,8 +32,9 @@ static struct BubbleInfo
 /*
 Returns true for success.
 */
-bool createServer()
+bool createServer(const MatchMode mode)
 {
+    hostMode = mode;
     if (server == nullptr)
     {
         address.host = ENET_HOST_ANY;
@@ -122,6 +125,7 @@ NetMessage updateNetwork()
     NetMessage result;
     result.type = NO_MESSAGE;
     result.numBubbles = 0;
+    result.mode = hostMode;
 
     if (host != nullptr)
     {
@@ -132,18 +136,15 @@ NetMessage updateNetwork()
             {
             case ENET_EVENT_TYPE_CONNECT:
                 std::cout << "Connected" << std::endl;
-                connected = true;
-                result.type = NetMessageType::CONNECTED;
                 if (peer == nullptr)
                 {
-                    // Server.
-                    peer = event.peer;                    
-                }
-                else
-                {
-                    // Client.
-                    sendHello();                    
+                    // Server. Tell the client which rules to play by.
+                    peer = event.peer;
+                    connected = true;
+                    result.type = NetMessageType::CONNECTED;
+                    sendHello();
                 }
+                // Client. The match starts when the server's hello arrives.
                 break;
             case ENET_EVENT_TYPE_RECEIVE:
                 info.type = *(event.packet->data);
@@ -152,6 +153,16 @@ NetMessage updateNetwork()
                 switch (info.type)
                 {
                 case TYPE_HELLO:
+                    if (server == nullptr && info.value < NUM_MATCH_MODES)
+                    {
+                        connected = true;
+                        result.type = NetMessageType::CONNECTED;
+                        result.mode = static_cast<MatchMode>(info.value);
+                    }
+                    else if (server == nullptr)
+                    {
+                        std::cout << "Server plays a mode this version doesn't have" << std::endl;
+                    }
                     break;
                 case TYPE_NUM_BUBBLES:
                     result.type = NetMessageType::NUM_BUBBLES;
@@ -208,10 +219,11 @@ static bool sendHello()
         return false;
     }
     info.type = TYPE_HELLO;
-    info.value = 0;
+    info.value = static_cast<uint8_t>(hostMode);
     // ENet will handle packet deallocation.
     ENetPacket *packet = enet_packet_create(&info, sizeof(info), ENET_PACKET_FLAG_RELIABLE);
     enet_peer_send(peer, CHANNEL_ID, packet);
+    return true;
 }
 
 /*
@@ -1,6 +1,8 @@
 #ifndef NET_H
 #define NET_H
 
+#include "match_rules.h"
+
 enum NetMessageType
 {
     NO_MESSAGE,
@@ -15,9 +17,12 @@ struct NetMessage
     NetMessageType type;
     // Only valid if type is NUM_BUBBLES, otherwise should be zero.
     uint8_t numBubbles;
+    // Only valid if type is CONNECTED. The host's rules, which both players use.
+    MatchMode mode;
 };
 
-bool createServer();
+// mode is sent to the client when it connects.
+bool createServer(const MatchMode mode);
 bool createClient();
 bool clientConnect(const char* hostName);
 NetMessage updateNetwork();
@@ -12,21 +12,23 @@ static struct CollisionInfo
     uint8_t checkY[MAX_Y_CHECKS];
 };
 
-static CollisionInfo calcCollisionInfo(const Bubble &playerBubble0, const Bubble &playerBubble1);
+static CollisionInfo calcCollisionInfo(const glm::ivec2 &playerBubble0, const glm::ivec2 &playerBubble1);
 
 
-bool canGoLeft(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &playerBubble0, const Bubble &playerBubble1)
+template<typename Rules>
+bool canGoLeft(GridCell const (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &playerBubble0, const glm::ivec2 &playerBubble1)
 {
     CollisionInfo info = calcCollisionInfo(playerBubble0, playerBubble1);
 
-    if (info.checkXLeft < 0 || info.checkXLeft >= GRID_COLUMNS)
+    if (info.checkXLeft < 0 || info.checkXLeft >= Rules::COLUMNS)
     {
         return false;
     }
 
     for (uint8_t i = 0; i < CollisionInfo::MAX_Y_CHECKS; i++)
     {
-        if (info.checkY[i] != CollisionInfo::EMPTY_Y_VALUE && grid[info.checkXLeft][info.checkY[i]].state == IDLE)
+        // Rows above the play space (a newly spawned pair) wrap to large values and have nothing in them.
+        if (info.checkY[i] != CollisionInfo::EMPTY_Y_VALUE && info.checkY[i] < Rules::ROWS && cellState(grid[info.checkXLeft][info.checkY[i]]) == IDLE)
         {
             return false;
         }
@@ -35,11 +37,12 @@ bool canGoLeft(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &play
     return true;
 }
 
-bool canGoRight(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &playerBubble0, const Bubble &playerBubble1)
+template<typename Rules>
+bool canGoRight(GridCell const (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &playerBubble0, const glm::ivec2 &playerBubble1)
 {
     CollisionInfo info = calcCollisionInfo(playerBubble0, playerBubble1);
 
-    if (info.checkXRight < 0 || info.checkXRight >= GRID_COLUMNS)
+    if (info.checkXRight < 0 || info.checkXRight >= Rules::COLUMNS)
     {
         return false;
     }
@@ -47,7 +50,7 @@ bool canGoRight(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &pla
     for (uint8_t i = 0; i < CollisionInfo::MAX_Y_CHECKS; i++)
     {
         // IDLE means there is something in the grid location.
-        if (info.checkY[i] != CollisionInfo::EMPTY_Y_VALUE && grid[info.checkXRight][info.checkY[i]].state == IDLE)
+        if (info.checkY[i] != CollisionInfo::EMPTY_Y_VALUE && info.checkY[i] < Rules::ROWS && cellState(grid[info.checkXRight][info.checkY[i]]) == IDLE)
         {
             return false;
         }
@@ -56,7 +59,15 @@ bool canGoRight(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &pla
     return true;
 }
 
-static CollisionInfo calcCollisionInfo(const Bubble &playerBubble0, const Bubble &playerBubble1)
+// One copy for each mode.
+template bool canGoLeft<ClassicRules>(GridCell const (&)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &, const glm::ivec2 &);
+template bool canGoLeft<ThreeMatchRules>(GridCell const (&)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &, const glm::ivec2 &);
+template bool canGoLeft<WideRules>(GridCell const (&)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &, const glm::ivec2 &);
+template bool canGoRight<ClassicRules>(GridCell const (&)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &, const glm::ivec2 &);
+template bool canGoRight<ThreeMatchRules>(GridCell const (&)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &, const glm::ivec2 &);
+template bool canGoRight<WideRules>(GridCell const (&)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &, const glm::ivec2 &);
+
+static CollisionInfo calcCollisionInfo(const glm::ivec2 &playerBubble0, const glm::ivec2 &playerBubble1)
 {
     CollisionInfo result;
 
@@ -66,16 +77,16 @@ static CollisionInfo calcCollisionInfo(const Bubble &playerBubble0, const Bubble
     glm::ivec2 gridPos1b;
     bool exactlyInGrid;
 
-    // Convert input to grid coordinates, making sure gridPos0x always refers to the bubble with smallest Y.
-    if (playerBubble0.playSpacePosition.y < playerBubble1.playSpacePosition.y)
+    // Positions are in play space. Convert input to grid coordinates, making sure gridPos0x always refers to the bubble with smallest Y.
+    if (playerBubble0.y < playerBubble1.y)
     {
-        exactlyInGrid = (playSpaceToNearestVerticalGrid(playerBubble0.playSpacePosition, gridPos0a, gridPos0b) == 1);
-        playSpaceToNearestVerticalGrid(playerBubble1.playSpacePosition, gridPos1a, gridPos1b);
+        exactlyInGrid = (playSpaceToNearestVerticalGrid(playerBubble0, gridPos0a, gridPos0b) == 1);
+        playSpaceToNearestVerticalGrid(playerBubble1, gridPos1a, gridPos1b);
     }
     else
     {
-        exactlyInGrid = (playSpaceToNearestVerticalGrid(playerBubble1.playSpacePosition, gridPos0a, gridPos0b) == 1);
-        playSpaceToNearestVerticalGrid(playerBubble0.playSpacePosition, gridPos1a, gridPos1b);
+        exactlyInGrid = (playSpaceToNearestVerticalGrid(playerBubble1, gridPos0a, gridPos0b) == 1);
+        playSpaceToNearestVerticalGrid(playerBubble0, gridPos1a, gridPos1b);
     }
 
     if (gridPos0a.x <= gridPos1a.x)
@@ -90,7 +101,7 @@ static CollisionInfo calcCollisionInfo(const Bubble &playerBubble0, const Bubble
     }
 
     // Fill in the CollisionInfo struct with the Y values in the grid that need to be checked for collisions.
-    if (playerBubble0.playSpacePosition.x == playerBubble1.playSpacePosition.x)
+    if (playerBubble0.x == playerBubble1.x)
     {
         // Bubbles are stacked.
         if (exactlyInGrid)
@@ -106,7 +117,7 @@ static CollisionInfo calcCollisionInfo(const Bubble &playerBubble0, const Bubble
             result.checkY[2] = gridPos1b.y;
         }
     }
-    else if (playerBubble0.playSpacePosition.y == playerBubble1.playSpacePosition.y)
+    else if (playerBubble0.y == playerBubble1.y)
     {
         // Bubbles are side by side.
         if (exactlyInGrid)
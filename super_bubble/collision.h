@@ -1,8 +1,12 @@
 #ifndef COLLISION_H
 #define COLLISION_H
 #include "defs.h"
+#include "match_rules.h"
 
-bool canGoLeft(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &playerBubble0, const Bubble &playerBubble1);
-bool canGoRight(Bubble const (&grid)[GRID_COLUMNS][GRID_ROWS], const Bubble &playerBubble0, const Bubble &playerBubble1);
+// Whether the pair can move a column over in the mode's grid. Built in collision.cpp for each mode's rules.
+template<typename Rules>
+bool canGoLeft(GridCell const (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &playerBubble0, const glm::ivec2 &playerBubble1);
+template<typename Rules>
+bool canGoRight(GridCell const (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS], const glm::ivec2 &playerBubble0, const glm::ivec2 &playerBubble1);
 
 #endif
@@ -47,19 +47,11 @@ const glm::vec4 MENU_CLEAR_COLOR = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
 const double TARGET_FPS = 60.0;
 const double TARGET_FRAME_SECONDS = 1.0 / TARGET_FPS;
 
-// FPS and frames for bubble animations. All bubbles have the same number of frames.
+// Frames for bubble animations. All bubbles have the same number of frames.
 const int8_t BUBBLE_FRAMES = 10;
-const double BUBBLE_FPS = 20.0;
-const double BUBBLE_FRAME_SECONDS = 1.0 / BUBBLE_FPS;
-
-// Size of the play field in grid space.
-const uint8_t GRID_ROWS = 10;
-const uint8_t GRID_COLUMNS = 6;
-
-// Length of bubble chain needed to kill chain.
-const uint8_t CHAIN_DEATH_LENGTH = 4;
-// Length of bubble chain needed to send to other player.
-const uint8_t CHAIN_MIN_SEND_LENGTH = 5;
+// Ticks each animation frame lasts. The frames used to be counted off in seconds at 20 a second, resetting rather
+// than carrying over, which held each one for four ticks rather than three. Kept so replays play the same.
+const uint8_t BUBBLE_FRAME_TICKS = 4;
 
 const int8_t BOUNCE_HEIGHT = 6;
 
@@ -89,6 +81,15 @@ enum BubbleColor { RED, GREEN, BLUE, YELLOW, GHOST };
 enum BubbleState { DEAD, IDLE, FALLING, DYING };
 const uint8_t MAX_SPAWN_COLOR = YELLOW;
 
+// Direction of the buddy bubble relative to the main bubble of the player pair.
+enum Direction
+{
+    NORTH,
+    EAST,
+    SOUTH,
+    WEST
+};
+
 const glm::vec3 BUBBLE_COLORS[] =
 {
     // Red
@@ -103,29 +104,33 @@ const glm::vec3 BUBBLE_COLORS[] =
     glm::vec3(0.7f, 0.7f, 0.7f)
 };
 
-struct Bubble
+/*
+ * A grid cell in one byte: the bubble's colour in the low four bits and its state in the high four.
+ * Where a bubble is drawn follows from its column and row, so nothing else is kept for it.
+**/
+typedef uint8_t GridCell;
+const uint8_t CELL_STATE_SHIFT = 4;
+const uint8_t CELL_COLOR_MASK = 0x0F;
+
+inline GridCell makeGridCell(const BubbleColor color, const BubbleState state)
 {
-    // This is the position within the play area.
-    glm::ivec2 playSpacePosition;
-    BubbleColor color;
-    BubbleState state;
-    uint8_t animationFrame;
-    bool visited;
-    int8_t bounceAmount;
-    int8_t bounceDir;
-
-    Bubble()
-    {
-        playSpacePosition.x = 0;
-        playSpacePosition.y = 0;
-        color = RED;
-        state = IDLE;
-        animationFrame = 0;
-        visited = false;
-        bounceAmount = 0;
-        bounceDir = 0;
-    }    
-};
+    return static_cast<GridCell>(color | (state << CELL_STATE_SHIFT));
+}
+
+inline BubbleColor cellColor(const GridCell cell)
+{
+    return static_cast<BubbleColor>(cell & CELL_COLOR_MASK);
+}
+
+inline BubbleState cellState(const GridCell cell)
+{
+    return static_cast<BubbleState>(cell >> CELL_STATE_SHIFT);
+}
+
+inline void setCellState(GridCell &cell, const BubbleState state)
+{
+    cell = makeGridCell(cellColor(cell), state);
+}
 
 struct Controls
 {
@@ -137,9 +142,8 @@ struct Controls
 };
 
 
-// UV size of sub images in texture atlases.
-const glm::vec2 UV_SIZE_BUBBLE = glm::vec2(0.1f, 0.25f);
-const glm::vec2 UV_SIZE_WHOLE_IMAGE = glm::vec2(1.0f, 1.0f);
+// Rows of animation frames in the bubbles image, one for each bubble state and a spare. There are BUBBLE_FRAMES columns.
+const uint8_t BUBBLE_IMAGE_ROWS = 4;
 
 // Rows in texture atlas for different bubble states.
 const uint8_t TEXTURE_ROW_IDLE = 0;
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include "evaluator.h"
+
+static const uint32_t NUM_BENCHMARK_BOARDS = 4096;
+
+static void makeBoards(std::vector<Board> &boards);
+
+void benchmarkEvaluators(const uint32_t iterations)
+{
+    std::vector<Board> boards;
+    makeBoards(boards);
+
+    TunableEvaluator tunable;
+    // Accumulate the results so the evaluations can't be optimised away.
+    int64_t total = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        total += DefaultEvaluator::evaluate(boards[i % boards.size()]);
+    }
+    const double compiledSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        total -= tunable.evaluate(boards[i % boards.size()]);
+    }
+    const double runtimeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Evaluator benchmark, " << iterations << " evaluations over " << boards.size() << " boards" << std::endl;
+    std::cout << "  compile time weights: " << (compiledSeconds * 1e9 / iterations) << " ns/eval" << std::endl;
+    std::cout << "  run time weights:     " << (runtimeSeconds * 1e9 / iterations) << " ns/eval" << std::endl;
+    // Both use the same weights, so this should be zero.
+    std::cout << "  checksum: " << total << std::endl;
+}
+
+// Boards from random play, so heights and colours look like a real match.
+static void makeBoards(std::vector<Board> &boards)
+{
+    uint32_t rng = 12345;
+    Board board;
+    clearBoard(board);
+    while (boards.size() < NUM_BENCHMARK_BOARDS)
+    {
+        uint8_t numEnemyBubbles = (nextRandom(rng) % 8 == 0) ? nextRandom(rng) % 6 : 0;
+        MoveResult result;
+        std::pair<BubbleColor, BubbleColor> colors(randomColor(rng), randomColor(rng));
+        if (applyPlacement(board, placementFromIndex(board.mode, nextRandom(rng) % numPlacements(board.mode)), colors, numEnemyBubbles, result))
+        {
+            boards.push_back(board);
+        }
+        else
+        {
+            clearBoard(board);
+        }
+    }
+}
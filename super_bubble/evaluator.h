@@ -0,0 +1,324 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <stdint.h>
+#include "board.h"
+
+/* Heuristic board evaluation for bots.
+ *
+ * Each feature is a policy class that accumulates its value while the board is walked once, column by
+ * column from the top row down. A feature must provide:
+ *  void cell(const Board &board, uint8_t col, uint8_t row, uint8_t cell) - called for every occupied cell.
+ *  int32_t value() const                                                 - raw value after the walk.
+ *  static const int32_t WEIGHT                                           - weight used by BoardEvaluator.
+ *
+ * BoardEvaluator<Rules, ...> bakes the feature set and weights in at compile time, so features that aren't
+ * listed cost nothing. RuntimeEvaluator<Rules, ...> walks the same features but takes its weights at run time
+ * for tuning. Both walk the grid of the Rules policy, and features that depend on the grid or the chain
+ * lengths take the same policy.
+ */
+
+// Variance of the column heights (scaled by the number of columns squared to stay in integers).
+template <int32_t Weight = -1, typename Rules = ClassicRules>
+struct HeightVariance
+{
+    static const int32_t WEIGHT = Weight;
+    int32_t sum;
+    int32_t sumSquares;
+
+    HeightVariance() : sum(0), sumSquares(0) { }
+
+    void cell(const Board &board, const uint8_t col, const uint8_t row, const uint8_t /*cell*/)
+    {
+        // Stacks have no gaps, so the first occupied cell from the top gives the column height.
+        if (row == 0 || board.cells[col][row - 1] == CELL_EMPTY)
+        {
+            const int32_t height = Rules::ROWS - row;
+            sum += height;
+            sumSquares += height * height;
+        }
+    }
+
+    int32_t value() const
+    {
+        return (Rules::COLUMNS * sumSquares) - (sum * sum);
+    }
+};
+
+// Height of the tallest column. Settling on the top row loses the game.
+template <int32_t Weight = -1, typename Rules = ClassicRules>
+struct MaxHeight
+{
+    static const int32_t WEIGHT = Weight;
+    int32_t height;
+
+    MaxHeight() : height(0) { }
+
+    void cell(const Board & /*board*/, const uint8_t /*col*/, const uint8_t row, const uint8_t /*cell*/)
+    {
+        if (Rules::ROWS - row > height)
+        {
+            height = Rules::ROWS - row;
+        }
+    }
+
+    int32_t value() const
+    {
+        return height;
+    }
+};
+
+// Number of touching pairs of the same colour (ghosts don't count).
+template <int32_t Weight = 1>
+struct ConnectedPairs
+{
+    static const int32_t WEIGHT = Weight;
+    int32_t pairs;
+
+    ConnectedPairs() : pairs(0) { }
+
+    void cell(const Board &board, const uint8_t col, const uint8_t row, const uint8_t cell)
+    {
+        if (cell == GHOST + 1)
+        {
+            return;
+        }
+        // Only look back at cells already walked so each pair is counted once.
+        if (row > 0 && board.cells[col][row - 1] == cell)
+        {
+            pairs++;
+        }
+        if (col > 0 && board.cells[col - 1][row] == cell)
+        {
+            pairs++;
+        }
+    }
+
+    int32_t value() const
+    {
+        return pairs;
+    }
+};
+
+// Ghost bubbles, plus coloured bubbles buried under them which can't be reached until the ghosts are cleared.
+template <int32_t Weight = -1>
+struct GhostBurden
+{
+    static const int32_t WEIGHT = Weight;
+    int32_t ghosts;
+    int32_t buried;
+    int8_t ghostColumn;
+
+    GhostBurden() : ghosts(0), buried(0), ghostColumn(-1) { }
+
+    void cell(const Board & /*board*/, const uint8_t col, const uint8_t /*row*/, const uint8_t cell)
+    {
+        if (cell == GHOST + 1)
+        {
+            ghosts++;
+            ghostColumn = col;
+        }
+        else if (ghostColumn == col)
+        {
+            buried++;
+        }
+    }
+
+    int32_t value() const
+    {
+        return ghosts + buried;
+    }
+};
+
+// Rewards groups that are close to the rules' CHAIN_DEATH_LENGTH: the sum of the squared sizes of every group
+// that can still grow. Groups are tracked with a union-find as the cells are walked.
+template <int32_t Weight = 1, typename Rules = ClassicRules>
+struct ChainPotential
+{
+    static const int32_t WEIGHT = Weight;
+    uint8_t parent[Rules::COLUMNS * Rules::ROWS];
+    uint8_t size[Rules::COLUMNS * Rules::ROWS];
+    int32_t potential;
+
+    ChainPotential() : potential(0) { }
+
+    void cell(const Board &board, const uint8_t col, const uint8_t row, const uint8_t cell)
+    {
+        if (cell == GHOST + 1)
+        {
+            return;
+        }
+        const uint8_t index = (col * Rules::ROWS) + row;
+        parent[index] = index;
+        size[index] = 1;
+        potential += score(1);
+        if (row > 0 && board.cells[col][row - 1] == cell)
+        {
+            join(index, index - 1);
+        }
+        if (col > 0 && board.cells[col - 1][row] == cell)
+        {
+            join(index, index - Rules::ROWS);
+        }
+    }
+
+    int32_t value() const
+    {
+        return potential;
+    }
+
+private:
+    static int32_t score(const uint8_t groupSize)
+    {
+        return groupSize < Rules::CHAIN_DEATH_LENGTH ? groupSize * groupSize : 0;
+    }
+
+    uint8_t find(uint8_t index)
+    {
+        while (parent[index] != index)
+        {
+            parent[index] = parent[parent[index]];
+            index = parent[index];
+        }
+        return index;
+    }
+
+    void join(const uint8_t a, const uint8_t b)
+    {
+        uint8_t rootA = find(a);
+        uint8_t rootB = find(b);
+        if (rootA == rootB)
+        {
+            return;
+        }
+        potential -= score(size[rootA]) + score(size[rootB]);
+        parent[rootB] = rootA;
+        size[rootA] += size[rootB];
+        potential += score(size[rootA]);
+    }
+};
+
+// Walks the board once, feeding every occupied cell to each feature in turn.
+template <typename... Features>
+struct FeaturePass;
+
+template <>
+struct FeaturePass<>
+{
+    void cell(const Board &, const uint8_t, const uint8_t, const uint8_t) { }
+    void values(int32_t *) const { }
+    int32_t weighted() const { return 0; }
+    int32_t weighted(const int32_t *) const { return 0; }
+};
+
+template <typename Feature, typename... Rest>
+struct FeaturePass<Feature, Rest...>
+{
+    Feature head;
+    FeaturePass<Rest...> tail;
+
+    void cell(const Board &board, const uint8_t col, const uint8_t row, const uint8_t cell)
+    {
+        head.cell(board, col, row, cell);
+        tail.cell(board, col, row, cell);
+    }
+
+    void values(int32_t *out) const
+    {
+        out[0] = head.value();
+        tail.values(out + 1);
+    }
+
+    int32_t weighted() const
+    {
+        return (Feature::WEIGHT * head.value()) + tail.weighted();
+    }
+
+    int32_t weighted(const int32_t *weights) const
+    {
+        return (weights[0] * head.value()) + tail.weighted(weights + 1);
+    }
+};
+
+template <typename Rules, typename... Features>
+void walkBoard(const Board &board, FeaturePass<Features...> &pass)
+{
+    for (uint8_t col = 0; col < Rules::COLUMNS; col++)
+    {
+        for (uint8_t row = 0; row < Rules::ROWS; row++)
+        {
+            const uint8_t cell = board.cells[col][row];
+            if (cell != CELL_EMPTY)
+            {
+                pass.cell(board, col, row, cell);
+            }
+        }
+    }
+}
+
+template <typename Rules, typename... Features>
+struct BoardEvaluator
+{
+    static const uint8_t NUM_FEATURES = sizeof...(Features);
+
+    static int32_t evaluate(const Board &board)
+    {
+        FeaturePass<Features...> pass;
+        walkBoard<Rules>(board, pass);
+        return pass.weighted();
+    }
+
+    // Raw (unweighted) feature values, in the order the features are listed.
+    static void features(const Board &board, int32_t (&out)[sizeof...(Features)])
+    {
+        FeaturePass<Features...> pass;
+        walkBoard<Rules>(board, pass);
+        pass.values(out);
+    }
+};
+
+template <typename Rules, typename... Features>
+struct RuntimeEvaluator
+{
+    static const uint8_t NUM_FEATURES = sizeof...(Features);
+    // Starts with the compile time weights of the features.
+    int32_t weights[sizeof...(Features)];
+
+    RuntimeEvaluator() : weights{ Features::WEIGHT... } { }
+
+    int32_t evaluate(const Board &board) const
+    {
+        FeaturePass<Features...> pass;
+        walkBoard<Rules>(board, pass);
+        return pass.weighted(weights);
+    }
+};
+
+// The feature set used by the bots, measured against a mode's grid and chain lengths.
+template <typename Rules>
+using ModeEvaluator = BoardEvaluator<Rules, HeightVariance<-2, Rules>, MaxHeight<-40, Rules>, ConnectedPairs<30>, GhostBurden<-25>, ChainPotential<8, Rules>>;
+template <typename Rules>
+using TunableModeEvaluator = RuntimeEvaluator<Rules, HeightVariance<-2, Rules>, MaxHeight<-40, Rules>, ConnectedPairs<30>, GhostBurden<-25>, ChainPotential<8, Rules>>;
+typedef ModeEvaluator<ClassicRules> DefaultEvaluator;
+typedef TunableModeEvaluator<ClassicRules> TunableEvaluator;
+
+// Scores a board with the bots' feature set under the board's own rules, picked the way settleBoard picks its copy.
+inline int32_t evaluateBoard(const Board &board)
+{
+    switch (board.mode)
+    {
+    case MODE_THREE_MATCH:
+        return ModeEvaluator<ThreeMatchRules>::evaluate(board);
+    case MODE_WIDE:
+        return ModeEvaluator<WideRules>::evaluate(board);
+    default:
+        return ModeEvaluator<ClassicRules>::evaluate(board);
+    }
+}
+
+/*
+ * Times both evaluators over a set of random boards and prints the cost per evaluation.
+**/
+void benchmarkEvaluators(const uint32_t iterations);
+
+#endif
@@ -0,0 +1,296 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <SOIL.h>
+#include "frame_export.h"
+#include "render_queue.h"
+
+// Longest wait for a readback fence before checking again.
+static const GLuint64 EXPORT_FENCE_WAIT_NANOSECONDS = 100000000;
+
+// A frame on its way from the GPU to the writer thread.
+struct ExportFrame
+{
+    uint32_t number;
+    std::vector<uint8_t> pixels;
+};
+
+// A readback in flight.
+struct ReadbackBuffer
+{
+    GLuint PBO;
+    GLsync fence;
+    uint32_t frameNumber;
+};
+
+static GLuint FBO = 0;
+static GLuint colorBuffer = 0;
+static ReadbackBuffer readbackBuffers[EXPORT_READBACK_BUFFERS];
+static GLuint exportWidth = 0;
+static GLuint exportHeight = 0;
+static ExportFormat exportFormat = EXPORT_RAW;
+static std::string exportDirectory;
+static FILE *rawFile = nullptr;
+static uint32_t framesDrawn = 0;
+
+// Shared with the writer thread. Only touched with the mutex held.
+static std::mutex writeMutex;
+static std::condition_variable frameQueued;
+static std::condition_variable frameWritten;
+static std::deque<ExportFrame*> writeQueue;
+static std::vector<ExportFrame*> freeFrames;
+static bool writerClosing = false;
+static uint32_t framesWritten = 0;
+static bool writeFailed = false;
+static std::thread writer;
+
+static void collectReadback(ReadbackBuffer &buffer);
+static void writeFrames();
+static bool writeFrame(const ExportFrame &frame, std::vector<uint8_t> &flipped);
+
+bool startFrameExport(const char *directory, const GLuint width, const GLuint height, const ExportFormat format)
+{
+    exportWidth = width;
+    exportHeight = height;
+    exportFormat = format;
+    exportDirectory.assign(directory);
+    if (!exportDirectory.empty() && exportDirectory.back() != '/' && exportDirectory.back() != '\\')
+    {
+        exportDirectory.append("/");
+    }
+    if (format == EXPORT_RAW)
+    {
+        const std::string fileName = exportDirectory + "frames.rgba";
+        rawFile = fopen(fileName.c_str(), "wb");
+        if (rawFile == nullptr)
+        {
+            std::cout << "Failed to create " << fileName << std::endl;
+            return false;
+        }
+    }
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cout << "Export framebuffer of " << width << "x" << height << " is not supported" << std::endl;
+        finishFrameExport();
+        return false;
+    }
+
+    // GL_STREAM_READ: written once by the GPU, read once by us.
+    const GLsizeiptr frameSize = static_cast<GLsizeiptr>(width) * height * 4;
+    for (uint8_t i = 0; i < EXPORT_READBACK_BUFFERS; i++)
+    {
+        glGenBuffers(1, &readbackBuffers[i].PBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[i].PBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+        readbackBuffers[i].fence = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // All the frame memory is allocated here, so nothing is allocated per frame.
+    for (uint8_t i = 0; i < EXPORT_WRITE_BUFFERS; i++)
+    {
+        ExportFrame *frame = new ExportFrame;
+        frame->pixels.resize(frameSize);
+        freeFrames.push_back(frame);
+    }
+    framesDrawn = 0;
+    framesWritten = 0;
+    writeFailed = false;
+    writerClosing = false;
+    writer = std::thread(writeFrames);
+    return true;
+}
+
+void beginExportFrame()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, exportWidth, exportHeight);
+}
+
+void endExportFrame()
+{
+    flushRenderQueue();
+    ReadbackBuffer &buffer = readbackBuffers[framesDrawn % EXPORT_READBACK_BUFFERS];
+    if (buffer.fence != nullptr)
+    {
+        collectReadback(buffer);
+    }
+
+    // With a pixel pack buffer bound, glReadPixels only queues the copy and returns straight away.
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.PBO);
+    glReadPixels(0, 0, exportWidth, exportHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    buffer.frameNumber = framesDrawn++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, WIDTH, HEIGHT);
+}
+
+uint32_t finishFrameExport()
+{
+    // Oldest first, so frames are queued in order.
+    for (uint8_t i = 0; i < EXPORT_READBACK_BUFFERS; i++)
+    {
+        ReadbackBuffer &buffer = readbackBuffers[(framesDrawn + i) % EXPORT_READBACK_BUFFERS];
+        if (buffer.fence != nullptr)
+        {
+            collectReadback(buffer);
+        }
+    }
+
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            writerClosing = true;
+        }
+        frameQueued.notify_all();
+        writer.join();
+    }
+    for (ExportFrame *frame : freeFrames)
+    {
+        delete frame;
+    }
+    freeFrames.clear();
+    if (rawFile != nullptr)
+    {
+        fclose(rawFile);
+        rawFile = nullptr;
+    }
+
+    for (uint8_t i = 0; i < EXPORT_READBACK_BUFFERS; i++)
+    {
+        if (readbackBuffers[i].PBO != 0)
+        {
+            glDeleteBuffers(1, &readbackBuffers[i].PBO);
+            readbackBuffers[i].PBO = 0;
+        }
+    }
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    FBO = 0;
+    colorBuffer = 0;
+
+    if (writeFailed)
+    {
+        std::cout << "Failed to write frames to " << exportDirectory << std::endl;
+    }
+    return framesWritten;
+}
+
+// Waits for a readback to land, copies it out and queues it for the writer.
+static void collectReadback(ReadbackBuffer &buffer)
+{
+    while (glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, EXPORT_FENCE_WAIT_NANOSECONDS) == GL_TIMEOUT_EXPIRED)
+    {
+    }
+    glDeleteSync(buffer.fence);
+    buffer.fence = nullptr;
+
+    ExportFrame *frame;
+    {
+        // Blocks while the writer is behind, so frames can't pile up in memory.
+        std::unique_lock<std::mutex> lock(writeMutex);
+        frameWritten.wait(lock, []() { return !freeFrames.empty(); });
+        frame = freeFrames.back();
+        freeFrames.pop_back();
+    }
+
+    frame->number = buffer.frameNumber;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.PBO);
+    const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame->pixels.size(), GL_MAP_READ_BIT);
+    if (pixels != nullptr)
+    {
+        memcpy(frame->pixels.data(), pixels, frame->pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (pixels != nullptr)
+        {
+            writeQueue.push_back(frame);
+        }
+        else
+        {
+            writeFailed = true;
+            freeFrames.push_back(frame);
+        }
+    }
+    frameQueued.notify_one();
+}
+
+// Writer thread. Writes queued frames in order until finishFrameExport closes the queue.
+static void writeFrames()
+{
+    std::vector<uint8_t> flipped(static_cast<size_t>(exportWidth) * exportHeight * 4);
+    for (;;)
+    {
+        ExportFrame *frame;
+        {
+            std::unique_lock<std::mutex> lock(writeMutex);
+            frameQueued.wait(lock, []() { return !writeQueue.empty() || writerClosing; });
+            if (writeQueue.empty())
+            {
+                return;
+            }
+            frame = writeQueue.front();
+            writeQueue.pop_front();
+        }
+
+        const bool written = writeFrame(*frame, flipped);
+
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            if (written)
+            {
+                framesWritten++;
+            }
+            else
+            {
+                writeFailed = true;
+            }
+            freeFrames.push_back(frame);
+        }
+        frameWritten.notify_one();
+    }
+}
+
+static bool writeFrame(const ExportFrame &frame, std::vector<uint8_t> &flipped)
+{
+    // GL rows start at the bottom of the image, files at the top.
+    const size_t rowSize = static_cast<size_t>(exportWidth) * 4;
+    for (GLuint row = 0; row < exportHeight; row++)
+    {
+        memcpy(&flipped[row * rowSize], &frame.pixels[(exportHeight - 1 - row) * rowSize], rowSize);
+    }
+
+    if (exportFormat == EXPORT_RAW)
+    {
+        return fwrite(flipped.data(), 1, flipped.size(), rawFile) == flipped.size();
+    }
+    std::ostringstream fileName;
+    fileName << exportDirectory << "frame_" << std::setw(6) << std::setfill('0') << frame.number << ".tga";
+    return SOIL_save_image(fileName.str().c_str(), SOIL_SAVE_TYPE_TGA, exportWidth, exportHeight, 4, flipped.data()) != 0;
+}
@@ -0,0 +1,38 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <stdint.h>
+#include "defs.h"
+
+/* Offscreen frame export.
+ *
+ * Frames are drawn into a framebuffer object at the export size instead of the window, then copied into
+ * a ring of pixel buffers with glReadPixels. The copy runs on the GPU, and each buffer is only mapped a few
+ * frames later, once its fence has passed, so drawing never waits for the readback. The mapped pixels are
+ * handed to a writer thread, which does the file IO.
+ */
+
+enum ExportFormat
+{
+    // Every frame appended to one frames.rgba file, top row first:
+    // ffmpeg -f rawvideo -pix_fmt rgba -s <width>x<height> -r 60 -i frames.rgba out.mp4
+    EXPORT_RAW,
+    // One frame_NNNNNN.tga file per frame.
+    EXPORT_TGA
+};
+
+// Frames read back at once. Each frame is mapped this many frames after it was drawn.
+const uint8_t EXPORT_READBACK_BUFFERS = 3;
+// Frames waiting for the writer thread. Drawing waits when they are all in use.
+const uint8_t EXPORT_WRITE_BUFFERS = 8;
+
+// Creates the framebuffer and starts the writer. The directory must already exist. Needs a current GL context.
+bool startFrameExport(const char *directory, const GLuint width, const GLuint height, const ExportFormat format);
+// Draws go to the export framebuffer, at the export size, until endExportFrame.
+void beginExportFrame();
+// Starts reading the frame back and passes on any earlier frame that has arrived.
+void endExportFrame();
+// Writes the frames still in flight, stops the writer and deletes the framebuffer. Returns the number of frames written.
+uint32_t finishFrameExport();
+
+#endif
@@ -0,0 +1,147 @@
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include "frame_pacing.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static GLFWwindow *pacedWindow = nullptr;
+static FramePacing framePacing = PACING_VSYNC;
+static bool lowLatencyMode = false;
+// Time between frames with a cap, or between refreshes with vsync.
+static double periodSeconds = TARGET_FRAME_SECONDS;
+static Clock::time_point nextFrame;
+static Clock::time_point inputSampled;
+static Clock::time_point lastPresent;
+static double latencies[PACING_STATS_FRAMES];
+static double workTimes[PACING_STATS_FRAMES];
+static uint32_t framesPresented = 0;
+static PacingStats stats;
+
+static void waitUntil(const Clock::time_point time);
+static void updateStats();
+
+void initFramePacing(GLFWwindow *window, const FramePacing pacing, const double capFps, const bool lowLatency)
+{
+    pacedWindow = window;
+    framePacing = pacing;
+    lowLatencyMode = lowLatency;
+    glfwSwapInterval(pacing == PACING_VSYNC ? 1 : 0);
+
+    periodSeconds = TARGET_FRAME_SECONDS;
+    if (pacing == PACING_CAP && capFps > 0.0)
+    {
+        periodSeconds = 1.0 / capFps;
+    }
+    else if (pacing == PACING_VSYNC)
+    {
+        const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        if (mode != nullptr && mode->refreshRate > 0)
+        {
+            periodSeconds = 1.0 / mode->refreshRate;
+        }
+    }
+#ifdef _WIN32
+    // Sleeps are otherwise rounded up to the 15.6ms system tick.
+    timeBeginPeriod(1);
+#endif
+
+    nextFrame = Clock::now();
+    lastPresent = nextFrame;
+    inputSampled = nextFrame;
+    framesPresented = 0;
+    stats.averageLatencySeconds = 0.0;
+    stats.worstLatencySeconds = 0.0;
+    stats.averageWorkSeconds = 0.0;
+}
+
+void waitForFrame()
+{
+    if (framePacing == PACING_CAP)
+    {
+        const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(periodSeconds));
+        waitUntil(nextFrame);
+        // Frames that ran long push the schedule back rather than being made up with a burst.
+        nextFrame = std::max(nextFrame + period, Clock::now());
+    }
+    else if (framePacing == PACING_VSYNC && lowLatencyMode && framesPresented > 0)
+    {
+        // The last frame was presented at lastPresent, so the next refresh is a period later. Leave just
+        // enough time before it for the slowest recent frame.
+        double worstWork = 0.0;
+        for (uint16_t i = 0; i < std::min<uint32_t>(framesPresented, PACING_STATS_FRAMES); i++)
+        {
+            worstWork = std::max(worstWork, workTimes[i]);
+        }
+        const double delay = periodSeconds - worstWork - PACING_LATE_MARGIN_SECONDS;
+        if (delay > 0.0)
+        {
+            waitUntil(lastPresent + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(delay)));
+        }
+    }
+}
+
+void markInputSampled()
+{
+    inputSampled = Clock::now();
+}
+
+void presentFrame()
+{
+    const Clock::time_point swapStart = Clock::now();
+    glfwSwapBuffers(pacedWindow);
+    if (lowLatencyMode)
+    {
+        // Nothing is left queued, so the swap has happened when this returns.
+        glFinish();
+    }
+    lastPresent = Clock::now();
+
+    const uint32_t slot = framesPresented % PACING_STATS_FRAMES;
+    latencies[slot] = std::chrono::duration<double>(lastPresent - inputSampled).count();
+    workTimes[slot] = std::chrono::duration<double>(swapStart - inputSampled).count();
+    framesPresented++;
+    if (framesPresented % PACING_STATS_FRAMES == 0)
+    {
+        updateStats();
+    }
+}
+
+const PacingStats& getPacingStats()
+{
+    return stats;
+}
+
+// Sleeps until shortly before the time, then spins the rest of the way.
+static void waitUntil(const Clock::time_point time)
+{
+    const Clock::time_point wake = time - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(PACING_SPIN_SECONDS));
+    if (Clock::now() < wake)
+    {
+        std::this_thread::sleep_until(wake);
+    }
+    while (Clock::now() < time)
+    {
+        std::this_thread::yield();
+    }
+}
+
+static void updateStats()
+{
+    double totalLatency = 0.0;
+    double totalWork = 0.0;
+    stats.worstLatencySeconds = 0.0;
+    for (uint16_t i = 0; i < PACING_STATS_FRAMES; i++)
+    {
+        totalLatency += latencies[i];
+        totalWork += workTimes[i];
+        stats.worstLatencySeconds = std::max(stats.worstLatencySeconds, latencies[i]);
+    }
+    stats.averageLatencySeconds = totalLatency / PACING_STATS_FRAMES;
+    stats.averageWorkSeconds = totalWork / PACING_STATS_FRAMES;
+}
@@ -0,0 +1,50 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include "defs.h"
+
+/* When frames start, and how long from reading input to the frame reaching the screen.
+ *
+ * The game logic steps at TARGET_FPS whatever the frame rate, so pacing only changes how often input is
+ * read and the screen drawn. With a frame rate cap the wait happens before input is read, so input is
+ * always as fresh as possible. Low latency mode waits for each frame to be presented, so the driver can't
+ * queue frames ahead; with vsync it also delays reading input until just before the frame has to be drawn.
+ */
+
+enum FramePacing
+{
+    // Swap at the monitor refresh.
+    PACING_VSYNC,
+    // As fast as possible.
+    PACING_UNCAPPED,
+    // At a set rate, without vsync.
+    PACING_CAP
+};
+
+// Sleeping stops this long before a frame is due, then the wait spins. Covers the scheduler's wake-up jitter.
+const double PACING_SPIN_SECONDS = 0.002;
+// Spare time left before the vsync deadline when reading input late.
+const double PACING_LATE_MARGIN_SECONDS = 0.002;
+// Frames the latency and work figures are averaged over.
+const uint16_t PACING_STATS_FRAMES = 120;
+
+struct PacingStats
+{
+    // From reading input to the frame being presented (or to the swap returning, outside low latency mode).
+    double averageLatencySeconds;
+    double worstLatencySeconds;
+    // From reading input to starting the swap.
+    double averageWorkSeconds;
+};
+
+// Call with a current context. capFps is only used with PACING_CAP.
+void initFramePacing(GLFWwindow *window, const FramePacing pacing, const double capFps, const bool lowLatency);
+// Waits until it's time to read input for the next frame.
+void waitForFrame();
+// Marks input as just read.
+void markInputSampled();
+// Swaps buffers and, in low latency mode, waits for the frame to be presented.
+void presentFrame();
+const PacingStats& getPacingStats();
+
+#endif
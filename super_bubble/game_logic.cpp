@@ -1,88 +1,158 @@
-#include <list>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <algorithm>
 #include "defs.h"
 #include "transforms.h"
 #include "collision.h"
-#include "bubble_net.h"
+#include "grid.h"
+#include "game_logic.h"
 
-static int8_t fallAmount = (int8_t)(3.0f * SCALE);
-static int8_t levelFallAmount = (int8_t)(3.0f * SCALE);
+static const int8_t levelFallAmount = (int8_t)(3.0f * SCALE);
 
 static const int8_t SPAWN_POS_Y = -2;
 
-static uint8_t *deathFrame = nullptr;
+template<typename Rules> static void stepState(MatchState &match, Controls &controls, const double secondsSinceLastUpdate);
+template<typename Rules> static GameState spawnBubble(MatchState &match);
+template<typename Rules> static GameState controlPlayerBubbles(MatchState &match, Controls &controls, const double secondsSinceLastUpdate);
+template<typename Rules> static GameState dropEnemyBubbles(MatchState &match, const double secondsSinceLastUpdate);
+template<typename Rules> static GameState scanForVictims(MatchState &match);
+template<typename Rules> static GameState animateDeaths(MatchState &match);
+template<typename Rules> static GameState scanForFloaters(MatchState &match);
+template<typename Rules> static GameState gravity(MatchState &match, const double secondsSinceLastUpdate);
+template<typename Rules> static GameState gameOver(MatchState &match);
+template<typename Rules> static GameState applyGravity(MatchState &match, const double secondsSinceLastUpdate);
+template<typename Rules> static int findGroupSize(MatchState &match, CellList &chain, const uint8_t &x, const uint8_t &y, const BubbleColor &color);
+template<typename Rules> static uint8_t checkForLink(MatchState &match, CellList &chain, const uint8_t &x, const uint8_t &y, const BubbleColor color);
+template<typename Rules> static void bounce(MatchState &match);
+static void addFallingBubble(MatchState &match, const glm::ivec2 &position, const BubbleColor color);
+static void removeFallingBubble(MatchState &match, const uint8_t index);
+template<typename Rules> static void addCell(CellList &list, const uint8_t x, const uint8_t y);
+template<typename Rules> static void addBounce(BounceList &list, const uint8_t x, const uint8_t y);
+template<typename Rules> static GridCell &cellAt(MatchState &match, const uint8_t cell);
+template<typename Rules> static bool isVisited(const MatchState &match, const uint8_t x, const uint8_t y);
+static BubbleColor randomSpawnColor(MatchState &match);
+static uint16_t nextMatchRandom(MatchState &match);
+
+void initMatchState(MatchState &match, const uint32_t seed, const MatchMode mode)
+{
+    memset(&match, 0, sizeof(match));
+    match.state = GameState::BUBBLE_SPAWN;
+    match.mode = mode;
+    initGrid(match.grid);
+    match.randomState = seed;
+    match.nextColors[0] = randomSpawnColor(match);
+    match.nextColors[1] = randomSpawnColor(match);
+    match.fallAmount = levelFallAmount;
+    match.buddyBubbleDirection = SOUTH;
+    match.gameOverRow = MODE_GRIDS[mode].rows - 1;
+}
+
+GameState stepMatch(MatchState &match, Controls &controls, const double secondsSinceLastUpdate)
+{
+    switch (match.mode)
+    {
+    case MODE_THREE_MATCH:
+        stepState<ThreeMatchRules>(match, controls, secondsSinceLastUpdate);
+        break;
+    case MODE_WIDE:
+        stepState<WideRules>(match, controls, secondsSinceLastUpdate);
+        break;
+    default:
+        stepState<ClassicRules>(match, controls, secondsSinceLastUpdate);
+        break;
+    }
+
+    match.tick++;
+    return match.state;
+}
 
-// For game over animation.
-static int8_t gameOverRow = GRID_ROWS - 1;
+// Runs the handler for the current state, under the rules of the match's mode.
+template<typename Rules>
+static void stepState(MatchState &match, Controls &controls, const double secondsSinceLastUpdate)
+{
+    switch (match.state)
+    {
+    case GameState::BUBBLE_SPAWN:
+        match.state = spawnBubble<Rules>(match);
+        break;
+    case GameState::PLAYER_CONTROL:
+        match.state = controlPlayerBubbles<Rules>(match, controls, secondsSinceLastUpdate);
+        break;
+    case GameState::DROP_ENEMY_BUBBLES:
+        match.state = dropEnemyBubbles<Rules>(match, secondsSinceLastUpdate);
+        break;
+    case GameState::SCAN_FOR_VICTIMS:
+        match.state = scanForVictims<Rules>(match);
+        break;
+    case GameState::ANIMATE_DEATHS:
+        match.state = animateDeaths<Rules>(match);
+        break;
+    case GameState::SCAN_FOR_FLOATERS:
+        match.state = scanForFloaters<Rules>(match);
+        break;
+    case GameState::GRAVITY:
+        match.state = gravity<Rules>(match, secondsSinceLastUpdate);
+        break;
+    case GameState::GAME_OVER:
+        match.state = gameOver<Rules>(match);
+        break;
+    default:
+        break;
+    }
+}
 
-enum Direction
+void saveMatchState(const MatchState &match, MatchState &snapshot)
 {
-    NORTH,
-    EAST,
-    SOUTH,
-    WEST
-};
-
-static Direction buddyBubbleDirection = SOUTH;
-static std::list<Bubble*> currentChain;
-static std::list<Bubble*> bounceList;
-
-static void printBubble(const Bubble &bubble);
-static GameState applyGravity(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, const double secondsSinceLastUpdate);
-static uint8_t checkForLink(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], const uint8_t &x, const uint8_t &y, const BubbleColor color);
-static void bounce();
-
-void resetGameLogic()
+    memcpy(&snapshot, &match, sizeof(MatchState));
+}
+
+void restoreMatchState(MatchState &match, const MatchState &snapshot)
 {
-	gameOverRow = GRID_ROWS - 1;
+    memcpy(&match, &snapshot, sizeof(MatchState));
 }
 
-GameState spawnBubble(std::list<Bubble> &fallingBubbles, std::pair<BubbleColor, BubbleColor> &nextColors)
+template<typename Rules>
+static GameState spawnBubble(MatchState &match)
 {
-    fallingBubbles.clear();
-    glm::ivec2 gridPos(rand() % GRID_COLUMNS, SPAWN_POS_Y);
-    Bubble mainBubble, buddyBubble;
-    gridSpaceToPlaySpace(gridPos, mainBubble.playSpacePosition);
+    FallingBubbles &falling = match.falling;
+    falling.size = 0;
+    glm::ivec2 gridPos(nextMatchRandom(match) % Rules::COLUMNS, SPAWN_POS_Y);
+    glm::ivec2 mainPosition, buddyPosition;
+    gridSpaceToPlaySpace(gridPos, mainPosition);
     gridPos.y++;
-    gridSpaceToPlaySpace(gridPos, buddyBubble.playSpacePosition);
-	mainBubble.color = nextColors.first;
-	buddyBubble.color = nextColors.second;
-    nextColors.first = static_cast<BubbleColor>(rand() % (MAX_SPAWN_COLOR + 1));
-    nextColors.second = static_cast<BubbleColor>(rand() % (MAX_SPAWN_COLOR + 1));
-    mainBubble.state = buddyBubble.state = FALLING;
-    mainBubble.animationFrame = buddyBubble.animationFrame = 0;
-    mainBubble.visited = buddyBubble.visited = false;
-    mainBubble.bounceAmount = buddyBubble.bounceAmount = 0;
-    mainBubble.bounceDir = buddyBubble.bounceDir = 0;
+    gridSpaceToPlaySpace(gridPos, buddyPosition);
+    addFallingBubble(match, buddyPosition, match.nextColors[1]);
+    addFallingBubble(match, mainPosition, match.nextColors[0]);
+    falling.pair = true;
+    match.nextColors[0] = randomSpawnColor(match);
+    match.nextColors[1] = randomSpawnColor(match);
     
-    buddyBubbleDirection = SOUTH;
-    fallAmount = levelFallAmount;    
-
-    // Must be pushed in bottom up order.
-    fallingBubbles.push_back(buddyBubble);
-    fallingBubbles.push_back(mainBubble);
+    match.buddyBubbleDirection = SOUTH;
+    match.fallAmount = levelFallAmount;    
 
     return GameState::PLAYER_CONTROL;
 }
 
-GameState controlPlayerBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, Controls &controls, const double secondsSinceLastUpdate)
+template<typename Rules>
+static GameState controlPlayerBubbles(MatchState &match, Controls &controls, const double secondsSinceLastUpdate)
 {
-    Bubble *buddyBubble = &fallingBubbles.front();
-    Bubble *mainBubble = &*std::next(fallingBubbles.begin());
+    GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS] = match.grid;
+    Direction &buddyBubbleDirection = match.buddyBubbleDirection;
+    glm::ivec2 buddyBubble = fallingPosition(match.falling, PAIR_BUDDY);
+    glm::ivec2 mainBubble = fallingPosition(match.falling, PAIR_MAIN);
 
     const glm::ivec2 horizontalMove(GRID_SIZE, 0);
-    if (controls.left && canGoLeft(grid, *mainBubble, *buddyBubble))
+    if (controls.left && canGoLeft<Rules>(grid, mainBubble, buddyBubble))
     {
-        mainBubble->playSpacePosition -= horizontalMove;
-        buddyBubble->playSpacePosition -= horizontalMove;
+        mainBubble -= horizontalMove;
+        buddyBubble -= horizontalMove;
         controls.left = false;
     }
-    else if (controls.right && canGoRight(grid, *mainBubble, *buddyBubble))
+    else if (controls.right && canGoRight<Rules>(grid, mainBubble, buddyBubble))
     {
-        mainBubble->playSpacePosition += horizontalMove;
-        buddyBubble->playSpacePosition += horizontalMove;
+        mainBubble += horizontalMove;
+        buddyBubble += horizontalMove;
         controls.right = false;
     }
     else if (controls.rotateCW)
@@ -91,41 +161,41 @@ GameState controlPlayerBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list
         {
         case Direction::NORTH:
         {
-            if (canGoRight(grid, *mainBubble, *buddyBubble))
+            if (canGoRight<Rules>(grid, mainBubble, buddyBubble))
             {
                 buddyBubbleDirection = Direction::EAST;
-                buddyBubble->playSpacePosition.x += GRID_SIZE;
-                buddyBubble->playSpacePosition.y = mainBubble->playSpacePosition.y;
+                buddyBubble.x += GRID_SIZE;
+                buddyBubble.y = mainBubble.y;
             }
             break;
         }
         case Direction::EAST:
         {            
-            uint8_t nextY = 1 + ((buddyBubble->playSpacePosition.y + GRID_SIZE) / GRID_SIZE);                        
-            if (nextY < GRID_ROWS && 
-                grid[mainBubble->playSpacePosition.x / GRID_SIZE][nextY].state != BubbleState::IDLE)
+            uint8_t nextY = 1 + ((buddyBubble.y + GRID_SIZE) / GRID_SIZE);                        
+            if (nextY < Rules::ROWS && 
+                cellState(grid[mainBubble.x / GRID_SIZE][nextY]) != BubbleState::IDLE)
             {
                 buddyBubbleDirection = Direction::SOUTH;
-                buddyBubble->playSpacePosition.x = mainBubble->playSpacePosition.x;
-                buddyBubble->playSpacePosition.y += GRID_SIZE;
+                buddyBubble.x = mainBubble.x;
+                buddyBubble.y += GRID_SIZE;
             }
             break;
         }
         case Direction::SOUTH:
         {
-            if (canGoLeft(grid, *mainBubble, *buddyBubble))
+            if (canGoLeft<Rules>(grid, mainBubble, buddyBubble))
             {
                 buddyBubbleDirection = Direction::WEST;
-                buddyBubble->playSpacePosition.x -= GRID_SIZE;
-                buddyBubble->playSpacePosition.y = mainBubble->playSpacePosition.y;
+                buddyBubble.x -= GRID_SIZE;
+                buddyBubble.y = mainBubble.y;
             }
             break;
         }
         case Direction::WEST:
         {
             buddyBubbleDirection = Direction::NORTH;
-            buddyBubble->playSpacePosition.x = mainBubble->playSpacePosition.x;
-            buddyBubble->playSpacePosition.y -= GRID_SIZE;
+            buddyBubble.x = mainBubble.x;
+            buddyBubble.y -= GRID_SIZE;
             break;
         }
         }
@@ -137,40 +207,40 @@ GameState controlPlayerBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list
         {
             case Direction::NORTH:
             {
-                if (canGoLeft(grid, *mainBubble, *buddyBubble))
+                if (canGoLeft<Rules>(grid, mainBubble, buddyBubble))
                 {
                     buddyBubbleDirection = Direction::WEST;
-                    buddyBubble->playSpacePosition.x -= GRID_SIZE;
-                    buddyBubble->playSpacePosition.y = mainBubble->playSpacePosition.y;
+                    buddyBubble.x -= GRID_SIZE;
+                    buddyBubble.y = mainBubble.y;
                 }
                 break;
             }
             case Direction::EAST:
             {
                 buddyBubbleDirection = Direction::NORTH;
-                buddyBubble->playSpacePosition.x = mainBubble->playSpacePosition.x;
-                buddyBubble->playSpacePosition.y -= GRID_SIZE;            
+                buddyBubble.x = mainBubble.x;
+                buddyBubble.y -= GRID_SIZE;            
                 break;
             }
             case Direction::SOUTH:
             {
-                if (canGoRight(grid, *mainBubble, *buddyBubble))
+                if (canGoRight<Rules>(grid, mainBubble, buddyBubble))
                 {
                     buddyBubbleDirection = Direction::EAST;
-                    buddyBubble->playSpacePosition.x += GRID_SIZE;
-                    buddyBubble->playSpacePosition.y = mainBubble->playSpacePosition.y;
+                    buddyBubble.x += GRID_SIZE;
+                    buddyBubble.y = mainBubble.y;
                 }
                 break;
             }
             case Direction::WEST:
             {            
-                uint8_t nextY = 1 + ((buddyBubble->playSpacePosition.y + GRID_SIZE) / GRID_SIZE);            
-                if (nextY < GRID_ROWS && 
-                    grid[mainBubble->playSpacePosition.x / GRID_SIZE][nextY].state != BubbleState::IDLE)
+                uint8_t nextY = 1 + ((buddyBubble.y + GRID_SIZE) / GRID_SIZE);            
+                if (nextY < Rules::ROWS && 
+                    cellState(grid[mainBubble.x / GRID_SIZE][nextY]) != BubbleState::IDLE)
                 {
                     buddyBubbleDirection = Direction::SOUTH;
-                    buddyBubble->playSpacePosition.x = mainBubble->playSpacePosition.x;
-                    buddyBubble->playSpacePosition.y += GRID_SIZE;
+                    buddyBubble.x = mainBubble.x;
+                    buddyBubble.y += GRID_SIZE;
                 }
                 break;
             }
@@ -184,8 +254,13 @@ GameState controlPlayerBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list
         return GameState::GRAVITY;
     }
 
-    GameState result = applyGravity(grid, fallingBubbles, secondsSinceLastUpdate);
-    if (result == GRAVITY && fallingBubbles.size() == 2)
+    match.falling.x[PAIR_BUDDY] = buddyBubble.x;
+    match.falling.y[PAIR_BUDDY] = buddyBubble.y;
+    match.falling.x[PAIR_MAIN] = mainBubble.x;
+    match.falling.y[PAIR_MAIN] = mainBubble.y;
+
+    GameState result = applyGravity<Rules>(match, secondsSinceLastUpdate);
+    if (result == GRAVITY && match.falling.pair)
     {
         return GameState::PLAYER_CONTROL;
     }
@@ -198,8 +273,10 @@ GameState controlPlayerBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list
 /*
  * numEnemyBubbles will be updated with the number of enemy bubbles consumed (dropped onto the play field).
 **/
-GameState dropEnemyBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, uint8_t &numEnemyBubbles, const double secondsSinceLastUpdate)
+template<typename Rules>
+static GameState dropEnemyBubbles(MatchState &match, const double secondsSinceLastUpdate)
 {
+    uint8_t &numEnemyBubbles = match.numEnemyBubbles;
     if (numEnemyBubbles == 0)
     {
         return GameState::SCAN_FOR_VICTIMS;
@@ -208,58 +285,56 @@ GameState dropEnemyBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bub
     {
         std::cout << "Got enemy bubbles: " << (uint16_t)numEnemyBubbles << std::endl;
         glm::ivec2 gridPos(0, -1);
-        int8_t numBubblesToDrop = std::min(numEnemyBubbles, GRID_COLUMNS);
+        const uint8_t columns = Rules::COLUMNS;
+        int8_t numBubblesToDrop = std::min(numEnemyBubbles, columns);
         for (int8_t x = 0; x < numBubblesToDrop; x++)
         {
-            Bubble faller;
-            faller.state = BubbleState::FALLING;
-            faller.color = GHOST;
+            glm::ivec2 position;
             gridPos.x = x;
-            gridSpaceToPlaySpace(gridPos, faller.playSpacePosition);
-            fallingBubbles.push_back(faller);
+            gridSpaceToPlaySpace(gridPos, position);
+            addFallingBubble(match, position, GHOST);
         }
         numEnemyBubbles -= numBubblesToDrop;
         return GameState::GRAVITY;
     }
 }
 
-GameState scanForVictims(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], uint32_t &score)
+template<typename Rules>
+static GameState scanForVictims(MatchState &match)
 {
+    GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS] = match.grid;
     bool foundVictims = false;    
     uint8_t totalDeaths = 0;
+    CellList currentChain;
+    currentChain.size = 0;
 
-    for (uint8_t y = 0; y < GRID_ROWS; y++)
+    for (uint8_t y = 0; y < Rules::ROWS; y++)
     {
-        for (uint8_t x = 0; x < GRID_COLUMNS; x++)
+        for (uint8_t x = 0; x < Rules::COLUMNS; x++)
         {
             // Bubbles that were already found to be part of another chain can be skipped.
-            if (!grid[x][y].visited && grid[x][y].color != GHOST)
+            if (!isVisited<Rules>(match, x, y) && cellColor(grid[x][y]) != GHOST)
             {
-				uint8_t chainLength = checkForLink(grid, x, y, grid[x][y].color);  
+				uint8_t chainLength = checkForLink<Rules>(match, currentChain, x, y, cellColor(grid[x][y]));  
                 
-                if (chainLength >= CHAIN_DEATH_LENGTH)
+                if (chainLength >= Rules::CHAIN_DEATH_LENGTH)
                 {                    
                     foundVictims = true;                    
                     totalDeaths += chainLength;
 
-                    score += ((chainLength - (CHAIN_DEATH_LENGTH - 1)) * 100);
-                    for (std::list<Bubble*>::iterator it = currentChain.begin(); it != currentChain.end(); it++)
-                    {
-                        (*it)->animationFrame = 0;
-                    }
-                    // Save pointer to animation frame so that we can track it in the animate death state.
-                    // The frames will be the same for all bubbles.
-                    deathFrame = &(currentChain.front()->animationFrame);
+                    match.score += ((chainLength - (Rules::CHAIN_DEATH_LENGTH - 1)) * 100);
+                    // Every dying bubble starts its animation now, so they all finish together.
+                    match.deathsEndTick = (match.tick / BUBBLE_FRAME_TICKS + BUBBLE_FRAMES - 1) * BUBBLE_FRAME_TICKS;
                 }
                 else
                 {
                     // Chain wasn't long enough, so reset state of all bubbles in the chain to idle.
-                    for (std::list<Bubble*>::iterator it = currentChain.begin(); it != currentChain.end(); it++)
+                    for (uint8_t i = 0; i < currentChain.size; i++)
                     {
-                        (*it)->state = BubbleState::IDLE;
+                        setCellState(cellAt<Rules>(match, currentChain.cells[i]), BubbleState::IDLE);
                     }
                 }
-                currentChain.clear();
+                currentChain.size = 0;
             }
         }
     }    
@@ -267,71 +342,68 @@ GameState scanForVictims(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], uint32_t &score
     {
         // Now find chains of ghost bubbles.
         // They can only be killed if they are touching a chain of another colour.
-        for (uint8_t y = 0; y < GRID_ROWS; y++)
+        for (uint8_t y = 0; y < Rules::ROWS; y++)
         {
-            for (uint8_t x = 0; x < GRID_COLUMNS; x++)
+            for (uint8_t x = 0; x < Rules::COLUMNS; x++)
             {
-                if (!grid[x][y].visited && grid[x][y].color == GHOST)
+                if (!isVisited<Rules>(match, x, y) && cellColor(grid[x][y]) == GHOST)
                 {
-                    checkForLink(grid, x, y, GHOST);
+                    checkForLink<Rules>(match, currentChain, x, y, GHOST);
                     
                     bool killGhostChain = false;
-                    for (std::list<Bubble*>::iterator it = currentChain.begin(); it != currentChain.end(); it++)
+                    for (uint8_t i = 0; i < currentChain.size; i++)
                     {
                         // Check each direction to see if it is touching a dying bubble.
-                        glm::ivec2 gridPos;
-                        playSpaceToGridSpace((*it)->playSpacePosition, gridPos);
+                        const glm::ivec2 gridPos(currentChain.cells[i] / Rules::ROWS, currentChain.cells[i] % Rules::ROWS);
                         // Above
                         if (gridPos.y > 0 && 
-                            grid[gridPos.x][gridPos.y - 1].color != GHOST &&
-                            grid[gridPos.x][gridPos.y - 1].state == BubbleState::DYING)
+                            cellColor(grid[gridPos.x][gridPos.y - 1]) != GHOST &&
+                            cellState(grid[gridPos.x][gridPos.y - 1]) == BubbleState::DYING)
                         {
                             killGhostChain = true;
                             break;
                         }
                         // Below
-                        if (gridPos.y < GRID_ROWS - 1 &&
-                            grid[gridPos.x][gridPos.y + 1].color != GHOST &&
-                            grid[gridPos.x][gridPos.y + 1].state == BubbleState::DYING)
+                        if (gridPos.y < Rules::ROWS - 1 &&
+                            cellColor(grid[gridPos.x][gridPos.y + 1]) != GHOST &&
+                            cellState(grid[gridPos.x][gridPos.y + 1]) == BubbleState::DYING)
                         {
                             killGhostChain = true;
                             break;
                         }
                         // Left
                         if (gridPos.x > 0 &&
-                            grid[gridPos.x - 1][gridPos.y].color != GHOST &&
-                            grid[gridPos.x - 1][gridPos.y].state == BubbleState::DYING)
+                            cellColor(grid[gridPos.x - 1][gridPos.y]) != GHOST &&
+                            cellState(grid[gridPos.x - 1][gridPos.y]) == BubbleState::DYING)
                         {
                             killGhostChain = true;
                             break;
                         }
                         // Right
-                        if (gridPos.x < GRID_COLUMNS - 1 &&
-                            grid[gridPos.x + 1][gridPos.y].color != GHOST &&
-                            grid[gridPos.x + 1][gridPos.y].state == BubbleState::DYING)
+                        if (gridPos.x < Rules::COLUMNS - 1 &&
+                            cellColor(grid[gridPos.x + 1][gridPos.y]) != GHOST &&
+                            cellState(grid[gridPos.x + 1][gridPos.y]) == BubbleState::DYING)
                         {
                             killGhostChain = true;
                             break;
                         }
                     } // end iterate over currentChain.                    
-                    for (std::list<Bubble*>::iterator it = currentChain.begin(); it != currentChain.end(); it++)
+                    for (uint8_t i = 0; i < currentChain.size; i++)
                     {
                         if (!killGhostChain)
                         {
-                            (*it)->state = BubbleState::IDLE;
-                        }
-                        else
-                        {
-                            (*it)->animationFrame = 0;
+                            setCellState(cellAt<Rules>(match, currentChain.cells[i]), BubbleState::IDLE);
                         }
                     }                    
-                    currentChain.clear();
+                    currentChain.size = 0;
                 } // end if (visited) and (color == GHOST)
             } // end iterate over x.
         } // end iterate over y.
-        if (networkIsConnected() && totalDeaths >= CHAIN_MIN_SEND_LENGTH)
+        if (totalDeaths >= Rules::CHAIN_MIN_SEND_LENGTH)
         {
-            sendBubbles((totalDeaths - (CHAIN_MIN_SEND_LENGTH - 1)) * 2);
+            const uint8_t numBubbles = (totalDeaths - (Rules::CHAIN_MIN_SEND_LENGTH - 1)) * 2;
+            match.garbageSent += numBubbles;
+            match.garbageToSend += numBubbles;
         }
         return GameState::ANIMATE_DEATHS;
     }
@@ -341,17 +413,19 @@ GameState scanForVictims(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], uint32_t &score
     }
 }
 
-GameState animateDeaths(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS])
+template<typename Rules>
+static GameState animateDeaths(MatchState &match)
 {    
-    if (*deathFrame == BUBBLE_FRAMES - 1)
+    GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS] = match.grid;
+    if (match.tick >= match.deathsEndTick)
     {
-        for (uint8_t y = 0; y < GRID_ROWS; y++)
+        for (uint8_t y = 0; y < Rules::ROWS; y++)
         {
-            for (uint8_t x = 0; x < GRID_COLUMNS; x++)
+            for (uint8_t x = 0; x < Rules::COLUMNS; x++)
             {
-                if (grid[x][y].state == BubbleState::DYING)
+                if (cellState(grid[x][y]) == BubbleState::DYING)
                 {
-                    grid[x][y].state = BubbleState::DEAD;
+                    setCellState(grid[x][y], BubbleState::DEAD);
                 }
             }
         }        
@@ -361,32 +435,34 @@ GameState animateDeaths(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS])
     return GameState::ANIMATE_DEATHS;
 }
 
-GameState scanForFloaters(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles)
+template<typename Rules>
+static GameState scanForFloaters(MatchState &match)
 {
+    GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS] = match.grid;
     bool foundFloaters = false;
-    for (int x = 0; x < GRID_COLUMNS; x++)
+    // Clear visited flags used by chain algorithm.
+    CellSet<Rules>::clear(match.visited);
+    for (int x = 0; x < Rules::COLUMNS; x++)
     {
         bool emptySpace = false;
         // Check rows from the bottom up for empty space.
-        for (int y = GRID_ROWS - 1; y >= 0; y--)
+        for (int y = Rules::ROWS - 1; y >= 0; y--)
         {
-            // Clear visited flag used by chain algorithm.
-            grid[x][y].visited = false;
-            if (grid[x][y].state == BubbleState::DEAD)
+            if (cellState(grid[x][y]) == BubbleState::DEAD)
             {
                 emptySpace = true;
             }
-            else if (grid[x][y].state == BubbleState::IDLE)
+            else if (cellState(grid[x][y]) == BubbleState::IDLE)
             {
                 // If we have seen empty space before seeing this bubble then it must fall.
                 if (emptySpace)
                 {
-                    // Copy this bubble and add it to the falling list.
-                    Bubble faller = grid[x][y];
-                    faller.state = FALLING;
-                    fallingBubbles.push_back(faller);
+                    // Add this bubble to the falling list.
+                    glm::ivec2 position;
+                    gridSpaceToPlaySpace(glm::ivec2(x, y), position);
+                    addFallingBubble(match, position, cellColor(grid[x][y]));
                     // Mark the old grid position as dead.
-                    grid[x][y].state = BubbleState::DEAD;
+                    setCellState(grid[x][y], BubbleState::DEAD);
                     foundFloaters = true;
                 }
             }
@@ -402,103 +478,135 @@ GameState scanForFloaters(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubb
     }
 }
 
-GameState gravity(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, const double secondsSinceLastUpdate)
+template<typename Rules>
+static GameState gravity(MatchState &match, const double secondsSinceLastUpdate)
 {
-    fallAmount = FAST_FALL_AMOUNT;
-    return applyGravity(grid, fallingBubbles, secondsSinceLastUpdate);
+    match.fallAmount = FAST_FALL_AMOUNT;
+    return applyGravity<Rules>(match, secondsSinceLastUpdate);
 }
 
 
-GameState gameOver(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS])
+template<typename Rules>
+static GameState gameOver(MatchState &match)
 {
-	if (gameOverRow >= 0)
+	if (match.gameOverRow >= 0)
 	{		
-		for (uint8_t col = 0; col < GRID_COLUMNS; col++)
+		for (uint8_t col = 0; col < Rules::COLUMNS; col++)
 		{	
-			grid[col][gameOverRow].color = GHOST;
+			match.grid[col][match.gameOverRow] = makeGridCell(GHOST, cellState(match.grid[col][match.gameOverRow]));
 		}
-		gameOverRow--;
+		match.gameOverRow--;
 	}
 	return GameState::GAME_OVER;
 }
 
-static void bounce()
+template<typename Rules>
+static void bounce(MatchState &match)
 {    
+    BounceList &list = match.bounceList;
     bool allDone = true;
-    for (std::list<Bubble*>::iterator it = bounceList.begin(); it != bounceList.end(); it++)
+    for (uint8_t i = 0; i < list.size; i++)
     {
-        if ((*it)->bounceAmount != 0)
+        if (list.amounts[i] != 0)
         {
             allDone = false;
-            (*it)->playSpacePosition.y += ((*it)->bounceAmount * (*it)->bounceDir);
-            (*it)->bounceDir *= -1;
-            if ((*it)->bounceDir < 0) (*it)->bounceAmount--;
+            match.bounceOffsets[list.cells[i] / Rules::ROWS][list.cells[i] % Rules::ROWS] += (list.amounts[i] * list.directions[i]);
+            list.directions[i] *= -1;
+            if (list.directions[i] < 0) list.amounts[i]--;
         }
     }
     
     if (allDone)
     {
-        bounceList.clear();
+        list.size = 0;
     }
 }
 
-static GameState applyGravity(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, const double secondsSinceLastUpdate)
+template<typename Rules>
+static GameState applyGravity(MatchState &match, const double secondsSinceLastUpdate)
 {
-    uint8_t pixels = round(static_cast<double>(fallAmount) * (secondsSinceLastUpdate / TARGET_FRAME_SECONDS));
+    GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS] = match.grid;
+    FallingBubbles &falling = match.falling;
+    uint8_t pixels = round(static_cast<double>(match.fallAmount) * (secondsSinceLastUpdate / TARGET_FRAME_SECONDS));
+
+    /*
+     * Lower bubbles go first, so a bubble landing this tick can be landed on by the one above it. The removals
+     * shuffle the arrays, so sort here, with an insertion sort as there are only ever a grid's worth. The pair
+     * always goes buddy first, whichever way up it is, as recorded replays depend on it.
+    **/
+    uint8_t order[MAX_FALLING_BUBBLES];
+    for (uint8_t i = 0; i < falling.size; i++)
+    {
+        uint8_t j = i;
+        if (!falling.pair)
+        {
+            for (; j > 0 && falling.y[order[j - 1]] < falling.y[i]; j--)
+            {
+                order[j] = order[j - 1];
+            }
+        }
+        order[j] = i;
+    }
 
     glm::ivec2 gridPos0;
     glm::ivec2 gridPos1;
-    std::list<Bubble>::iterator it = fallingBubbles.begin();
-    while (it != fallingBubbles.end())
+    bool landed[MAX_FALLING_BUBBLES] = {};
+    bool toppedOut = false;
+    for (uint8_t k = 0; k < falling.size; k++)
     {
+        const uint8_t i = order[k];
         // Which grid squares would we be overlapping after adding the fall amount?
-        const glm::ivec2 playSpaceNext(it->playSpacePosition.x, it->playSpacePosition.y + pixels);
+        const glm::ivec2 playSpaceNext(falling.x[i], falling.y[i] + pixels);
         uint8_t numMatches = playSpaceToNearestVerticalGrid(playSpaceNext, gridPos0, gridPos1);
 
         // Check if one of the overlapped squares is ground or an idle bubble.
         glm::ivec2 *hitPos = nullptr;
-        if (numMatches > 0 && (gridPos0.y == GRID_ROWS || (gridPos0.y >= 0 && grid[gridPos0.x][gridPos0.y].state == BubbleState::IDLE)))
+        if (numMatches > 0 && (gridPos0.y == Rules::ROWS || (gridPos0.y >= 0 && cellState(grid[gridPos0.x][gridPos0.y]) == BubbleState::IDLE)))
         {
             hitPos = &gridPos0;
         }
-        else if (numMatches == 2 && (gridPos1.y == GRID_ROWS || (gridPos1.y >= 0 && grid[gridPos1.x][gridPos1.y].state == BubbleState::IDLE)))
+        else if (numMatches == 2 && (gridPos1.y == Rules::ROWS || (gridPos1.y >= 0 && cellState(grid[gridPos1.x][gridPos1.y]) == BubbleState::IDLE)))
         {
             hitPos = &gridPos1;
         }
 
         if (hitPos != nullptr)
         {
-            grid[hitPos->x][hitPos->y - 1].state = BubbleState::IDLE;
-            grid[hitPos->x][hitPos->y - 1].color = it->color;
-            grid[hitPos->x][hitPos->y - 1].bounceAmount = BOUNCE_HEIGHT;
-            grid[hitPos->x][hitPos->y - 1].bounceDir = -1;            
-            bounceList.push_back(&grid[hitPos->x][hitPos->y - 1]);
-
-            fallingBubbles.erase(it++);
+            grid[hitPos->x][hitPos->y - 1] = makeGridCell(falling.colors[i], BubbleState::IDLE);
+            addBounce<Rules>(match.bounceList, hitPos->x, hitPos->y - 1);
+            landed[i] = true;
 
             // Check if the settle position of this bubble was the top row.
             if (hitPos->y - 1 == 0)
             {
-                if (networkIsConnected())
-                {
-                    sendGameOver();
-                }
-                return GameState::GAME_OVER;
+                toppedOut = true;
+                break;
             }
         }
         else
         {
-            it->playSpacePosition.y += pixels;
-            it++;
+            falling.y[i] += pixels;
+        }
+    }
+    // Last first, so the bubble moved into each gap has already been looked at.
+    for (int16_t i = falling.size - 1; i >= 0; i--)
+    {
+        if (landed[i])
+        {
+            removeFallingBubble(match, static_cast<uint8_t>(i));
         }
     }
+    if (toppedOut)
+    {
+        return GameState::GAME_OVER;
+    }
 
     // Apply bounce to anything on the bounce list.
-    if (bounceList.size() > 0)
+    if (match.bounceList.size > 0)
     {
-        bounce();
+        bounce<Rules>(match);
     }
-    else if (fallingBubbles.size() == 0)
+    else if (falling.size == 0)
     {
         return GameState::DROP_ENEMY_BUBBLES;
     }
@@ -508,20 +616,22 @@ static GameState applyGravity(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<
 // Finds size of a group of touching same coloured squares.
 // Takes x, y input specifying grid location (in grid co-ordinates!) to start checking
 // from.
-static int findGroupSize(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], const uint8_t &x, const uint8_t &y, const BubbleColor &color)
+template<typename Rules>
+static int findGroupSize(MatchState &match, CellList &chain, const uint8_t &x, const uint8_t &y, const BubbleColor &color)
 {
-    if (grid[x][y].color == color)
+    GridCell &cell = match.grid[x][y];
+    if (cellColor(cell) == color)
     {
-        grid[x][y].state = BubbleState::DYING;
+        setCellState(cell, BubbleState::DYING);
         // Set visited flag so we don't start looking for a chain from this bubble again.
         // The visited state of all bubbles will be cleared when scanning for floaters.
-        grid[x][y].visited = true;
-        currentChain.push_back(&grid[x][y]);
+        CellSet<Rules>::insert(match.visited, (x * Rules::ROWS) + y);
+        addCell<Rules>(chain, x, y);
         return 1 +
-            checkForLink(grid, x - 1, y, color) +
-            checkForLink(grid, x, y - 1, color) +
-            checkForLink(grid, x + 1, y, color) +
-            checkForLink(grid, x, y + 1, color);
+            checkForLink<Rules>(match, chain, x - 1, y, color) +
+            checkForLink<Rules>(match, chain, x, y - 1, color) +
+            checkForLink<Rules>(match, chain, x + 1, y, color) +
+            checkForLink<Rules>(match, chain, x, y + 1, color);
     }
     else
     {
@@ -529,22 +639,86 @@ static int findGroupSize(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], const uint8_t &
     }
 }
 
-static uint8_t checkForLink(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], const uint8_t &x, const uint8_t &y, const BubbleColor color)
+template<typename Rules>
+static uint8_t checkForLink(MatchState &match, CellList &chain, const uint8_t &x, const uint8_t &y, const BubbleColor color)
 {
     // Make sure we are not outside the grid. We are checking grid coordinates, not pixels, so boundary is at zero.
     if (x < 0) return 0;
     if (y < 0) return 0;
-    if (x > GRID_COLUMNS - 1) return 0;
-    if (y > GRID_ROWS - 1) return 0;
+    if (x > Rules::COLUMNS - 1) return 0;
+    if (y > Rules::ROWS - 1) return 0;
 
-    if (grid[x][y].state == BubbleState::IDLE)
+    if (cellState(match.grid[x][y]) == BubbleState::IDLE)
     {
-        return findGroupSize(grid, x, y, color);
+        return findGroupSize<Rules>(match, chain, x, y, color);
     }
     return 0;
 }
 
-static void printBubble(const Bubble &bubble)
+static void addFallingBubble(MatchState &match, const glm::ivec2 &position, const BubbleColor color)
+{
+    FallingBubbles &falling = match.falling;
+    if (falling.size < MAX_FALLING_BUBBLES)
+    {
+        falling.x[falling.size] = position.x;
+        falling.y[falling.size] = position.y;
+        falling.colors[falling.size] = color;
+        falling.size++;
+    }
+}
+
+// Moves the last bubble into the gap. The pair can't survive that, so it stops being one.
+static void removeFallingBubble(MatchState &match, const uint8_t index)
+{
+    FallingBubbles &falling = match.falling;
+    falling.size--;
+    falling.x[index] = falling.x[falling.size];
+    falling.y[index] = falling.y[falling.size];
+    falling.colors[index] = falling.colors[falling.size];
+    falling.pair = false;
+}
+
+template<typename Rules>
+static void addCell(CellList &list, const uint8_t x, const uint8_t y)
+{
+    if (list.size < MAX_GRID_CELLS)
+    {
+        list.cells[list.size++] = (x * Rules::ROWS) + y;
+    }
+}
+
+template<typename Rules>
+static void addBounce(BounceList &list, const uint8_t x, const uint8_t y)
+{
+    if (list.size < MAX_GRID_CELLS)
+    {
+        list.cells[list.size] = (x * Rules::ROWS) + y;
+        list.amounts[list.size] = BOUNCE_HEIGHT;
+        list.directions[list.size] = -1;
+        list.size++;
+    }
+}
+
+template<typename Rules>
+static GridCell &cellAt(MatchState &match, const uint8_t cell)
+{
+    return match.grid[cell / Rules::ROWS][cell % Rules::ROWS];
+}
+
+template<typename Rules>
+static bool isVisited(const MatchState &match, const uint8_t x, const uint8_t y)
+{
+    return CellSet<Rules>::contains(match.visited, (x * Rules::ROWS) + y);
+}
+
+static BubbleColor randomSpawnColor(MatchState &match)
 {
-    std::cout << "(" << bubble.playSpacePosition.x << "," << bubble.playSpacePosition.y << ") state: " << bubble.state << std::endl;
-}
\ No newline at end of file
+    return static_cast<BubbleColor>(nextMatchRandom(match) % (MAX_SPAWN_COLOR + 1));
+}
+
+// Same sequence as the MSVC rand() that matches used to spawn from, so replays recorded before this still play.
+static uint16_t nextMatchRandom(MatchState &match)
+{
+    match.randomState = (match.randomState * 214013) + 2531011;
+    return (match.randomState >> 16) & 0x7FFF;
+}
@@ -1,14 +1,133 @@
 #ifndef STATE_HANDLERS_H
 #define STATE_HANDLERS_H
 
-void resetGameLogic();
-GameState spawnBubble(std::list<Bubble> &fallingBubbles, std::pair<BubbleColor, BubbleColor> &nextColors);
-GameState controlPlayerBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, Controls &controls, const double secondsSinceLastUpdate);
-GameState dropEnemyBubbles(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, uint8_t &numEnemyBubbles, const double secondsSinceLastUpdate);
-GameState scanForVictims(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], uint32_t &score);
-GameState animateDeaths(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS]);
-GameState scanForFloaters(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles);
-GameState gravity(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS], std::list<Bubble> &fallingBubbles, const double secondsSinceLastUpdate);
-GameState gameOver(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS]);
+#include <type_traits>
+#include "defs.h"
+#include "match_rules.h"
+
+/* Everything that decides how a match plays out, stepped one tick at a time by stepMatch.
+ *
+ * A MatchState is plain data: grid positions are stored as indices rather than pointers and the spawn
+ * colours come from its own random state, so a copy is a complete, independent match. Snapshots for
+ * rewind, rollback or checkpoints are a single memcpy, and two matches can be stepped side by side.
+ */
+
+// Floaters come from the grid and enemy bubbles only drop once everything else has landed, so a grid's worth is the most that can fall at once.
+const uint8_t MAX_FALLING_BUBBLES = MAX_GRID_CELLS;
+
+// Grid positions, each stored as column * Rules::ROWS + row for the match's mode.
+struct CellList
+{
+    uint8_t cells[MAX_GRID_CELLS];
+    uint8_t size;
+};
+
+const uint8_t MAX_CELL_SET_WORDS = (MAX_GRID_CELLS + 63) / 64;
+
+/*
+ * One bit per grid position, numbered as in CellList, kept in the words of a MatchState. The number of words
+ * used follows from the policy, so the classic grid is still a single word and its bits are where they always were.
+**/
+template<typename Rules>
+struct CellSet
+{
+    static const uint8_t WORDS = ((Rules::COLUMNS * Rules::ROWS) + 63) / 64;
+
+    static bool contains(const uint64_t (&words)[MAX_CELL_SET_WORDS], const uint8_t cell)
+    {
+        return (words[cell / 64] >> (cell % 64)) & 1;
+    }
+
+    static void insert(uint64_t (&words)[MAX_CELL_SET_WORDS], const uint8_t cell)
+    {
+        words[cell / 64] |= uint64_t(1) << (cell % 64);
+    }
+
+    static void clear(uint64_t (&words)[MAX_CELL_SET_WORDS])
+    {
+        for (uint8_t i = 0; i < WORDS; i++)
+        {
+            words[i] = 0;
+        }
+    }
+};
+
+static_assert(CellSet<ClassicRules>::WORDS == 1 && CellSet<WideRules>::WORDS <= MAX_CELL_SET_WORDS, "The visited words hold every mode's grid");
+
+// Bubbles that have landed and are still bouncing, with how far each has left to go.
+struct BounceList
+{
+    uint8_t cells[MAX_GRID_CELLS];
+    int8_t amounts[MAX_GRID_CELLS];
+    int8_t directions[MAX_GRID_CELLS];
+    uint8_t size;
+};
+
+// Slots of the spawned pair in FallingBubbles.
+const uint8_t PAIR_BUDDY = 0, PAIR_MAIN = 1;
+
+/*
+ * Bubbles in the air, one entry across each array. Everything in here is FALLING, so no state is kept.
+ * Removing a bubble moves the last one into its place, so the order changes as bubbles land, except for
+ * the spawned pair, which stays in PAIR_BUDDY and PAIR_MAIN for as long as both are falling.
+**/
+struct FallingBubbles
+{
+    // Play space positions, kept as plain ints so MatchState stays trivially copyable whatever glm does.
+    int32_t x[MAX_FALLING_BUBBLES];
+    int32_t y[MAX_FALLING_BUBBLES];
+    BubbleColor colors[MAX_FALLING_BUBBLES];
+    uint8_t size;
+    // True from the pair spawning until one of it lands. Nothing else falls alongside the pair.
+    bool pair;
+};
+
+struct MatchState
+{
+    GameState state;
+    MatchMode mode;
+    // Only the mode's COLUMNS by ROWS corner is played in.
+    GridCell grid[MAX_GRID_COLUMNS][MAX_GRID_ROWS];
+    // CellSet of the bubbles scanForVictims has already counted in a chain. Cleared by scanForFloaters.
+    uint64_t visited[MAX_CELL_SET_WORDS];
+    FallingBubbles falling;
+    BubbleColor nextColors[2];
+    uint32_t score;
+    // Enemy bubbles waiting to drop.
+    uint8_t numEnemyBubbles;
+    // Bubbles this player's chains have sent (or would have sent, when not connected) since the match started.
+    uint16_t garbageSent;
+    // Bubbles sent by the last step, for the caller to pass on to the other player.
+    uint8_t garbageToSend;
+    // Game logic updates since the match started.
+    uint32_t tick;
+    uint32_t randomState;
+    int8_t fallAmount;
+    Direction buddyBubbleDirection;
+    BounceList bounceList;
+    // How far above or below its cell each bubble is drawn while it bounces. Only drawing reads it.
+    int8_t bounceOffsets[MAX_GRID_COLUMNS][MAX_GRID_ROWS];
+    // Tick the dying bubbles reach the last frame of their animation, which ends the deaths. They all start together.
+    uint32_t deathsEndTick;
+    // For game over animation.
+    int8_t gameOverRow;
+};
+
+static_assert(std::is_trivially_copyable<MatchState>::value, "Snapshots and the layer cache copy a MatchState with memcpy");
+
+inline glm::ivec2 fallingPosition(const FallingBubbles &falling, const uint8_t index)
+{
+    return glm::ivec2(falling.x[index], falling.y[index]);
+}
+
+// Starts a new match. The seed decides every spawn, so it is all a replay needs besides the mode and the inputs.
+void initMatchState(MatchState &match, const uint32_t seed, const MatchMode mode);
+/*
+ * Runs one tick of the match from its current state, which must be BUBBLE_SPAWN or later.
+ * Controls that were acted on are cleared. Returns the new state.
+**/
+GameState stepMatch(MatchState &match, Controls &controls, const double secondsSinceLastUpdate);
+void saveMatchState(const MatchState &match, MatchState &snapshot);
+void restoreMatchState(MatchState &match, const MatchState &snapshot);
 
 #endif
@@ -0,0 +1,298 @@
+#include <iostream>
+#include "glyph_cache.h"
+#include "render_queue.h"
+
+static bool rasterise(GlyphCache &cache, const uint32_t codepoint, CachedGlyph &glyph);
+static bool allocate(GlyphCache &cache, const GLuint width, const GLuint height, CachedGlyph &glyph);
+static bool allocateInShelf(GlyphShelf &shelf, const GLuint width, const GLuint height, GLuint &x);
+static bool addPage(GlyphCache &cache);
+static bool evictOldest(GlyphCache &cache);
+static void release(GlyphCache &cache, const CachedGlyph &glyph);
+
+bool initGlyphCache(GlyphCache &cache, const std::string &font, const GLuint fontSize)
+{
+    cache.loaded = false;
+    cache.rasterised = 0;
+    cache.evicted = 0;
+    if (FT_Init_FreeType(&cache.library))
+    {
+        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        return false;
+    }
+    if (FT_New_Face(cache.library, font.c_str(), 0, &cache.face))
+    {
+        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+        FT_Done_FreeType(cache.library);
+        return false;
+    }
+    FT_Set_Pixel_Sizes(cache.face, 0, fontSize);
+    cache.loaded = true;
+    return true;
+}
+
+void deleteGlyphCache(GlyphCache &cache)
+{
+    for (GlyphPage &page : cache.pages)
+    {
+        glDeleteTextures(1, &page.texture);
+    }
+    cache.pages.clear();
+    cache.glyphs.clear();
+    cache.recent.clear();
+    if (cache.loaded)
+    {
+        FT_Done_Face(cache.face);
+        FT_Done_FreeType(cache.library);
+        cache.loaded = false;
+    }
+}
+
+bool findGlyph(GlyphCache &cache, const uint32_t codepoint, Character &glyph)
+{
+    auto found = cache.glyphs.find(codepoint);
+    if (found == cache.glyphs.end())
+    {
+        CachedGlyph cached;
+        if (!rasterise(cache, codepoint, cached))
+        {
+            return false;
+        }
+        if (cached.packed)
+        {
+            cache.recent.push_front(codepoint);
+            cached.recent = cache.recent.begin();
+        }
+        found = cache.glyphs.insert(std::make_pair(codepoint, cached)).first;
+    }
+    CachedGlyph &cached = found->second;
+    cached.lastUsed = getRenderFrame();
+    if (cached.packed)
+    {
+        cache.recent.splice(cache.recent.begin(), cache.recent, cached.recent);
+    }
+    glyph = cached.character;
+    return true;
+}
+
+static bool rasterise(GlyphCache &cache, const uint32_t codepoint, CachedGlyph &glyph)
+{
+    // Code points the font doesn't have come out as its missing glyph box.
+    if (!cache.loaded || FT_Load_Char(cache.face, codepoint, FT_LOAD_RENDER))
+    {
+        return false;
+    }
+    const FT_GlyphSlot slot = cache.face->glyph;
+    const GLuint width = slot->bitmap.width;
+    const GLuint rows = slot->bitmap.rows;
+    glyph.character.TextureID = 0;
+    glyph.character.UVOrigin = glm::vec2(0.0f);
+    glyph.character.UVSize = glm::vec2(0.0f);
+    glyph.character.Size = glm::ivec2(width, rows);
+    glyph.character.Bearing = glm::ivec2(slot->bitmap_left, slot->bitmap_top);
+    glyph.character.Advance = slot->advance.x;
+    glyph.packed = false;
+    if (width == 0 || rows == 0)
+    {
+        return true;
+    }
+
+    const GLuint paddedWidth = width + GLYPH_PADDING * 2;
+    const GLuint paddedHeight = rows + GLYPH_PADDING * 2;
+    if (!allocate(cache, paddedWidth, paddedHeight, glyph))
+    {
+        return false;
+    }
+    // The padding is written too, clearing whatever was there before.
+    std::vector<unsigned char> pixels(paddedWidth * paddedHeight, 0);
+    for (GLuint y = 0; y < rows; y++)
+    {
+        for (GLuint x = 0; x < width; x++)
+        {
+            pixels[(y + GLYPH_PADDING) * paddedWidth + x + GLYPH_PADDING] = slot->bitmap.buffer[y * slot->bitmap.pitch + x];
+        }
+    }
+    const GlyphPage &page = cache.pages[glyph.page];
+    const GLuint top = page.shelves[glyph.shelf].y;
+    glBindTexture(GL_TEXTURE_2D, page.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, top, paddedWidth, paddedHeight, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glyph.character.TextureID = page.texture;
+    glyph.character.UVOrigin = glm::vec2(static_cast<float>(glyph.x + GLYPH_PADDING) / GLYPH_PAGE_SIZE, static_cast<float>(top + GLYPH_PADDING) / GLYPH_PAGE_SIZE);
+    glyph.character.UVSize = glm::vec2(static_cast<float>(width) / GLYPH_PAGE_SIZE, static_cast<float>(rows) / GLYPH_PAGE_SIZE);
+    cache.rasterised++;
+    return true;
+}
+
+/*
+ * Finds room for a glyph: a shelf of the right height first, then a new shelf, then a new page, and only
+ * then evicts glyphs, oldest first, until there is room.
+**/
+static bool allocate(GlyphCache &cache, const GLuint width, const GLuint height, CachedGlyph &glyph)
+{
+    if (width > GLYPH_PAGE_SIZE || height > GLYPH_PAGE_SIZE)
+    {
+        return false;
+    }
+    for (;;)
+    {
+        for (size_t p = 0; p < cache.pages.size(); p++)
+        {
+            std::vector<GlyphShelf> &shelves = cache.pages[p].shelves;
+            for (size_t s = 0; s < shelves.size(); s++)
+            {
+                if (allocateInShelf(shelves[s], width, height, glyph.x))
+                {
+                    glyph.page = static_cast<uint8_t>(p);
+                    glyph.shelf = static_cast<uint16_t>(s);
+                    glyph.width = width;
+                    glyph.packed = true;
+                    return true;
+                }
+            }
+        }
+        for (size_t p = 0; p < cache.pages.size(); p++)
+        {
+            GlyphPage &page = cache.pages[p];
+            if (page.used + height <= GLYPH_PAGE_SIZE)
+            {
+                GlyphShelf shelf;
+                shelf.y = page.used;
+                shelf.height = height;
+                shelf.used = width;
+                page.shelves.push_back(shelf);
+                page.used += height;
+                glyph.page = static_cast<uint8_t>(p);
+                glyph.shelf = static_cast<uint16_t>(page.shelves.size() - 1);
+                glyph.x = 0;
+                glyph.width = width;
+                glyph.packed = true;
+                return true;
+            }
+        }
+        if (!addPage(cache) && !evictOldest(cache))
+        {
+            return false;
+        }
+    }
+}
+
+static bool allocateInShelf(GlyphShelf &shelf, const GLuint width, const GLuint height, GLuint &x)
+{
+    if (height > shelf.height || height + GLYPH_SHELF_SLACK < shelf.height)
+    {
+        return false;
+    }
+    for (auto gap = shelf.gaps.begin(); gap != shelf.gaps.end(); ++gap)
+    {
+        if (gap->second >= width)
+        {
+            x = gap->first;
+            gap->first += width;
+            gap->second -= width;
+            if (gap->second == 0)
+            {
+                shelf.gaps.erase(gap);
+            }
+            return true;
+        }
+    }
+    if (shelf.used + width <= GLYPH_PAGE_SIZE)
+    {
+        x = shelf.used;
+        shelf.used += width;
+        return true;
+    }
+    return false;
+}
+
+static bool addPage(GlyphCache &cache)
+{
+    if (cache.pages.size() >= GLYPH_MAX_PAGES)
+    {
+        return false;
+    }
+    GlyphPage page;
+    page.used = 0;
+    glGenTextures(1, &page.texture);
+    glBindTexture(GL_TEXTURE_2D, page.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Sampled like the glyphs in the main atlas: white, with the coverage in alpha.
+    const GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    cache.pages.push_back(page);
+    return true;
+}
+
+// Evicts the least recently drawn glyph, unless it was drawn this frame. Returns false if nothing could be evicted.
+static bool evictOldest(GlyphCache &cache)
+{
+    if (cache.recent.empty())
+    {
+        return false;
+    }
+    auto oldest = cache.glyphs.find(cache.recent.back());
+    if (oldest->second.lastUsed == getRenderFrame())
+    {
+        return false;
+    }
+    release(cache, oldest->second);
+    cache.recent.pop_back();
+    cache.glyphs.erase(oldest);
+    cache.evicted++;
+    return true;
+}
+
+// Gives a glyph's space back to its shelf, and gives empty shelves at the bottom of the page back to the page.
+static void release(GlyphCache &cache, const CachedGlyph &glyph)
+{
+    GlyphPage &page = cache.pages[glyph.page];
+    GlyphShelf &shelf = page.shelves[glyph.shelf];
+    if (glyph.x + glyph.width == shelf.used)
+    {
+        shelf.used = glyph.x;
+        if (!shelf.gaps.empty() && shelf.gaps.back().first + shelf.gaps.back().second == shelf.used)
+        {
+            shelf.used = shelf.gaps.back().first;
+            shelf.gaps.pop_back();
+        }
+    }
+    else
+    {
+        auto next = shelf.gaps.begin();
+        while (next != shelf.gaps.end() && next->first < glyph.x)
+        {
+            ++next;
+        }
+        next = shelf.gaps.insert(next, std::make_pair(glyph.x, glyph.width));
+        // Join the gap after, then the one before.
+        auto after = next + 1;
+        if (after != shelf.gaps.end() && next->first + next->second == after->first)
+        {
+            next->second += after->second;
+            shelf.gaps.erase(after);
+        }
+        if (next != shelf.gaps.begin())
+        {
+            auto before = next - 1;
+            if (before->first + before->second == next->first)
+            {
+                before->second += next->second;
+                shelf.gaps.erase(next);
+            }
+        }
+    }
+    // Glyphs refer to shelves by index, so only the last shelf can go.
+    while (!page.shelves.empty() && page.shelves.back().used == 0)
+    {
+        page.used = page.shelves.back().y;
+        page.shelves.pop_back();
+    }
+}
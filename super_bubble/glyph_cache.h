@@ -0,0 +1,96 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/* Glyphs rasterised on first use.
+ *
+ * Code points past the ASCII set that TextRenderer loads up front are rasterised with FreeType the first time
+ * they are drawn, into pages: single channel textures of GLYPH_PAGE_SIZE square, filled a shelf at a time. A shelf
+ * is a row as tall as the first glyph put in it, and takes later glyphs up to GLYPH_SHELF_SLACK pixels shorter.
+ *
+ * No more than GLYPH_MAX_PAGES pages are made. Once they are full, the least recently drawn glyphs are evicted
+ * to make room, and the space they leave is reused. Glyphs drawn this render frame are never evicted, as the
+ * draws queued for them haven't been made yet, so a frame that needs more glyphs than the pages hold leaves
+ * the rest blank.
+ */
+
+const GLuint GLYPH_PAGE_SIZE = 512;
+const uint8_t GLYPH_MAX_PAGES = 4;
+const GLuint GLYPH_SHELF_SLACK = 4;
+// Empty pixels around each glyph, so filtering never picks up a neighbour.
+const GLuint GLYPH_PADDING = 1;
+
+/// Holds all state information relevant to a character as loaded using FreeType
+struct Character {
+    GLuint TextureID;   // ID handle of the atlas texture holding the glyph
+    glm::vec2 UVOrigin; // Top left of the glyph in the atlas
+    glm::vec2 UVSize;   // Size of the glyph in the atlas
+    glm::ivec2 Size;    // Size of glyph
+    glm::ivec2 Bearing; // Offset from baseline to left/top of glyph
+    GLuint Advance;     // Horizontal offset to advance to next glyph
+};
+
+// A row of a page. Glyphs are added at the end, or into gaps left by evicted glyphs.
+struct GlyphShelf
+{
+    GLuint y, height;
+    // Width taken from the left, gaps included.
+    GLuint used;
+    // Gaps as (x, width), sorted by x and never touching each other or the end of used.
+    std::vector<std::pair<GLuint, GLuint> > gaps;
+};
+
+struct GlyphPage
+{
+    GLuint texture;
+    std::vector<GlyphShelf> shelves;
+    // Height taken by the shelves.
+    GLuint used;
+};
+
+struct CachedGlyph
+{
+    Character character;
+    // Where it is packed, with padding. Glyphs with nothing to draw aren't packed and have no page.
+    bool packed;
+    uint8_t page;
+    uint16_t shelf;
+    GLuint x, width;
+    // Render frame it was last drawn in.
+    uint32_t lastUsed;
+    std::list<uint32_t>::iterator recent;
+};
+
+struct GlyphCache
+{
+    FT_Library library;
+    FT_Face face;
+    bool loaded;
+    std::vector<GlyphPage> pages;
+    std::unordered_map<uint32_t, CachedGlyph> glyphs;
+    // Code points of the packed glyphs, most recently drawn first.
+    std::list<uint32_t> recent;
+    uint32_t rasterised;
+    uint32_t evicted;
+};
+
+// Opens the font for rasterising. Pages are only made once glyphs need them.
+bool initGlyphCache(GlyphCache &cache, const std::string &font, const GLuint fontSize);
+void deleteGlyphCache(GlyphCache &cache);
+/*
+ * Finds the glyph for a code point, rasterising it if it isn't cached, and marks it drawn this frame.
+ * Returns false if it couldn't be made room for.
+**/
+bool findGlyph(GlyphCache &cache, const uint32_t codepoint, Character &glyph);
+
+#endif
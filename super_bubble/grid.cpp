@@ -4,74 +4,97 @@
 #include "resource_manager.h"
 #include "sprite_renderer.h"
 
-void initGrid(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS])
+void initGrid(GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS])
 {
-    for (uint8_t col = 0; col < GRID_COLUMNS; col++)
+    for (uint8_t col = 0; col < MAX_GRID_COLUMNS; col++)
     {
-        for (uint8_t row = 0; row < GRID_ROWS; row++)
+        for (uint8_t row = 0; row < MAX_GRID_ROWS; row++)
         {
-            gridSpaceToPlaySpace(glm::ivec2(col, row), grid[col][row].playSpacePosition);
-            grid[col][row].color = RED;
-            grid[col][row].state = DEAD;
-            grid[col][row].animationFrame = 0;
-            grid[col][row].visited = false;
-            grid[col][row].bounceAmount = BOUNCE_HEIGHT;
-            grid[col][row].bounceDir = -1;
+            grid[col][row] = makeGridCell(RED, DEAD);
         }
     }
 }
 
 
-void renderGrid(Bubble (&grid)[GRID_COLUMNS][GRID_ROWS], const double secondsSinceLastUpdate)
+uint8_t cellAnimationFrame(const MatchState &match, const GridCell cell)
 {
-    static double seconds = 0.0;
-    seconds += secondsSinceLastUpdate;
-
-    bool updateFrame = false;    
-    if (seconds > BUBBLE_FRAME_SECONDS)
-    {        
-        updateFrame = true;
-        seconds = 0.0;
+    // Counted in whole frames, so every bubble changes frame on the same tick.
+    const uint32_t frame = match.tick / BUBBLE_FRAME_TICKS;
+    if (cellState(cell) == DYING)
+    {
+        // The deaths started on the first frame and end on the last.
+        return (frame + BUBBLE_FRAMES - 1 - match.deathsEndTick / BUBBLE_FRAME_TICKS) % BUBBLE_FRAMES;
     }
-    
+    return frame % BUBBLE_FRAMES;
+}
+
+glm::ivec2 cellPlaySpacePosition(const MatchState &match, const uint8_t col, const uint8_t row)
+{
+    glm::ivec2 position;
+    gridSpaceToPlaySpace(glm::ivec2(col, row), position);
+    position.y += match.bounceOffsets[col][row];
+    return position;
+}
+
+void renderGrid(const MatchState &match)
+{
+    const GridShape &shape = MODE_GRIDS[match.mode];
+    const uint16_t cellSize = boardLayout(match.mode).cellSize;
     glm::uvec2 renderPos;
-    for (uint8_t col = 0; col < GRID_COLUMNS; col++)
+    for (uint8_t col = 0; col < shape.columns; col++)
     {
-        for (uint8_t row = 0; row < GRID_ROWS; row++)
+        for (uint8_t row = 0; row < shape.rows; row++)
         {
-            if (updateFrame)
-            {
-                if (grid[col][row].animationFrame + 1 < BUBBLE_FRAMES)
-                {
-                    grid[col][row].animationFrame++;    
-                }
-                else
-                {
-                    grid[col][row].animationFrame = 0;
-                }
-            }
-            if (grid[col][row].state != DEAD)
+            const GridCell cell = match.grid[col][row];
+            if (cellState(cell) != DEAD)
             {
                 // The bubbles are defined in play space, but this may be offset from window space, so transform it.
-                playSpaceToWindowSpace(grid[col][row].playSpacePosition, renderPos);
+                playSpaceToWindowSpace(match.mode, cellPlaySpacePosition(match, col, row), renderPos);
                 drawSprite(
-                    // The texture atlas to use.
-                    ResourceManager::GetTexture("bubbles"),
-                    // Size of source image to extract from texture atlas.
-                    UV_SIZE_BUBBLE,
+                    // Where the bubbles image is in the texture atlas.
+                    ResourceManager::GetRegion("bubbles"),
                     // Column in texture sheet to use.
-                    grid[col][row].animationFrame,
+                    cellAnimationFrame(match, cell),
                     // Row in texture sheet to use. Based on current state.
-                    grid[col][row].state - 1,
+                    cellState(cell) - 1,
                     // Render position in window space coordinates.
                     renderPos,
                     // Size of target rendered image in window.
-                    glm::uvec2(GRID_SIZE, GRID_SIZE),
+                    glm::uvec2(cellSize, cellSize),
                     // No rotation.
                     0.0f,
                     // RGB colour.
-                    BUBBLE_COLORS[grid[col][row].color]);
+                    BUBBLE_COLORS[cellColor(cell)]);
+            }
+        }
+    }
+}
+
+bool gridsLookSame(const MatchState &match, const MatchState &other)
+{
+    // A different mode is drawn in a different layout.
+    if (match.mode != other.mode)
+    {
+        return false;
+    }
+    const GridShape &shape = MODE_GRIDS[match.mode];
+    for (uint8_t col = 0; col < shape.columns; col++)
+    {
+        for (uint8_t row = 0; row < shape.rows; row++)
+        {
+            const GridCell a = match.grid[col][row];
+            const GridCell b = other.grid[col][row];
+            if (cellState(a) != cellState(b))
+            {
+                return false;
+            }
+            // Nothing of a dead bubble shows.
+            if (cellState(a) != DEAD && (a != b || cellAnimationFrame(match, a) != cellAnimationFrame(other, b) ||
+                match.bounceOffsets[col][row] != other.bounceOffsets[col][row]))
+            {
+                return false;
             }
         }
     }
-}
\ No newline at end of file
+    return true;
+}
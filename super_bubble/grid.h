@@ -3,8 +3,17 @@
 
 #include "defs.h"
 #include "transforms.h"
+#include "game_logic.h"
 
-void initGrid(Bubble(&grid)[GRID_COLUMNS][GRID_ROWS]);
-void renderGrid(Bubble (&grid)[GRID_COLUMNS][GRID_ROWS], const double secondsSinceLastUpdate);
+// Empties the whole of the grid storage, whatever part of it the mode plays in.
+void initGrid(GridCell (&grid)[MAX_GRID_COLUMNS][MAX_GRID_ROWS]);
+// Frame of a grid bubble's animation at the match's tick. Idle bubbles cycle from the start of the match, dying ones from their deaths.
+uint8_t cellAnimationFrame(const MatchState &match, const GridCell cell);
+// Where a grid bubble is drawn, which is its cell unless it is bouncing.
+glm::ivec2 cellPlaySpacePosition(const MatchState &match, const uint8_t col, const uint8_t row);
+// Draws the grid as it is at the match's tick, in the mode's layout. Reads the match only, so it can be skipped or run at any rate.
+void renderGrid(const MatchState &match);
+// True if renderGrid would draw both grids the same.
+bool gridsLookSame(const MatchState &match, const MatchState &other);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,106 @@
+#include "layers.h"
+#include "render_queue.h"
+
+static GLuint FBOs[NUM_LAYERS] = { 0 };
+static GLuint textures[NUM_LAYERS] = { 0 };
+static bool dirty[NUM_LAYERS] = { false };
+static GLuint layerWidth = 0;
+static GLuint layerHeight = 0;
+// What was bound before beginLayer.
+static GLint targetFBO = 0;
+static GLint targetViewport[4];
+
+static void copyLayer(const GLuint from, const GLuint to);
+
+void initLayers(const GLuint width, const GLuint height)
+{
+    deleteLayers();
+    layerWidth = width;
+    layerHeight = height;
+    glGenTextures(NUM_LAYERS, textures);
+    glGenFramebuffers(NUM_LAYERS, FBOs);
+    for (uint8_t i = 0; i < NUM_LAYERS; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBOs[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+        dirty[i] = true;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void deleteLayers()
+{
+    if (FBOs[0] != 0)
+    {
+        glDeleteFramebuffers(NUM_LAYERS, FBOs);
+        glDeleteTextures(NUM_LAYERS, textures);
+        for (uint8_t i = 0; i < NUM_LAYERS; i++)
+        {
+            FBOs[i] = 0;
+            textures[i] = 0;
+        }
+    }
+}
+
+void markLayerDirty(const Layer layer)
+{
+    for (uint8_t i = layer; i < NUM_LAYERS; i++)
+    {
+        dirty[i] = true;
+    }
+}
+
+bool beginLayer(const Layer layer)
+{
+    if (!dirty[layer])
+    {
+        return false;
+    }
+    dirty[layer] = false;
+
+    // Whatever is queued belongs to the target, not the layer.
+    flushRenderQueue();
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFBO);
+    glGetIntegerv(GL_VIEWPORT, targetViewport);
+    if (layer > 0)
+    {
+        copyLayer(FBOs[layer - 1], FBOs[layer]);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, FBOs[layer]);
+    glViewport(0, 0, layerWidth, layerHeight);
+    if (layer == 0)
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    return true;
+}
+
+void endLayer()
+{
+    flushRenderQueue();
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    glViewport(targetViewport[0], targetViewport[1], targetViewport[2], targetViewport[3]);
+}
+
+void drawLayer(const Layer layer)
+{
+    flushRenderQueue();
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    copyLayer(FBOs[layer], target);
+}
+
+// Copies a whole layer without going through a shader. Leaves both read and draw bound to the destination.
+static void copyLayer(const GLuint from, const GLuint to)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+    glBlitFramebuffer(0, 0, layerWidth, layerHeight, 0, 0, layerWidth, layerHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, to);
+}
@@ -0,0 +1,38 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+#include "defs.h"
+
+/* Cached layers for the game screen.
+ *
+ * Each layer is a framebuffer the size of the draw target holding everything up to and including that layer,
+ * so only the top one is copied to the screen each frame, with a single blit. A layer is only drawn again once
+ * it has been marked dirty, and it then starts from a copy of the layer under it. Anything that moves every
+ * frame is drawn straight to the target on top.
+ */
+
+enum Layer
+{
+    // The background image and the HUD.
+    LAYER_HUD,
+    // The bubbles settled in the grid.
+    LAYER_GRID,
+    NUM_LAYERS
+};
+
+// Creates the layers at the size of the draw target, all dirty. Can be called again when the target size changes.
+void initLayers(const GLuint width, const GLuint height);
+void deleteLayers();
+// Marks the layer and every layer above it to be drawn again.
+void markLayerDirty(const Layer layer);
+/*
+ * If the layer is dirty, binds it with the layer below already copied in and returns true. The caller
+ * then draws the layer and calls endLayer. Returns false if the layer is up to date.
+**/
+bool beginLayer(const Layer layer);
+// Goes back to drawing to the target that was bound before beginLayer.
+void endLayer();
+// Copies the layer, and so all of those below it, over the whole of the current draw target.
+void drawLayer(const Layer layer);
+
+#endif
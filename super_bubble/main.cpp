@@ -1,10 +1,14 @@
 #include <iostream>
-#include <list>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <sstream>
 #include <utility>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
 #include "enet/enet.h"
 #include "defs.h"
 #include "transforms.h"
@@ -15,43 +19,294 @@
 #include "game_logic.h"
 #include "bubble_net.h"
 #include "menu_effect.h"
+#include "selfplay.h"
+#include "evaluator.h"
+#include "bot.h"
+#include "replay.h"
+#include "replay_index.h"
+#include "replay_verify.h"
+#include "frame_export.h"
+#include "layers.h"
+#include "stream_buffer.h"
+#include "profiler.h"
+#include "frame_pacing.h"
+#include "render_target.h"
+#include "shader_sources.h"
+#include "texture_compress.h"
+#include "bubble_batch.h"
+#include "spectator.h"
+#include "render_queue.h"
 
-static void startGame();
+static void startGame(const uint32_t seed, const MatchMode mode);
 static GameState disconnect();
 static void update(const double secondsSinceLastUpdate);
 static void draw(const double secondsSinceLastUpdate);
+static void drawGameLayers();
 static void getServerText();
+static void updateBot();
+static bool startPlayback(const char *fileName, const uint32_t matchIndex, const int64_t matchOffset);
+static bool beginPlayback(const ReplayHeader &header);
+static NetMessage playbackTick();
+static void checkPlaybackEnd();
+static int runHeadlessReplay(const char *fileName, const int32_t matchIndex, const int64_t matchOffset);
+static int exportReplay(const char *fileName, const int32_t matchIndex, const int64_t matchOffset, const char *directory,
+    const GLuint width, const GLuint height, const ExportFormat format);
+static std::string getReplayFileName();
+static bool parseDisplayOption(char *argv[], const int argc, int &i);
+static bool parseModeOption(char *argv[], const int argc, int &i);
+static bool parseMatchNumber(const char *arg, int32_t &number);
+static bool parseMatchOffset(const char *arg, int64_t &offset);
+static void drawPacingStats();
+static void drawRenderStats();
+static void renderSizeChanged();
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
 static void charCallback(GLFWwindow* window, unsigned int codepoint);
+static void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 static const char* MENU_STRINGS [] = { "START SINGLE PLAYER", 
+                                       "WATCH BOT PLAY",
                                        "START MULTIPLAYER SERVER",
                                        "JOIN MULTIPLAYER SERVER",
                                        "HELP",
                                        "QUIT" };
-static const uint8_t NUM_MENU_ITEMS = 5;
-static const uint8_t MENU_START_SINGLE = 0, MENU_START_MULTI = 1, MENU_JOIN_MULTI = 2, MENU_HELP = 3, MENU_QUIT = 4;
+static const uint8_t NUM_MENU_ITEMS = 6;
+static const uint8_t MENU_START_SINGLE = 0, MENU_WATCH_BOT = 1, MENU_START_MULTI = 2, MENU_JOIN_MULTI = 3, MENU_HELP = 4, MENU_QUIT = 5;
+// Every match played is appended to a file in here, one file per day.
+static const char *REPLAY_DIR = "../replays/";
+// Where F4 writes the profiler history.
+static const char *PROFILE_FILE = "../profile.csv";
+// Game logic updates allowed per frame before the game gives up catching up and runs slow instead.
+static const uint8_t MAX_UPDATES_PER_FRAME = 5;
+// Frame times this close to TARGET_FRAME_SECONDS count as one update, so vsync jitter doesn't give 0 or 2 updates a frame.
+static const double UPDATE_SLACK_SECONDS = 0.002;
 
 static GLFWwindow* window = nullptr;
-static Bubble grid[GRID_COLUMNS][GRID_ROWS];
 static GameState state = MENU;
-static std::list<Bubble> fallingBubbles;
 static Controls controls;
 static TextRenderer *text = nullptr;
-static uint32_t score = 0;
-static std::pair <BubbleColor, BubbleColor> nextColors;
 static uint8_t selectedMenuItem = 0;
 
 static double frameTime = 0.0;
 static double startTime = 0.0;
 static uint32_t frame = 0;
 
-static uint8_t numEnemyBubbles = 0;
+// True when the player pair is controlled by the bot.
+static bool botPlaying = false;
+
+// The match being played. Replay records are stamped with its tick.
+static MatchState match;
+// Rules for matches played here. Replays are played under the rules they were recorded with.
+static MatchMode matchMode = MODE_CLASSIC;
+// Playback state. While replaying, controls and network messages come from the replay instead.
+static bool replaying = false;
+static ReplayReader replayReader = { nullptr, 0, 0, false };
+static ReplayEvent replayEvent;
+static bool hasReplayEvent = false;
+// Bubbles the replay says were sent.
+static uint16_t replayBubblesSent = 0;
+// Version 1 replays have no record of the bubbles sent.
+static bool replayChecksSent = false;
+// Set when playback finishes: whether the match ended the same way as when it was recorded.
+static bool replayVerified = false;
+// Set when playback finishes without reaching the recording's end record, so there was nothing to verify against.
+static bool replayCutOff = false;
+// Showing a wall of replays rather than the game.
+static bool spectating = false;
 
 static std::string errorMessage;
 static std::string server;
 
-int main()
+// Set with --pacing and --low-latency.
+static FramePacing framePacing = PACING_VSYNC;
+static double pacingCapFps = 0.0;
+static bool lowLatency = false;
+// Set with --window and --render-scale.
+static GLuint windowWidth = WIDTH;
+static GLuint windowHeight = HEIGHT;
+static float renderScale = 1.0f;
+
+int main(int argc, char *argv[])
 {
+    // Headless self-play data generation: --selfplay <output file> [matches] [threads]
+    if (argc >= 3 && strcmp(argv[1], "--selfplay") == 0)
+    {
+        uint32_t numMatches = argc >= 4 ? strtoul(argv[3], nullptr, 10) : 1000;
+        uint32_t numThreads = argc >= 5 ? strtoul(argv[4], nullptr, 10) : std::thread::hardware_concurrency();
+        return runSelfPlay(argv[2], numMatches, numThreads, static_cast<uint32_t>(time(NULL))) ? 0 : 1;
+    }
+    // Self-play file check: --selfplay-stats <self-play file>
+    // Decodes every column of every block and prints how well each compressed.
+    if (argc >= 3 && strcmp(argv[1], "--selfplay-stats") == 0)
+    {
+        return printSelfPlayStats(argv[2]) ? 0 : 1;
+    }
+    // Replay playback: --replay <replay file> [match number, or @offset as listed by --query] [--headless] [display options]
+    // Headless playback runs as fast as possible, checking the result of every match (or just the one given).
+    const char *replayFile = nullptr;
+    int32_t replayMatch = -1;
+    int64_t replayOffset = -1;
+    if (argc >= 3 && strcmp(argv[1], "--replay") == 0)
+    {
+        replayFile = argv[2];
+        bool headless = false;
+        for (int i = 3; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--headless") == 0)
+            {
+                headless = true;
+            }
+            else if (!parseMatchOffset(argv[i], replayOffset) && !parseDisplayOption(argv, argc, i) && !parseMatchNumber(argv[i], replayMatch))
+            {
+                std::cout << "Unknown option " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        if (headless)
+        {
+            return runHeadlessReplay(replayFile, replayMatch, replayOffset);
+        }
+    }
+    // Spectator wall: --spectate <replay file> [4 | 9 | 16] [display options]
+    // Plays the file's matches side by side, moving each board on to a later match as its own ends.
+    const char *spectateFile = nullptr;
+    uint8_t spectateBoards = 9;
+    if (argc >= 3 && strcmp(argv[1], "--spectate") == 0)
+    {
+        spectateFile = argv[2];
+        for (int i = 3; i < argc; i++)
+        {
+            if (parseDisplayOption(argv, argc, i))
+            {
+                continue;
+            }
+            int32_t count;
+            if (!parseMatchNumber(argv[i], count))
+            {
+                std::cout << "Unknown option " << argv[i] << std::endl;
+                return 1;
+            }
+            if (!isSpectatorBoardCount(count))
+            {
+                std::cout << "A spectator wall has 4, 9 or 16 boards." << std::endl;
+                return 1;
+            }
+            spectateBoards = static_cast<uint8_t>(count);
+        }
+    }
+    // Replay corpus index: --index <index file> [--threads N] <replay files...>
+    if (argc >= 4 && strcmp(argv[1], "--index") == 0)
+    {
+        uint32_t numThreads = std::thread::hardware_concurrency();
+        std::vector<std::string> files;
+        for (int i = 3; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            {
+                numThreads = strtoul(argv[++i], nullptr, 10);
+            }
+            else
+            {
+                files.push_back(argv[i]);
+            }
+        }
+        if (files.empty())
+        {
+            std::cout << "No replay files to index" << std::endl;
+            return 1;
+        }
+        return runReplayIndexer(argv[2], files, numThreads) ? 0 : 1;
+    }
+    // Replay search: --query <index file> [filters]
+    if (argc >= 3 && strcmp(argv[1], "--query") == 0)
+    {
+        ReplayQuery query;
+        if (!parseReplayQuery(argc - 3, argv + 3, query))
+        {
+            return 1;
+        }
+        return queryReplayIndex(argv[2], query) ? 0 : 1;
+    }
+    // Replay verification: --verify [--threads N] [replay files...]
+    // With no files, replay file names are read from stdin as they arrive.
+    if (argc >= 2 && strcmp(argv[1], "--verify") == 0)
+    {
+        uint32_t numThreads = std::thread::hardware_concurrency();
+        std::vector<std::string> files;
+        for (int i = 2; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            {
+                numThreads = strtoul(argv[++i], nullptr, 10);
+            }
+            else
+            {
+                files.push_back(argv[i]);
+            }
+        }
+        return runReplayVerifier(files, numThreads) == 0 ? 0 : 1;
+    }
+    // Replay video export: --export <replay file> <output directory> [match number | @offset] [--size <width>x<height>] [--tga] [--software]
+    // Draws every tick of the match offscreen and writes the frames out as fast as they can be drawn.
+    const char *exportDirectory = nullptr;
+    GLuint exportWidth = WIDTH;
+    GLuint exportHeight = HEIGHT;
+    ExportFormat exportFormat = EXPORT_RAW;
+    bool softwareRendering = false;
+    if (argc >= 4 && strcmp(argv[1], "--export") == 0)
+    {
+        replayFile = argv[2];
+        exportDirectory = argv[3];
+        for (int i = 4; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            {
+                if (sscanf(argv[++i], "%ux%u", &exportWidth, &exportHeight) != 2 || exportWidth == 0 || exportHeight == 0)
+                {
+                    std::cout << "Export size should be <width>x<height>" << std::endl;
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--tga") == 0)
+            {
+                exportFormat = EXPORT_TGA;
+            }
+            else if (strcmp(argv[i], "--software") == 0)
+            {
+                softwareRendering = true;
+            }
+            else if (!parseMatchOffset(argv[i], replayOffset) && !parseMatchNumber(argv[i], replayMatch))
+            {
+                std::cout << "Unknown option " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+    }
+    // Options for play: [--pacing vsync | uncapped | <frames per second>] [--low-latency]
+    //                   [--window <width>x<height>] [--render-scale <percent of window>] [--mode classic | three | wide]
+    if (argc >= 2 && (strcmp(argv[1], "--pacing") == 0 || strcmp(argv[1], "--low-latency") == 0
+        || strcmp(argv[1], "--window") == 0 || strcmp(argv[1], "--render-scale") == 0 || strcmp(argv[1], "--mode") == 0))
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (!parseDisplayOption(argv, argc, i) && !parseModeOption(argv, argc, i))
+            {
+                std::cout << "Unknown option " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+    }
+    // Texture conversion: --compress <image files...>
+    // Writes a .ktx of S3TC blocks and mipmaps next to each image, loaded in its place from then on.
+    if (argc >= 3 && strcmp(argv[1], "--compress") == 0)
+    {
+        return compressTextureFiles(argv + 2, argc - 2) ? 0 : 1;
+    }
+    // Board evaluator timings: --bench-eval [evaluations]
+    if (argc >= 2 && strcmp(argv[1], "--bench-eval") == 0)
+    {
+        benchmarkEvaluators(argc >= 3 ? strtoul(argv[2], nullptr, 10) : 10000000);
+        return 0;
+    }
+
     std::cout << "Starting GLFW context, OpenGL 3.3" << std::endl;    
 
     srand(time(NULL));
@@ -68,10 +323,22 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    // The game keeps its aspect ratio in any shape of window. Exports are drawn at a fixed size.
+    glfwWindowHint(GLFW_RESIZABLE, exportDirectory == nullptr ? GL_TRUE : GL_FALSE);
+    // Exports draw offscreen, so the window only provides the GL context.
+    glfwWindowHint(GLFW_VISIBLE, exportDirectory == nullptr ? GL_TRUE : GL_FALSE);
+    if (softwareRendering)
+    {
+#ifdef GLFW_OSMESA_CONTEXT_API
+        // Renders on the CPU with no display needed.
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#else
+        std::cout << "This GLFW was built without OSMesa, using the default context." << std::endl;
+#endif
+    }
 
     // Create a GLFWwindow object that we can use for GLFW's functions
-    window = glfwCreateWindow(WIDTH, HEIGHT, "Super Bubble", nullptr, nullptr);
+    window = glfwCreateWindow(windowWidth, windowHeight, "Super Bubble", nullptr, nullptr);
     glfwMakeContextCurrent(window);
     if (window == NULL)
     {
@@ -82,6 +349,7 @@ int main()
 
     // Set the required callback functions
     glfwSetKeyCallback(window, keyCallback);
+    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 
     // Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
     glewExperimental = GL_TRUE;
@@ -92,86 +360,184 @@ int main()
         return -1;
     }
 
-    // Define the viewport dimensions
-    glViewport(0, 0, WIDTH, HEIGHT);
+    // Frames are drawn at a fraction of the window size and scaled up. The viewport is set each frame.
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    initRenderTarget(framebufferWidth, framebufferHeight, renderScale);
+    beginRenderTarget();
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // Vertex data for sprites and text is streamed through this.
+    initStreamBuffer();
+
     // Load shaders.
-    ResourceManager::LoadShader("../shaders/sprite.vs", "../shaders/sprite.frag", nullptr, "sprite");
+    ResourceManager::LoadShader(SPRITE_VERTEX_SOURCE, SPRITE_FRAGMENT_SOURCE, nullptr, "sprite");
     // Configure shaders.
     glm::mat4 projection = glm::ortho(0.0f, static_cast<GLfloat>(WIDTH), static_cast<GLfloat>(HEIGHT), 0.0f, -1.0f, 1.0f);
     ResourceManager::GetShader("sprite").Use().SetInteger("sprite", 0);
     ResourceManager::GetShader("sprite").SetMatrix4("projection", projection);
     initSpriteRenderer(ResourceManager::GetShader("sprite"));
-    // Load textures.
-    ResourceManager::LoadTexture("../resources/textures/help.png", GL_FALSE, "help");
-    ResourceManager::LoadTexture("../resources/textures/background1.png", GL_FALSE, "background");
+    // Bubbles drawn many at once, for the spectator wall.
+    ResourceManager::LoadShader(BUBBLE_VERTEX_SOURCE, BUBBLE_FRAGMENT_SOURCE, nullptr, "bubble");
+    ResourceManager::GetShader("bubble").Use().SetInteger("image", 0);
+    ResourceManager::GetShader("bubble").SetMatrix4("projection", projection);
+    initBubbleBatch(ResourceManager::GetShader("bubble"));
+    // Full screen images load in the background, and are drawn black until they arrive.
+    ResourceManager::LoadTextureAsync("../resources/textures/help.png", GL_FALSE, "help");
+    ResourceManager::LoadTextureAsync("../resources/textures/background1.png", GL_FALSE, "background");
+    // Smaller textures are packed into atlases with the font glyphs below.
 #ifdef DEBUG
-    ResourceManager::LoadTexture("../resources/textures/bubbles_debug.png", GL_TRUE, "bubbles");
+    ResourceManager::QueueAtlasImage("../resources/textures/bubbles_debug.png", GL_TRUE, "bubbles", BUBBLE_FRAMES, BUBBLE_IMAGE_ROWS);
 #else
-    ResourceManager::LoadTexture("../resources/textures/bubbles.png", GL_TRUE, "bubbles");
+    ResourceManager::QueueAtlasImage("../resources/textures/bubbles.png", GL_TRUE, "bubbles", BUBBLE_FRAMES, BUBBLE_IMAGE_ROWS);
 #endif
     // Load text renderer.
     text = new TextRenderer(WIDTH, HEIGHT);
     text->Load("../fonts/ocraext.ttf", 24);
+    ResourceManager::BuildAtlases();
+    text->FindGlyphs();
 
     // Menu effect.
     initEffectRenderer();
+    // Cached background and grid.
+    initLayers(getRenderWidth(), getRenderHeight());
+    setSpriteTargetHeight(getRenderHeight());
+    // Shown with F3.
+    initProfiler();
 
-    // Sync to monitor refresh.
-    glfwSwapInterval(1);
+    // Sync to monitor refresh, unless told otherwise.
+    initFramePacing(window, framePacing, pacingCapFps, lowLatency);
+
+    int exitCode = 0;
+    if (exportDirectory != nullptr)
+    {
+        exitCode = exportReplay(replayFile, replayMatch, replayOffset, exportDirectory, exportWidth, exportHeight, exportFormat);
+        glfwSetWindowShouldClose(window, GL_TRUE);
+    }
+    else if (replayFile != nullptr && !startPlayback(replayFile, replayMatch < 0 ? 0 : replayMatch, replayOffset))
+    {
+        errorMessage.assign("Could not play replay.");
+    }
+    else if (spectateFile != nullptr)
+    {
+        spectating = startSpectatorWall(spectateFile, spectateBoards);
+        if (!spectating)
+        {
+            errorMessage.assign("Could not show replays.");
+        }
+    }
 
     // Game loop
+    double updateTime = 0.0;
     while (!glfwWindowShouldClose(window))
     {
+        // With a frame rate cap, this is where the time goes, so that input is read as late as possible.
+        waitForFrame();
+        beginProfileFrame();
         // Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
+        beginProfile(PROFILE_POLL_EVENTS);
         glfwPollEvents();
+        markInputSampled();
+        endProfile(PROFILE_POLL_EVENTS);
 
         if (frame != 0)
         {
             frameTime = glfwGetTime() - startTime;
         }
-        update(frameTime);
         startTime = glfwGetTime();
 
+        // The game logic always steps by TARGET_FRAME_SECONDS so that matches play out the same way when replayed.
+        updateTime += frameTime;
+        uint8_t updates = 0;
+        while (updateTime >= TARGET_FRAME_SECONDS - UPDATE_SLACK_SECONDS && updates < MAX_UPDATES_PER_FRAME)
+        {
+            beginProfile(PROFILE_UPDATE);
+            update(TARGET_FRAME_SECONDS);
+            endProfile(PROFILE_UPDATE);
+            updateTime -= TARGET_FRAME_SECONDS;
+            updates++;
+        }
+        if (updates == MAX_UPDATES_PER_FRAME)
+        {
+            updateTime = 0.0;
+        }
+
+        // Upload any images that have finished loading. The background is cached in the HUD layer.
+        if (ResourceManager::UpdateTextureLoads() > 0)
+        {
+            markLayerDirty(LAYER_HUD);
+        }
+
+        beginProfile(PROFILE_DRAW);
+        beginRenderTarget();
         draw(frameTime);
+        endProfile(PROFILE_DRAW);
+        drawProfileOverlay(*text);
+        drawPacingStats();
+        drawRenderStats();
+        beginProfile(PROFILE_PRESENT);
+        presentRenderTarget();
+        endProfile(PROFILE_PRESENT);
+        endRenderFrame();
+        endStreamFrame();
 
-        glfwSwapBuffers(window);
+        beginProfile(PROFILE_SWAP);
+        presentFrame();
+        endProfile(PROFILE_SWAP);
+        endProfileFrame();
 
         frame++;
     }
 
     // Clean up.
     deleteSpriteVertexArrays();
+    deleteBubbleBatch();
     deleteEffectVertexArrays();
+    deleteLayers();
+    deleteRenderTarget();
+    deleteStreamBuffer();
+    deleteProfiler();
+    delete text;
     ResourceManager::Clear();
 
+    if (isRecording())
+    {
+        stopRecording(match.tick, match.score, REPLAY_ABANDONED);
+    }
+    closeReplayFile(replayReader);
+    stopSpectatorWall();
+
     // Terminate GLFW, clearing any resources allocated by GLFW.
     glfwTerminate();
 
     shutdownNetwork();
     enet_deinitialize();
 
-    return 0;
+    return exitCode;
 }
 
-static void startGame()
+static void startGame(const uint32_t seed, const MatchMode mode)
 {
-	nextColors.first = static_cast<BubbleColor>(rand() % (MAX_SPAWN_COLOR + 1));
-	nextColors.second = static_cast<BubbleColor>(rand() % (MAX_SPAWN_COLOR + 1));
-	initGrid(grid);
+    initMatchState(match, seed, mode);
 	controls.left = false;
 	controls.right = false;
 	controls.drop = false;
 	controls.rotateCW = false;
-	score = 0;
-	resetGameLogic();
+	controls.rotateACW = false;
     frameTime = 0.0;
     startTime = 0.0;
     frame = 0;
-    state = GameState::BUBBLE_SPAWN;
+    state = match.state;
+
+    if (!replaying)
+    {
+        uint8_t flags = 0;
+        flags |= networkIsConnected() ? REPLAY_FLAG_MULTIPLAYER : 0;
+        flags |= botPlaying ? REPLAY_FLAG_BOT : 0;
+        startRecording(getReplayFileName().c_str(), seed, mode, flags);
+    }
 }
 
 static void getServerText()
@@ -200,10 +566,20 @@ static GameState disconnect()
 }
 
 static void update(const double secondsSinceLastUpdate) {
-    NetMessage netMsg = updateNetwork();
+    if (spectating)
+    {
+        updateSpectatorWall();
+        return;
+    }
+    const bool inGame = state >= GameState::BUBBLE_SPAWN;
+    NetMessage netMsg = replaying ? playbackTick() : updateNetwork();
+    if (inGame)
+    {
+        recordNetMessage(match.tick, netMsg);
+    }
     if (netMsg.type == NetMessageType::NUM_BUBBLES)
     {
-        numEnemyBubbles += netMsg.numBubbles;        
+        match.numEnemyBubbles += netMsg.numBubbles;        
     }
     else if (netMsg.type == NetMessageType::DISCONNECT_REQ)
     {
@@ -215,14 +591,27 @@ static void update(const double secondsSinceLastUpdate) {
     }
     else if (netMsg.type == NetMessageType::REMOTE_GAME_OVER)
     {
-        state = GameState::WIN;
+        match.state = GameState::WIN;
+        state = match.state;
+    }
+
+    const GameState previousState = state;
+    if (botPlaying)
+    {
+        updateBot();
+    }
+    if (inGame)
+    {
+        // Recorded as the state machine sees them, so bot matches replay too.
+        recordControls(match.tick, controls);
     }
 
+    beginProfile(stateProfileTimer(state));
+    const GameState profiledState = state;
     switch (state)
     {
     case GameState::MENU:
     case GameState::HELP:
-    case GameState::WIN:
     case GameState::TEXT_ENTRY:
         // Do nothing - handled by key press call-back.
         break;
@@ -230,40 +619,479 @@ static void update(const double secondsSinceLastUpdate) {
     case GameState::CLIENT_CONNECT:
         if (netMsg.type == CONNECTED)
         {
-            startGame();
+            // Both players use the host's rules, whatever --mode the client was started with.
+            startGame(static_cast<uint32_t>(time(NULL)), netMsg.mode);
         }
         break;
     case GameState::DISCONNECT:
         state = disconnect();
         break;
-    case GameState::BUBBLE_SPAWN:
-        state = spawnBubble(fallingBubbles, nextColors);
+    default:
+        // Everything from BUBBLE_SPAWN on is the match itself.
+        state = stepMatch(match, controls, secondsSinceLastUpdate);
         break;
+    }
+    endProfile(stateProfileTimer(profiledState));
+
+    if (inGame)
+    {
+        recordControlsUsed(controls);
+    }
+    if (match.garbageToSend > 0)
+    {
+        recordBubblesSent(match.tick - 1, match.garbageToSend);
+        if (networkIsConnected())
+        {
+            sendBubbles(match.garbageToSend);
+        }
+        match.garbageToSend = 0;
+    }
+    if (previousState != GameState::GAME_OVER && state == GameState::GAME_OVER && networkIsConnected())
+    {
+        sendGameOver();
+    }
+    if (isRecording() && (state < GameState::BUBBLE_SPAWN || state == GameState::WIN || state == GameState::GAME_OVER))
+    {
+        stopRecording(match.tick, match.score, getReplayResult(state));
+    }
+    if (replaying)
+    {
+        checkPlaybackEnd();
+    }
+
+    if (botPlaying && previousState == GameState::PLAYER_CONTROL && state != GameState::PLAYER_CONTROL)
+    {
+        botMoveFinished();
+    }
+    if (botPlaying && previousState != GameState::GAME_OVER && state == GameState::GAME_OVER)
+    {
+        const BotStats &stats = getBotStats();
+        std::cout << "Bot: " << stats.movesMade << " moves, average depth " << (stats.movesMade > 0 ? static_cast<double>(stats.depthTotal) / stats.movesMade : 0.0)
+            << ", " << stats.nodes << " nodes, " << stats.deadlineMisses << "/" << stats.frames << " frames over budget (worst by "
+            << stats.worstOverrunSeconds * 1000.0 << "ms), " << stats.speculativeHits << "/" << stats.speculativeSearches << " speculative searches used" << std::endl;
+    }
+}
+
+/*
+ * Runs the bot's share of the frame. While the pair is under control the bot searches the real position and
+ * steers towards its best move. While the pair and any chain reaction settle, it searches ahead on the
+ * next pair from a prediction of the settled board.
+**/
+static void updateBot()
+{
+    Board board;
+    switch (state)
+    {
     case GameState::PLAYER_CONTROL:
-        state = controlPlayerBubbles(grid, fallingBubbles, controls, secondsSinceLastUpdate);
+    {
+        boardFromGrid(match.grid, match.mode, board);
+        std::pair<BubbleColor, BubbleColor> colors(match.falling.colors[PAIR_MAIN], match.falling.colors[PAIR_BUDDY]);
+        std::pair<BubbleColor, BubbleColor> nextColors(match.nextColors[0], match.nextColors[1]);
+        startBotSearch(board, colors, nextColors, match.numEnemyBubbles, false);
+        continueBotSearch(BOT_FRAME_BUDGET_SECONDS);
+        steerBot(match, controls);
         break;
+    }
     case GameState::DROP_ENEMY_BUBBLES:
-        state = dropEnemyBubbles(grid, fallingBubbles, numEnemyBubbles, secondsSinceLastUpdate);
-        break;
     case GameState::SCAN_FOR_VICTIMS:
-        state = scanForVictims(grid, score);
-        break;
     case GameState::ANIMATE_DEATHS:
-        state = animateDeaths(grid);
-        break;
     case GameState::SCAN_FOR_FLOATERS:
-        state = scanForFloaters(grid, fallingBubbles);
-        break;
     case GameState::GRAVITY:
-        state = gravity(grid, fallingBubbles, secondsSinceLastUpdate);
+    {
+        predictSettledBoard(match, board);
+        std::pair<BubbleColor, BubbleColor> nextColors(match.nextColors[0], match.nextColors[1]);
+        startBotSearch(board, nextColors, nextColors, 0, true);
+        continueBotSearch(BOT_FRAME_BUDGET_SECONDS);
         break;
-    case GameState::GAME_OVER:
-        state = gameOver(grid);
+    }
+    default:
         break;
     }
 }
 
+static bool startPlayback(const char *fileName, const uint32_t matchIndex, const int64_t matchOffset)
+{
+    ReplayHeader header;
+    if (!openReplayFile(fileName, replayReader))
+    {
+        std::cout << "Failed to open replay file " << fileName << std::endl;
+        return false;
+    }
+    if (matchOffset >= 0)
+    {
+        if (!seekReplayMatch(replayReader, matchOffset, header))
+        {
+            std::cout << "Replay file has no match at offset " << matchOffset << std::endl;
+            return false;
+        }
+        return beginPlayback(header);
+    }
+    for (uint32_t i = 0; i <= matchIndex; i++)
+    {
+        if (!nextReplayMatch(replayReader, header))
+        {
+            std::cout << "Replay file has no match " << matchIndex << std::endl;
+            return false;
+        }
+    }
+    return beginPlayback(header);
+}
+
+static bool beginPlayback(const ReplayHeader &header)
+{
+    MatchMode mode;
+    if (!findReplayMode(header.rules, mode))
+    {
+        std::cout << "Replay was recorded with different rules." << std::endl;
+        return false;
+    }
+    botPlaying = false;
+    replaying = true;
+    replayVerified = false;
+    replayCutOff = false;
+    replayBubblesSent = 0;
+    replayChecksSent = header.version >= 2;
+    startGame(header.seed, mode);
+    hasReplayEvent = readReplayEvent(replayReader, replayEvent);
+    return true;
+}
+
+/*
+ * Applies the replay records for this tick. Controls are set directly and a recorded network message
+ * is returned in place of one from the network.
+**/
+static NetMessage playbackTick()
+{
+    NetMessage message;
+    message.type = NetMessageType::NO_MESSAGE;
+    message.numBubbles = 0;
+    message.mode = match.mode;
+    if (state < GameState::BUBBLE_SPAWN)
+    {
+        return message;
+    }
+
+    while (hasReplayEvent && replayEvent.tick <= match.tick && replayEvent.type != REPLAY_END)
+    {
+        switch (replayEvent.type)
+        {
+        case REPLAY_CONTROLS:
+            controls = replayEvent.controls;
+            break;
+        case REPLAY_NUM_BUBBLES:
+            message.type = NetMessageType::NUM_BUBBLES;
+            message.numBubbles = replayEvent.numBubbles;
+            break;
+        case REPLAY_REMOTE_GAME_OVER:
+            message.type = NetMessageType::REMOTE_GAME_OVER;
+            break;
+        case REPLAY_BUBBLES_SENT:
+            replayBubblesSent += replayEvent.numBubbles;
+            break;
+        default:
+            break;
+        }
+        hasReplayEvent = readReplayEvent(replayReader, replayEvent);
+    }
+    return message;
+}
+
+// Stops playback once the match has run for as many ticks as when it was recorded, and checks it ended the same way.
+static void checkPlaybackEnd()
+{
+    if (hasReplayEvent && (replayEvent.type != REPLAY_END || replayEvent.tick > match.tick))
+    {
+        return;
+    }
+
+    replaying = false;
+    const ReplayResult result = getReplayResult(state);
+    if (hasReplayEvent)
+    {
+        replayVerified = replayEvent.score == match.score && replayEvent.result == result &&
+            (!replayChecksSent || replayBubblesSent == match.garbageSent);
+        if (!replayVerified)
+        {
+            std::cout << "Replay mismatch at tick " << match.tick << ": score " << match.score << " (recorded " << replayEvent.score
+                << "), result " << result << " (recorded " << replayEvent.result << "), bubbles sent " << match.garbageSent
+                << " (recorded " << replayBubblesSent << ")" << std::endl;
+        }
+    }
+    else
+    {
+        // Recording was cut off, so there is nothing to check against. Not verified, as a damaged file proves nothing.
+        replayCutOff = true;
+        std::cout << "Replay cut off at tick " << match.tick << ", before the end of the match was recorded" << std::endl;
+    }
+    hasReplayEvent = false;
+    if (result == REPLAY_ABANDONED)
+    {
+        state = GameState::DISCONNECT;
+    }
+}
+
+static int runHeadlessReplay(const char *fileName, const int32_t matchIndex, const int64_t matchOffset)
+{
+    if (!openReplayFile(fileName, replayReader))
+    {
+        std::cout << "Failed to open replay file " << fileName << std::endl;
+        return 1;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ReplayHeader header;
+    int32_t index = 0;
+    uint32_t matches = 0;
+    uint32_t mismatches = 0;
+    uint32_t cutOff = 0;
+    uint64_t ticks = 0;
+    bool haveMatch = matchOffset >= 0 ? seekReplayMatch(replayReader, matchOffset, header) : nextReplayMatch(replayReader, header);
+    for (; haveMatch; haveMatch = matchOffset < 0 && nextReplayMatch(replayReader, header))
+    {
+        if (matchIndex >= 0 && index++ != matchIndex)
+        {
+            continue;
+        }
+        matches++;
+        if (!beginPlayback(header))
+        {
+            mismatches++;
+            continue;
+        }
+        while (replaying)
+        {
+            update(TARGET_FRAME_SECONDS);
+        }
+        ticks += match.tick;
+        if (replayCutOff)
+        {
+            cutOff++;
+        }
+        else if (!replayVerified)
+        {
+            mismatches++;
+        }
+    }
+    closeReplayFile(replayReader);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << matches << " matches replayed, " << mismatches << " mismatched, " << cutOff << " cut off. " << ticks << " ticks in " << seconds << "s ("
+        << (seconds > 0.0 ? (ticks * TARGET_FRAME_SECONDS) / seconds : 0.0) << "x real time)" << std::endl;
+    return mismatches == 0 && cutOff == 0 ? 0 : 1;
+}
+
+/*
+ * Plays back one match, drawing every tick into the export framebuffer. Nothing waits on the clock or the
+ * display, so this runs as fast as frames can be drawn and read back.
+**/
+static int exportReplay(const char *fileName, const int32_t matchIndex, const int64_t matchOffset, const char *directory,
+    const GLuint width, const GLuint height, const ExportFormat format)
+{
+    if (!startPlayback(fileName, matchIndex < 0 ? 0 : matchIndex, matchOffset))
+    {
+        return 1;
+    }
+    // Every frame has to have the real images in it.
+    ResourceManager::FinishTextureLoads();
+    if (!startFrameExport(directory, width, height, format))
+    {
+        return 1;
+    }
+    setSpriteTargetHeight(height);
+    initLayers(width, height);
+    glfwSwapInterval(0);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // One frame per tick, drawn after the update as in the game loop.
+    while (replaying)
+    {
+        update(TARGET_FRAME_SECONDS);
+        beginExportFrame();
+        draw(TARGET_FRAME_SECONDS);
+        endExportFrame();
+        endRenderFrame();
+        endStreamFrame();
+        frame++;
+    }
+    // Hold the final screen for a second.
+    for (uint32_t i = 0; i < TARGET_FPS; i++)
+    {
+        beginExportFrame();
+        draw(TARGET_FRAME_SECONDS);
+        endExportFrame();
+        endRenderFrame();
+        endStreamFrame();
+        frame++;
+    }
+    const uint32_t framesWritten = finishFrameExport();
+    renderSizeChanged();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << framesWritten << " frames of " << width << "x" << height << " written to " << directory << " in " << seconds << "s ("
+        << (seconds > 0.0 ? framesWritten / seconds : 0.0) << " fps, " << (seconds > 0.0 ? (framesWritten * TARGET_FRAME_SECONDS) / seconds : 0.0)
+        << "x real time)" << std::endl;
+    return framesWritten == frame && replayVerified ? 0 : 1;
+}
+
+// Reads a match number for --replay or --export, or a board count for --spectate. False if arg isn't a whole number.
+static bool parseMatchNumber(const char *arg, int32_t &number)
+{
+    char *end;
+    const long value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || value < 0 || value > INT32_MAX)
+    {
+        return false;
+    }
+    number = static_cast<int32_t>(value);
+    return true;
+}
+
+// Reads an @offset (as listed by --query) for --replay or --export. False if arg isn't an @ and a whole number.
+static bool parseMatchOffset(const char *arg, int64_t &offset)
+{
+    if (arg[0] != '@')
+    {
+        return false;
+    }
+    char *end;
+    const long long value = strtoll(arg + 1, &end, 10);
+    if (end == arg + 1 || *end != '\0' || value < 0)
+    {
+        return false;
+    }
+    offset = value;
+    return true;
+}
+
+// Reads --mode at argv[i], moving i past its value. False if it isn't there.
+static bool parseModeOption(char *argv[], const int argc, int &i)
+{
+    if (strcmp(argv[i], "--mode") != 0 || i + 1 >= argc)
+    {
+        return false;
+    }
+    const char *mode = argv[++i];
+    for (uint8_t m = 0; m < NUM_MATCH_MODES; m++)
+    {
+        if (strcmp(mode, MATCH_MODE_NAMES[m]) == 0)
+        {
+            matchMode = static_cast<MatchMode>(m);
+            return true;
+        }
+    }
+    std::cout << "Mode should be classic, three or wide, using classic." << std::endl;
+    matchMode = MODE_CLASSIC;
+    return true;
+}
+
+// Reads a display option at argv[i], moving i past its value. False if it isn't one.
+static bool parseDisplayOption(char *argv[], const int argc, int &i)
+{
+    if (strcmp(argv[i], "--low-latency") == 0)
+    {
+        lowLatency = true;
+        return true;
+    }
+    if (strcmp(argv[i], "--window") == 0 && i + 1 < argc)
+    {
+        if (sscanf(argv[++i], "%ux%u", &windowWidth, &windowHeight) != 2 || windowWidth == 0 || windowHeight == 0)
+        {
+            std::cout << "Window size should be <width>x<height>, using " << WIDTH << "x" << HEIGHT << "." << std::endl;
+            windowWidth = WIDTH;
+            windowHeight = HEIGHT;
+        }
+        return true;
+    }
+    if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+    {
+        renderScale = static_cast<float>(atof(argv[++i])) / 100.0f;
+        if (renderScale <= 0.0f || renderScale > 1.0f)
+        {
+            std::cout << "Render scale should be a percentage up to 100, using 100." << std::endl;
+            renderScale = 1.0f;
+        }
+        return true;
+    }
+    if (strcmp(argv[i], "--pacing") != 0 || i + 1 >= argc)
+    {
+        return false;
+    }
+    const char *pacing = argv[++i];
+    if (strcmp(pacing, "vsync") == 0)
+    {
+        framePacing = PACING_VSYNC;
+    }
+    else if (strcmp(pacing, "uncapped") == 0)
+    {
+        framePacing = PACING_UNCAPPED;
+    }
+    else
+    {
+        framePacing = PACING_CAP;
+        pacingCapFps = atof(pacing);
+        if (pacingCapFps <= 0.0)
+        {
+            std::cout << "Pacing should be vsync, uncapped or a frame rate, using vsync." << std::endl;
+            framePacing = PACING_VSYNC;
+        }
+    }
+    return true;
+}
+
+// Remakes what is drawn at the size of the render target.
+static void renderSizeChanged()
+{
+    initLayers(getRenderWidth(), getRenderHeight());
+    setSpriteTargetHeight(getRenderHeight());
+}
+
+// Input to display latency, shown at the bottom of the screen along with the profiler overlay.
+static void drawPacingStats()
+{
+    if (!profilerEnabled())
+    {
+        return;
+    }
+    const PacingStats &stats = getPacingStats();
+    std::ostringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(1);
+    ss << "input to " << (lowLatency ? "present" : "swap") << " ms avg " << stats.averageLatencySeconds * 1000.0
+        << " worst " << stats.worstLatencySeconds * 1000.0 << ", work avg " << stats.averageWorkSeconds * 1000.0;
+    text->RenderText(ss.str(), 10.0f, HEIGHT - 20.0f, SCALE * 0.4f, glm::vec3(1.0f, 1.0f, 0.0f));
+}
+
+// Shown with the profiler, for the frame before this one, as this one is still being queued.
+static void drawRenderStats()
+{
+    if (!profilerEnabled())
+    {
+        return;
+    }
+    const RenderStats &stats = getRenderStats();
+    std::ostringstream ss;
+    ss << stats.commands << " commands in " << stats.drawCalls << " draws, changes: program " << stats.programChanges
+        << " texture " << stats.textureChanges << " vao " << stats.vertexArrayChanges << " blend " << stats.blendChanges
+        << " uniform " << stats.uniformChanges;
+    text->RenderText(ss.str(), 10.0f, HEIGHT - 40.0f, SCALE * 0.4f, glm::vec3(1.0f, 1.0f, 0.0f));
+}
+
+static std::string getReplayFileName()
+{
+    char date[16];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y%m%d", localtime(&now));
+    std::string fileName(REPLAY_DIR);
+    fileName.append(date).append(".sbr");
+    return fileName;
+}
+
 static void draw(const double secondsSinceLastUpdate) {    
+    if (spectating)
+    {
+        drawSpectatorWall(*text);
+        return;
+    }
     if (state == GameState::MENU || 
         state == GameState::SERVER_LISTEN || 
         state == GameState::CLIENT_CONNECT ||
@@ -272,6 +1100,7 @@ static void draw(const double secondsSinceLastUpdate) {
         float theta = static_cast<float>(frame) / 30.0f;        
         if (state == GameState::MENU)
         {
+            ProfileScope profile(PROFILE_MENU_EFFECT);
             drawMenuEffect(secondsSinceLastUpdate);
         }
         else
@@ -301,7 +1130,7 @@ static void draw(const double secondsSinceLastUpdate) {
 	}
     else if (state == GameState::HELP)
     {
-        drawSprite(ResourceManager::GetTexture("help"), UV_SIZE_WHOLE_IMAGE, 0, 0, glm::uvec2(0, 0), glm::uvec2(WIDTH, HEIGHT), 0.0f);
+        drawSprite(ResourceManager::GetRegion("help"), 0, 0, glm::uvec2(0, 0), glm::uvec2(WIDTH, HEIGHT), 0.0f, glm::vec3(1.0f), 0.0f, PASS_BACKGROUND);
     }
     else if (state == GameState::TEXT_ENTRY)
     {
@@ -324,49 +1153,44 @@ static void draw(const double secondsSinceLastUpdate) {
     }
 	else
 	{
-		drawSprite(ResourceManager::GetTexture("background"), UV_SIZE_WHOLE_IMAGE, 0, 0, glm::uvec2(0, 0), glm::uvec2(WIDTH, HEIGHT), 0.0f);
-        
-		renderGrid(grid, secondsSinceLastUpdate);
+		drawGameLayers();
 
 		glm::uvec2 renderPos;
+		const BoardLayout &layout = boardLayout(match.mode);
 		// Render falling sprites.
-		for (std::list<Bubble>::iterator it = fallingBubbles.begin(); it != fallingBubbles.end(); it++)
+		beginProfile(PROFILE_FALLING);
+		for (uint8_t i = 0; i < match.falling.size; i++)
 		{
 			// The bubbles are defined in play space, but this may be offset from window space, so transform it.
-			playSpaceToWindowSpace((*it).playSpacePosition, renderPos);
+			playSpaceToWindowSpace(match.mode, fallingPosition(match.falling, i), renderPos);
 
 			drawSprite(
-				// The texture atlas to use.
-				ResourceManager::GetTexture("bubbles"),
-				// Size of source image to extract from texture atlas.
-				UV_SIZE_BUBBLE,
-				// Column in texture sheet to use.
-				(*it).animationFrame,
+				// Where the bubbles image is in the texture atlas.
+				ResourceManager::GetRegion("bubbles"),
+				// Column in texture sheet to use. Falling bubbles don't animate.
+				0,
 				// Row in texture sheet to use. Based on current state.
-				(*it).state - 1,
+				FALLING - 1,
 				// Render position in window space coordinates.
 				renderPos,
 				// Size of target rendered image in window.
-				glm::uvec2(GRID_SIZE, GRID_SIZE),
+				glm::uvec2(layout.cellSize, layout.cellSize),
 				// No rotation.
 				0.0f,
 				// RGB colour.
-                BUBBLE_COLORS[(*it).color],
+                BUBBLE_COLORS[match.falling.colors[i]],
 				// Clip falling sprites to top of play space so they enter smoothly
-				PLAY_SPACE_POS.y);
+				layout.position.y);
 		}
+		endProfile(PROFILE_FALLING);
 
-		// Render next bubbles.
-		drawSprite(ResourceManager::GetTexture("bubbles"), UV_SIZE_BUBBLE, 0, 0, NEXT_BUBBLE_POS,
-			glm::uvec2(GRID_SIZE, GRID_SIZE), 0.0f, BUBBLE_COLORS[nextColors.first], 0);
-		drawSprite(ResourceManager::GetTexture("bubbles"), UV_SIZE_BUBBLE, 0, 0, NEXT_BUBBLE_POS + glm::uvec2(0, GRID_SIZE),
-			glm::uvec2(GRID_SIZE, GRID_SIZE), 0.0f, BUBBLE_COLORS[nextColors.second], 0);
-		text->RenderText("NEXT", NEXT_BUBBLE_LABEL_POS.x, NEXT_BUBBLE_LABEL_POS.y, SCALE, glm::vec3(1.0f, 0.0f, 0.0f));
-
-		// Render score.
-		std::ostringstream ss;
-		ss << "Score " << score;
-		text->RenderText(ss.str(), SCORE_POS.x, SCORE_POS.y, SCALE, glm::vec3(1.0f, 0.0f, 0.0f));
+        if (botPlaying)
+        {
+            const BotStats &stats = getBotStats();
+            std::ostringstream botText;
+            botText << "Depth " << (uint16_t)stats.depthReached << " Late " << stats.deadlineMisses;
+            text->RenderText(botText.str(), SCORE_POS.x, SCORE_POS.y + MENU_Y_SPACING, SCALE * 0.5f, MENU_COLOR);
+        }
 
 		if (state == GameState::GAME_OVER)
 		{
@@ -379,12 +1203,94 @@ static void draw(const double secondsSinceLastUpdate) {
 	}
 }
 
+/*
+ * Draws the layers that have changed since they were last drawn, then copies them to the screen.
+ * The HUD layer changes with the score and next bubbles, the grid layer when a settled bubble lands,
+ * dies or moves on to its next animation frame.
+**/
+static void drawGameLayers()
+{
+    static uint32_t layerScore = 0;
+    static BubbleColor layerNextColors[2] = { RED, RED };
+    static MatchState layerMatch;
+    if (match.score != layerScore || match.nextColors[0] != layerNextColors[0] || match.nextColors[1] != layerNextColors[1])
+    {
+        markLayerDirty(LAYER_HUD);
+        layerScore = match.score;
+        layerNextColors[0] = match.nextColors[0];
+        layerNextColors[1] = match.nextColors[1];
+    }
+    if (!gridsLookSame(match, layerMatch))
+    {
+        markLayerDirty(LAYER_GRID);
+        saveMatchState(match, layerMatch);
+    }
+
+    beginProfile(PROFILE_BACKGROUND);
+    if (beginLayer(LAYER_HUD))
+    {
+        drawSprite(ResourceManager::GetRegion("background"), 0, 0, glm::uvec2(0, 0), glm::uvec2(WIDTH, HEIGHT), 0.0f, glm::vec3(1.0f), 0.0f, PASS_BACKGROUND);
+        // Render next bubbles.
+        drawSprite(ResourceManager::GetRegion("bubbles"), 0, 0, NEXT_BUBBLE_POS,
+            glm::uvec2(GRID_SIZE, GRID_SIZE), 0.0f, BUBBLE_COLORS[match.nextColors[0]], 0);
+        drawSprite(ResourceManager::GetRegion("bubbles"), 0, 0, NEXT_BUBBLE_POS + glm::uvec2(0, GRID_SIZE),
+            glm::uvec2(GRID_SIZE, GRID_SIZE), 0.0f, BUBBLE_COLORS[match.nextColors[1]], 0);
+        text->RenderText("NEXT", NEXT_BUBBLE_LABEL_POS.x, NEXT_BUBBLE_LABEL_POS.y, SCALE, glm::vec3(1.0f, 0.0f, 0.0f));
+
+        // Render score.
+        std::ostringstream ss;
+        ss << "Score " << match.score;
+        text->RenderText(ss.str(), SCORE_POS.x, SCORE_POS.y, SCALE, glm::vec3(1.0f, 0.0f, 0.0f));
+        endLayer();
+    }
+    endProfile(PROFILE_BACKGROUND);
+    if (beginLayer(LAYER_GRID))
+    {
+        ProfileScope profile(PROFILE_GRID);
+        renderGrid(match);
+        endLayer();
+    }
+    beginProfile(PROFILE_PRESENT);
+    drawLayer(LAYER_GRID);
+    endProfile(PROFILE_PRESENT);
+}
+
 // Is called whenever a key is pressed/released via GLFW
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {	
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+    {
+        toggleProfiler();
+    }
+    else if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
+    {
+        writeProfileCsv(PROFILE_FILE);
+    }
+    else if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+    {
+        // Steps down through the render scales, then back to full size.
+        uint8_t next = 0;
+        for (uint8_t i = 0; i < NUM_RENDER_SCALES; i++)
+        {
+            if (getRenderScale() >= RENDER_SCALES[i])
+            {
+                next = (i + 1) % NUM_RENDER_SCALES;
+                break;
+            }
+        }
+        renderScale = RENDER_SCALES[next];
+        if (setRenderScale(renderScale))
+        {
+            renderSizeChanged();
+        }
+    }
+    else if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     {
-        if (state != GameState::MENU)
+        if (spectating)
+        {
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+        else if (state != GameState::MENU)
         {
             errorMessage.clear();
             state = GameState::DISCONNECT;
@@ -411,10 +1317,18 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
             switch (selectedMenuItem)
             {
             case MENU_START_SINGLE:
-                startGame();
+                botPlaying = false;
+                startGame(static_cast<uint32_t>(time(NULL)), matchMode);
+                break;
+            case MENU_WATCH_BOT:
+                botPlaying = true;
+                resetBot();
+                startGame(static_cast<uint32_t>(time(NULL)), matchMode);
                 break;
             case MENU_START_MULTI:
-                if (!createServer())
+                // The player controls their own pair online, whatever was picked before.
+                botPlaying = false;
+                if (!createServer(matchMode))
                 {                    
                     errorMessage.assign("Server creation failed.");
                     state = GameState::MENU;
@@ -425,6 +1339,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
                 }
                 break;
             case MENU_JOIN_MULTI:
+                botPlaying = false;
                 getServerText();
                 break;
             case MENU_HELP:
@@ -445,10 +1360,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
     {
         if (key == GLFW_KEY_BACKSPACE)
         {
-            if (server.length() > 0)
-            {
-                server.pop_back();
-            }
+            popUtf8(server);
         }
         else if (key == GLFW_KEY_ENTER && server.length() != 0)
         {
@@ -464,7 +1376,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
             }
         }
     }
-    else
+    else if (!botPlaying && !replaying)
     {
         // In game - so get keys for moving bubbles.
         bool pressed;
@@ -506,8 +1418,18 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 
 static void charCallback(GLFWwindow* window, unsigned int codepoint)
 {    
-    if (codepoint > 32 && codepoint < 123)
+    // Anything printable but space, in any script. The C1 control codes are the only unprintable ones glfw passes on.
+    if (codepoint > 32 && (codepoint < 0x7F || codepoint > 0x9F) && codepoint < 0x110000)
+    {
+        appendUtf8(server, codepoint);
+    }
+}
+
+// Is called whenever the window is resized, with the new size in pixels.
+static void framebufferSizeCallback(GLFWwindow* window, int width, int height)
+{
+    if (resizeRenderTarget(width, height))
     {
-        server.append(1, static_cast<uint8_t>(codepoint));
+        renderSizeChanged();
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,83 @@
+#ifndef MATCH_RULES_H
+#define MATCH_RULES_H
+
+#include <stdint.h>
+
+/* Rules that can change from one match to the next.
+ *
+ * Each mode is a policy struct of compile time constants: the size of its grid and the chain lengths. The match
+ * step in game_logic.cpp, the board simulation in board.cpp and the bot's evaluator are templates over the policy
+ * with one copy built for each mode, so the sizes and lengths they test against are constants. The mode is picked
+ * when a match starts and kept with the match (and the bot's boards), and it is only switched on once per step or
+ * move, to pick the copy to run.
+ *
+ * Grid storage is sized for the largest mode so a MatchState or Board is the same plain data whatever is played.
+ * Play space is always in GRID_SIZE cells; only the drawn layout (see transforms.h) changes with the grid.
+ */
+
+enum MatchMode
+{
+    MODE_CLASSIC,
+    MODE_THREE_MATCH,
+    MODE_WIDE,
+    NUM_MATCH_MODES
+};
+
+// Names for --mode on the command line.
+const char *const MATCH_MODE_NAMES[NUM_MATCH_MODES] = { "classic", "three", "wide" };
+
+struct ClassicRules
+{
+    // Size of the play field in grid space.
+    static const uint8_t COLUMNS = 6;
+    static const uint8_t ROWS = 10;
+    // Length of bubble chain needed to kill chain.
+    static const uint8_t CHAIN_DEATH_LENGTH = 4;
+    // Length of bubble chain needed to send to other player.
+    static const uint8_t CHAIN_MIN_SEND_LENGTH = 5;
+};
+
+// Chains of three die, and sending starts a bubble sooner to match.
+struct ThreeMatchRules
+{
+    static const uint8_t COLUMNS = 6;
+    static const uint8_t ROWS = 10;
+    static const uint8_t CHAIN_DEATH_LENGTH = 3;
+    static const uint8_t CHAIN_MIN_SEND_LENGTH = 4;
+};
+
+// Classic chains on a wider, deeper field, so matches run longer.
+struct WideRules
+{
+    static const uint8_t COLUMNS = 8;
+    static const uint8_t ROWS = 14;
+    static const uint8_t CHAIN_DEATH_LENGTH = 4;
+    static const uint8_t CHAIN_MIN_SEND_LENGTH = 5;
+};
+
+// Grid storage is this size, with each mode using the top left of it.
+const uint8_t MAX_GRID_COLUMNS = 8;
+const uint8_t MAX_GRID_ROWS = 14;
+// Grid positions are stored in a uint8_t as column * rows + row.
+const uint8_t MAX_GRID_CELLS = MAX_GRID_COLUMNS * MAX_GRID_ROWS;
+static_assert(MAX_GRID_COLUMNS * MAX_GRID_ROWS <= 255, "Grid positions are stored in a uint8_t");
+
+static_assert(ClassicRules::COLUMNS <= MAX_GRID_COLUMNS && ClassicRules::ROWS <= MAX_GRID_ROWS &&
+    ThreeMatchRules::COLUMNS <= MAX_GRID_COLUMNS && ThreeMatchRules::ROWS <= MAX_GRID_ROWS &&
+    WideRules::COLUMNS <= MAX_GRID_COLUMNS && WideRules::ROWS <= MAX_GRID_ROWS, "Every mode's grid fits the grid storage");
+
+// Grid size of each mode, for code that only needs the size at run time (drawing, replays, stats).
+struct GridShape
+{
+    uint8_t columns;
+    uint8_t rows;
+};
+
+const GridShape MODE_GRIDS[NUM_MATCH_MODES] =
+{
+    { ClassicRules::COLUMNS, ClassicRules::ROWS },
+    { ThreeMatchRules::COLUMNS, ThreeMatchRules::ROWS },
+    { WideRules::COLUMNS, WideRules::ROWS }
+};
+
+#endif
@@ -2,30 +2,103 @@
 #include "defs.h"
 #include "shader.h"
 #include "resource_manager.h"
+#include "shader_sources.h"
+#include "render_queue.h"
+
+// Sizes the effect can be drawn at, as a fraction of the screen, largest first.
+static const float EFFECT_SCALES[] = { 1.0f, 0.75f, 0.5f, 0.35f, 0.25f };
+static const uint8_t NUM_EFFECT_SCALES = sizeof(EFFECT_SCALES) / sizeof(EFFECT_SCALES[0]);
+// Timer queries in flight, so reading one back never waits for the GPU.
+static const uint8_t EFFECT_TIMERS = 4;
+// Weight of the newest GPU time in the running average.
+static const double EFFECT_TIME_SMOOTHING = 0.1;
+// Frames to wait after a change of size before judging the new one.
+static const uint16_t EFFECT_SETTLE_FRAMES = 30;
 
 // Render state
 static Shader shader;
 static GLuint VAO;
 static GLuint VBO;
 static GLuint EBO;
+// The effect at reduced size, in the bottom left corner of a texture the size of the screen.
+static GLuint FBO = 0;
+static GLuint texture = 0;
+static GLint textureWidth = 0;
+static GLint textureHeight = 0;
+// Controller state
+static GLuint timers[EFFECT_TIMERS];
+static bool timerStarted[EFFECT_TIMERS];
+static uint8_t nextTimer = 0;
+static double averageSeconds = 0.0;
+static uint8_t scaleIndex = 0;
+static uint16_t framesSinceChange = 0;
+static uint16_t framesOverBudget = 0;
+static bool frozen = false;
 
 // Initializes and configures the quad's buffer and vertex attributes
 static void initRenderData();
+static void resizeTarget(const GLint width, const GLint height);
+static void readTimers();
+static void chooseScale();
 
 void initEffectRenderer()
 {
-    shader = ResourceManager::LoadShader("../shaders/effect.vs", "../shaders/effect.frag", nullptr, "effect");
+    shader = ResourceManager::LoadShader(EFFECT_VERTEX_SOURCE, EFFECT_FRAGMENT_SOURCE, nullptr, "effect");
     initRenderData();
+    glGenQueries(EFFECT_TIMERS, timers);
+    for (uint8_t i = 0; i < EFFECT_TIMERS; i++)
+    {
+        timerStarted[i] = false;
+    }
+    nextTimer = 0;
+    averageSeconds = 0.0;
+    scaleIndex = 0;
+    framesSinceChange = 0;
+    framesOverBudget = 0;
+    frozen = false;
 }
 
 void drawMenuEffect(const double secondsSinceLastUpdate)
 {
     static GLfloat time = secondsSinceLastUpdate;    
-    shader.SetFloat("time", time, true);
-    
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    // The effect is drawn straight away, into its own framebuffer, so anything queued for the target goes first.
+    flushRenderQueue();
+    GLint target;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] != textureWidth || viewport[3] != textureHeight)
+    {
+        resizeTarget(viewport[2], viewport[3]);
+    }
+    const GLint width = static_cast<GLint>(textureWidth * EFFECT_SCALES[scaleIndex]);
+    const GLint height = static_cast<GLint>(textureHeight * EFFECT_SCALES[scaleIndex]);
+
+    if (!frozen)
+    {
+        readTimers();
+        chooseScale();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+        glBeginQuery(GL_TIME_ELAPSED, timers[nextTimer]);
+        useProgram(shader.ID);
+        shader.SetFloat("time", time);
+        bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        bindVertexArray(0);
+        glEndQuery(GL_TIME_ELAPSED);
+        timerStarted[nextTimer] = true;
+        nextTimer = (nextTimer + 1) % EFFECT_TIMERS;
+    }
+
+    // Scale up to the target.
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+        GL_COLOR_BUFFER_BIT, width == viewport[2] ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
     time += secondsSinceLastUpdate;
 }
 
@@ -33,6 +106,13 @@ void deleteEffectVertexArrays() {
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &EBO);
     glDeleteBuffers(1, &VBO);
+    glDeleteQueries(EFFECT_TIMERS, timers);
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &texture);
+    FBO = 0;
+    texture = 0;
+    textureWidth = 0;
+    textureHeight = 0;
 }
 
 void initRenderData()
@@ -62,4 +142,86 @@ void initRenderData()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     // Unbind VAO (NOT the EBO)
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
+
+// Makes the offscreen texture the size of the target. The effect is drawn again after this, even if frozen.
+static void resizeTarget(const GLint width, const GLint height)
+{
+    if (FBO == 0)
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenTextures(1, &texture);
+    }
+    textureWidth = width;
+    textureHeight = height;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    frozen = false;
+    framesOverBudget = 0;
+}
+
+// Adds the GPU times that have come back to the running average. Never waits for one.
+static void readTimers()
+{
+    for (uint8_t i = 0; i < EFFECT_TIMERS; i++)
+    {
+        if (!timerStarted[i])
+        {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(timers[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 nanoseconds;
+            glGetQueryObjectui64v(timers[i], GL_QUERY_RESULT, &nanoseconds);
+            const double seconds = nanoseconds * 1e-9;
+            averageSeconds = averageSeconds == 0.0 ? seconds : averageSeconds + (seconds - averageSeconds) * EFFECT_TIME_SMOOTHING;
+            timerStarted[i] = false;
+        }
+    }
+}
+
+/*
+ * Steps the size down when the average is over budget, and up when the next size up would fit going by
+ * pixel count. Each change waits for the average to catch up before the next.
+**/
+static void chooseScale()
+{
+    if (averageSeconds == 0.0 || ++framesSinceChange < EFFECT_SETTLE_FRAMES)
+    {
+        return;
+    }
+    if (averageSeconds > MENU_EFFECT_BUDGET_SECONDS)
+    {
+        if (scaleIndex + 1 < NUM_EFFECT_SCALES)
+        {
+            scaleIndex++;
+            framesSinceChange = 0;
+        }
+        else if (++framesOverBudget >= MENU_EFFECT_FREEZE_FRAMES)
+        {
+            // Keep showing the frame about to be drawn.
+            frozen = true;
+        }
+        return;
+    }
+    framesOverBudget = 0;
+    if (scaleIndex > 0)
+    {
+        const float growth = EFFECT_SCALES[scaleIndex - 1] / EFFECT_SCALES[scaleIndex];
+        if (averageSeconds * growth * growth < MENU_EFFECT_BUDGET_SECONDS * 0.8)
+        {
+            scaleIndex--;
+            framesSinceChange = 0;
+        }
+    }
+}
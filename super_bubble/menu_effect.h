@@ -1,6 +1,19 @@
 #ifndef MENU_EFFECT_H
 #define MENU_EFFECT_H
 
+#include <stdint.h>
+
+/* The menu background is drawn into an offscreen texture at a fraction of the screen size and scaled up.
+ * The fraction is picked each frame from how long the GPU took over the last few, to keep it within
+ * MENU_EFFECT_BUDGET_SECONDS. If even the smallest size is over budget the effect is frozen and the
+ * last frame is shown from then on.
+ */
+
+// GPU time the effect may take per frame.
+const double MENU_EFFECT_BUDGET_SECONDS = 0.004;
+// Over budget for this many frames in a row at the smallest size freezes the effect.
+const uint16_t MENU_EFFECT_FREEZE_FRAMES = 60;
+
 void initEffectRenderer();
 void drawMenuEffect(const double secondsSinceLastUpdate);
 void deleteEffectVertexArrays();
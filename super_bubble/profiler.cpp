@@ -0,0 +1,334 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "profiler.h"
+#include "render_text.h"
+
+static const char *TIMER_NAMES[NUM_PROFILE_TIMERS] = {
+    "poll events", "update", "draw", "swap",
+    "background", "grid", "falling", "text", "menu effect", "present", "render queue",
+    "menu", "help", "text entry", "server listen", "client connect", "disconnect",
+    "bubble spawn", "player control", "drop enemy", "scan victims", "animate deaths", "scan floaters", "gravity", "win", "game over"
+};
+// Marks a timer that didn't run in a frame.
+static const float NOT_TIMED = -1.0f;
+static const GLfloat OVERLAY_SCALE = SCALE * 0.4f;
+static const glm::vec3 OVERLAY_COLOR = glm::vec3(1.0f, 1.0f, 0.0f);
+
+// Timestamp queries for one frame's GPU passes, waiting to be read.
+struct GpuFrame
+{
+    // A start and an end query for each pass.
+    GLuint queries[PROFILE_MAX_GPU_PASSES * 2];
+    ProfileTimer timers[PROFILE_MAX_GPU_PASSES];
+    uint16_t numPasses;
+    uint32_t frame;
+};
+
+static bool enabled = false;
+static bool toggleRequested = false;
+static bool inFrame = false;
+// Set while drawing the overlay, so it doesn't time itself.
+static bool paused = false;
+// Frames profiled since enabled. The current one is stored at frames % PROFILE_HISTORY_FRAMES.
+static uint32_t frames = 0;
+static std::chrono::steady_clock::time_point started[NUM_PROFILE_TIMERS];
+static bool running[NUM_PROFILE_TIMERS];
+// Index in the current GpuFrame of each timer's open pass.
+static uint16_t openPass[NUM_PROFILE_TIMERS];
+static float cpuHistory[PROFILE_HISTORY_FRAMES][NUM_PROFILE_TIMERS];
+static float gpuHistory[PROFILE_HISTORY_FRAMES][NUM_PROFILE_TIMERS];
+static GpuFrame gpuFrames[PROFILE_GPU_LATENCY];
+static uint32_t gpuFramesDropped = 0;
+static std::vector<std::string> overlayLines;
+
+static bool hasGpu(const ProfileTimer timer);
+static void readGpuFrame(GpuFrame &gpuFrame);
+static bool timerStats(float (&history)[PROFILE_HISTORY_FRAMES][NUM_PROFILE_TIMERS], const ProfileTimer timer, float &min, float &average, float &p99);
+static void refreshOverlay();
+
+ProfileScope::ProfileScope(const ProfileTimer timerToUse) : timer(timerToUse)
+{
+    beginProfile(timer);
+}
+
+ProfileScope::~ProfileScope()
+{
+    endProfile(timer);
+}
+
+void initProfiler()
+{
+    for (uint8_t i = 0; i < PROFILE_GPU_LATENCY; i++)
+    {
+        glGenQueries(PROFILE_MAX_GPU_PASSES * 2, gpuFrames[i].queries);
+        gpuFrames[i].numPasses = 0;
+    }
+}
+
+void deleteProfiler()
+{
+    for (uint8_t i = 0; i < PROFILE_GPU_LATENCY; i++)
+    {
+        glDeleteQueries(PROFILE_MAX_GPU_PASSES * 2, gpuFrames[i].queries);
+    }
+}
+
+bool profilerEnabled()
+{
+    return enabled;
+}
+
+void toggleProfiler()
+{
+    // Keys are handled part way through a frame, so this waits for the next one.
+    toggleRequested = true;
+}
+
+void beginProfileFrame()
+{
+    if (toggleRequested)
+    {
+        toggleRequested = false;
+        enabled = !enabled;
+        frames = 0;
+        gpuFramesDropped = 0;
+        overlayLines.clear();
+        for (uint8_t i = 0; i < PROFILE_GPU_LATENCY; i++)
+        {
+            gpuFrames[i].numPasses = 0;
+        }
+    }
+    if (!enabled)
+    {
+        return;
+    }
+
+    inFrame = true;
+    const uint32_t row = frames % PROFILE_HISTORY_FRAMES;
+    for (uint8_t i = 0; i < NUM_PROFILE_TIMERS; i++)
+    {
+        cpuHistory[row][i] = NOT_TIMED;
+        gpuHistory[row][i] = NOT_TIMED;
+        running[i] = false;
+    }
+    GpuFrame &gpuFrame = gpuFrames[frames % PROFILE_GPU_LATENCY];
+    gpuFrame.numPasses = 0;
+    gpuFrame.frame = frames;
+}
+
+void endProfileFrame()
+{
+    if (!inFrame)
+    {
+        return;
+    }
+    inFrame = false;
+    frames++;
+    // The oldest frame's queries, about to be reused.
+    GpuFrame &oldest = gpuFrames[frames % PROFILE_GPU_LATENCY];
+    if (oldest.numPasses > 0)
+    {
+        readGpuFrame(oldest);
+        oldest.numPasses = 0;
+    }
+    if (frames % PROFILE_OVERLAY_REFRESH_FRAMES == 0)
+    {
+        refreshOverlay();
+    }
+}
+
+void beginProfile(const ProfileTimer timer)
+{
+    if (!inFrame || paused)
+    {
+        return;
+    }
+    running[timer] = true;
+    started[timer] = std::chrono::steady_clock::now();
+    GpuFrame &gpuFrame = gpuFrames[frames % PROFILE_GPU_LATENCY];
+    if (hasGpu(timer) && gpuFrame.numPasses < PROFILE_MAX_GPU_PASSES)
+    {
+        openPass[timer] = gpuFrame.numPasses;
+        gpuFrame.timers[gpuFrame.numPasses] = timer;
+        glQueryCounter(gpuFrame.queries[gpuFrame.numPasses * 2], GL_TIMESTAMP);
+        gpuFrame.numPasses++;
+    }
+    else
+    {
+        openPass[timer] = PROFILE_MAX_GPU_PASSES;
+    }
+}
+
+void endProfile(const ProfileTimer timer)
+{
+    if (!inFrame || paused || !running[timer])
+    {
+        return;
+    }
+    running[timer] = false;
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - started[timer]).count();
+    float &total = cpuHistory[frames % PROFILE_HISTORY_FRAMES][timer];
+    total = total == NOT_TIMED ? seconds : total + seconds;
+    if (openPass[timer] < PROFILE_MAX_GPU_PASSES)
+    {
+        glQueryCounter(gpuFrames[frames % PROFILE_GPU_LATENCY].queries[openPass[timer] * 2 + 1], GL_TIMESTAMP);
+    }
+}
+
+ProfileTimer stateProfileTimer(const GameState state)
+{
+    return static_cast<ProfileTimer>(PROFILE_STATE_FIRST + state);
+}
+
+void drawProfileOverlay(TextRenderer &text)
+{
+    if (!enabled)
+    {
+        return;
+    }
+    paused = true;
+    for (size_t i = 0; i < overlayLines.size(); i++)
+    {
+        text.RenderText(overlayLines[i], 10.0f, 10.0f + i * 24.0f * OVERLAY_SCALE, OVERLAY_SCALE, OVERLAY_COLOR);
+    }
+    paused = false;
+}
+
+bool writeProfileCsv(const char *fileName)
+{
+    std::ofstream file(fileName);
+    if (!file)
+    {
+        std::cout << "Failed to write " << fileName << std::endl;
+        return false;
+    }
+    file << "frame";
+    for (uint8_t i = 0; i < NUM_PROFILE_TIMERS; i++)
+    {
+        file << "," << TIMER_NAMES[i] << " cpu ms," << TIMER_NAMES[i] << " gpu ms";
+    }
+    file << "\n";
+    // The last PROFILE_GPU_LATENCY frames have no GPU times yet, so stop before them.
+    const uint32_t end = frames > PROFILE_GPU_LATENCY ? frames - PROFILE_GPU_LATENCY : 0;
+    const uint32_t start = frames > PROFILE_HISTORY_FRAMES ? frames - PROFILE_HISTORY_FRAMES : 0;
+    for (uint32_t frame = start; frame < end; frame++)
+    {
+        const uint32_t row = frame % PROFILE_HISTORY_FRAMES;
+        file << frame;
+        for (uint8_t i = 0; i < NUM_PROFILE_TIMERS; i++)
+        {
+            file << ",";
+            if (cpuHistory[row][i] != NOT_TIMED)
+            {
+                file << cpuHistory[row][i] * 1000.0f;
+            }
+            file << ",";
+            if (gpuHistory[row][i] != NOT_TIMED)
+            {
+                file << gpuHistory[row][i] * 1000.0f;
+            }
+        }
+        file << "\n";
+    }
+    std::cout << "Wrote " << end - start << " frames of profile to " << fileName << std::endl;
+    return true;
+}
+
+static bool hasGpu(const ProfileTimer timer)
+{
+    // Falling bubbles and text only queue their draws, so the GPU does their work under PROFILE_RENDER_QUEUE.
+    return timer >= PROFILE_BACKGROUND && timer <= PROFILE_RENDER_QUEUE && timer != PROFILE_FALLING && timer != PROFILE_TEXT;
+}
+
+// Adds up a frame's pass times, if the GPU has got to the end of them. Never waits.
+static void readGpuFrame(GpuFrame &gpuFrame)
+{
+    if (frames - gpuFrame.frame > PROFILE_HISTORY_FRAMES)
+    {
+        return;
+    }
+    // Passes can nest, so the last query issued isn't always the last to finish.
+    for (uint16_t i = 0; i < gpuFrame.numPasses; i++)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(gpuFrame.queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            gpuFramesDropped++;
+            return;
+        }
+    }
+    float (&row)[NUM_PROFILE_TIMERS] = gpuHistory[gpuFrame.frame % PROFILE_HISTORY_FRAMES];
+    for (uint16_t i = 0; i < gpuFrame.numPasses; i++)
+    {
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(gpuFrame.queries[i * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(gpuFrame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+        const float seconds = (end - begin) * 1e-9f;
+        float &total = row[gpuFrame.timers[i]];
+        total = total == NOT_TIMED ? seconds : total + seconds;
+    }
+}
+
+// Min, average and 99th percentile over the frames in the history that ran the timer. False if none did.
+static bool timerStats(float (&history)[PROFILE_HISTORY_FRAMES][NUM_PROFILE_TIMERS], const ProfileTimer timer, float &min, float &average, float &p99)
+{
+    std::vector<float> times;
+    const uint32_t numFrames = std::min<uint32_t>(frames, PROFILE_HISTORY_FRAMES);
+    for (uint32_t i = 0; i < numFrames; i++)
+    {
+        if (history[i][timer] != NOT_TIMED)
+        {
+            times.push_back(history[i][timer]);
+        }
+    }
+    if (times.empty())
+    {
+        return false;
+    }
+    std::sort(times.begin(), times.end());
+    float total = 0.0f;
+    for (float time : times)
+    {
+        total += time;
+    }
+    min = times.front();
+    average = total / times.size();
+    p99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+    return true;
+}
+
+static void refreshOverlay()
+{
+    overlayLines.clear();
+    overlayLines.push_back("ms               cpu min/avg/p99       gpu min/avg/p99");
+    for (uint8_t i = 0; i < NUM_PROFILE_TIMERS; i++)
+    {
+        const ProfileTimer timer = static_cast<ProfileTimer>(i);
+        float min, average, p99;
+        if (!timerStats(cpuHistory, timer, min, average, p99))
+        {
+            continue;
+        }
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << std::left << std::setw(16) << TIMER_NAMES[i] << " "
+            << min * 1000.0f << "/" << average * 1000.0f << "/" << p99 * 1000.0f;
+        if (timerStats(gpuHistory, timer, min, average, p99))
+        {
+            line << "   " << min * 1000.0f << "/" << average * 1000.0f << "/" << p99 * 1000.0f;
+        }
+        overlayLines.push_back(line.str());
+    }
+    if (gpuFramesDropped > 0)
+    {
+        std::ostringstream line;
+        line << gpuFramesDropped << " frames of GPU times not ready in time";
+        overlayLines.push_back(line.str());
+    }
+}
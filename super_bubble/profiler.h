@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "defs.h"
+
+class TextRenderer;
+
+/* Frame profiler.
+ *
+ * Timers measure CPU time, and the draw passes GPU time too, summed over each frame. GPU times come from
+ * pairs of timestamp queries that are read back PROFILE_GPU_LATENCY frames later, and a frame whose queries
+ * still aren't ready by then is skipped rather than waited for. The last PROFILE_HISTORY_FRAMES frames are
+ * kept for the overlay's min/avg/p99 and for writing to CSV. Nothing is measured while the overlay is hidden.
+ */
+
+enum ProfileTimer
+{
+    PROFILE_POLL_EVENTS,
+    PROFILE_UPDATE,
+    PROFILE_DRAW,
+    PROFILE_SWAP,
+    // Draw passes, also timed on the GPU apart from falling bubbles and text. Text is counted in the pass it is drawn in as well.
+    PROFILE_BACKGROUND,
+    PROFILE_GRID,
+    PROFILE_FALLING,
+    PROFILE_TEXT,
+    PROFILE_MENU_EFFECT,
+    // Full screen blits: cached layers onto the render target and the render target onto the window.
+    PROFILE_PRESENT,
+    // Sorting and issuing queued draws. The passes above record their draws, so their GPU time is counted here.
+    // Passes that flush the queue or draw directly before they end have GPU times of their own as well.
+    PROFILE_RENDER_QUEUE,
+    // The state machine part of update(), one timer for each state it can start in, MENU to GAME_OVER.
+    PROFILE_STATE_FIRST,
+    NUM_PROFILE_TIMERS = PROFILE_STATE_FIRST + GAME_OVER + 1
+};
+
+const uint16_t PROFILE_HISTORY_FRAMES = 300;
+// Frames between drawing a GPU pass and reading its time.
+const uint8_t PROFILE_GPU_LATENCY = 4;
+// Most GPU-timed passes in one frame. Any after this aren't timed on the GPU.
+const uint16_t PROFILE_MAX_GPU_PASSES = 128;
+// Frames between refreshes of the overlay figures.
+const uint16_t PROFILE_OVERLAY_REFRESH_FRAMES = 30;
+
+// Times a block of code.
+struct ProfileScope
+{
+    ProfileTimer timer;
+    ProfileScope(const ProfileTimer timerToUse);
+    ~ProfileScope();
+};
+
+void initProfiler();
+void deleteProfiler();
+bool profilerEnabled();
+// Shows or hides the overlay. Profiling runs while it is shown.
+void toggleProfiler();
+void beginProfileFrame();
+void endProfileFrame();
+void beginProfile(const ProfileTimer timer);
+void endProfile(const ProfileTimer timer);
+ProfileTimer stateProfileTimer(const GameState state);
+void drawProfileOverlay(TextRenderer &text);
+// One row per frame in the history, with a CPU and a GPU column in milliseconds for each timer.
+bool writeProfileCsv(const char *fileName);
+
+#endif
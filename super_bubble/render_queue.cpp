@@ -0,0 +1,244 @@
+#include <vector>
+#include <algorithm>
+#include "render_queue.h"
+#include "stream_buffer.h"
+#include "profiler.h"
+
+// Sort key layout, most significant first: pass 4 bits, program 12, texture 16, depth 16, sequence 16.
+static const uint8_t KEY_PASS_SHIFT = 60;
+static const uint8_t KEY_PROGRAM_SHIFT = 48;
+static const uint8_t KEY_TEXTURE_SHIFT = 32;
+static const uint8_t KEY_DEPTH_SHIFT = 16;
+static const uint64_t KEY_SEQUENCE_MASK = 0xFFFF;
+// Marks cached state that isn't known, so the next change is always made.
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+static std::vector<RenderCommand> commands;
+// Keys with the command's index in place of the low bits, sorted in place of the commands themselves.
+static std::vector<uint64_t> sortKeys;
+
+// State cache. Only right between a flush and the next change made outside the queue, so it is reset at each flush.
+static GLuint currentProgram = UNKNOWN;
+static GLuint currentTexture = UNKNOWN;
+static GLuint currentVertexArray = UNKNOWN;
+static GLuint currentBlend = UNKNOWN;
+// Last per-draw uniforms set on the current program.
+static bool uniformsKnown = false;
+static glm::vec3 currentColor;
+static GLfloat currentClipY;
+
+static RenderStats frameStats;
+static uint32_t renderFrame = 0;
+static RenderStats stats;
+
+static void resetStateCache();
+static void setUniforms(const RenderCommand &command);
+static bool canMerge(const RenderCommand &last, const RenderCommand &next);
+static void issue(const RenderCommand &command);
+
+uint64_t makeRenderKey(const RenderPass pass, const GLuint program, const GLuint texture, const uint16_t depth)
+{
+    return (static_cast<uint64_t>(pass) << KEY_PASS_SHIFT) |
+        (static_cast<uint64_t>(program & 0xFFF) << KEY_PROGRAM_SHIFT) |
+        (static_cast<uint64_t>(texture & 0xFFFF) << KEY_TEXTURE_SHIFT) |
+        (static_cast<uint64_t>(depth) << KEY_DEPTH_SHIFT);
+}
+
+RenderCommand makeRenderCommand(const RenderPass pass, const GLuint program, const GLuint texture, const GLuint vertexArray,
+    const GLenum mode, const GLint first, const GLsizei count)
+{
+    RenderCommand command;
+    command.key = makeRenderKey(pass, program, texture, 0);
+    command.program = program;
+    command.texture = texture;
+    command.vertexArray = vertexArray;
+    command.blend = true;
+    command.mode = mode;
+    command.first = first;
+    command.count = count;
+    command.instances = 0;
+    command.instanceFirst = 0;
+    command.instanceVec4s = 0;
+    command.colorLocation = -1;
+    command.color = glm::vec3(1.0f);
+    command.clipLocation = -1;
+    command.clipY = 0.0f;
+    return command;
+}
+
+void submitRenderCommand(const RenderCommand &command)
+{
+    if (commands.size() >= MAX_RENDER_COMMANDS)
+    {
+        // Everything already queued was recorded first, so drawing it now keeps the order right.
+        flushRenderQueue();
+    }
+    sortKeys.push_back((command.key & ~KEY_SEQUENCE_MASK) | commands.size());
+    commands.push_back(command);
+    frameStats.commands++;
+}
+
+void flushRenderQueue()
+{
+    resetStateCache();
+    if (commands.empty())
+    {
+        return;
+    }
+    ProfileScope profile(PROFILE_RENDER_QUEUE);
+    // Keys are unique thanks to the sequence number, so this keeps the recorded order among equal commands.
+    std::sort(sortKeys.begin(), sortKeys.end());
+    glActiveTexture(GL_TEXTURE0);
+
+    RenderCommand pending = commands[sortKeys[0] & KEY_SEQUENCE_MASK];
+    for (size_t i = 1; i < sortKeys.size(); i++)
+    {
+        const RenderCommand &next = commands[sortKeys[i] & KEY_SEQUENCE_MASK];
+        if (canMerge(pending, next))
+        {
+            pending.count += next.count;
+        }
+        else
+        {
+            issue(pending);
+            pending = next;
+        }
+    }
+    issue(pending);
+    // Leave no vertex array bound for code outside the queue to change by mistake.
+    bindVertexArray(0);
+
+    commands.clear();
+    sortKeys.clear();
+}
+
+void useProgram(const GLuint program)
+{
+    if (program != currentProgram)
+    {
+        glUseProgram(program);
+        currentProgram = program;
+        uniformsKnown = false;
+        frameStats.programChanges++;
+    }
+}
+
+void bindTexture(const GLuint texture)
+{
+    if (texture != currentTexture)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        currentTexture = texture;
+        frameStats.textureChanges++;
+    }
+}
+
+void bindVertexArray(const GLuint vertexArray)
+{
+    if (vertexArray != currentVertexArray)
+    {
+        glBindVertexArray(vertexArray);
+        currentVertexArray = vertexArray;
+        frameStats.vertexArrayChanges++;
+    }
+}
+
+void setBlend(const bool blend)
+{
+    const GLuint value = blend ? 1 : 0;
+    if (value != currentBlend)
+    {
+        if (blend)
+        {
+            glEnable(GL_BLEND);
+        }
+        else
+        {
+            glDisable(GL_BLEND);
+        }
+        currentBlend = value;
+        frameStats.blendChanges++;
+    }
+}
+
+void endRenderFrame()
+{
+    stats = frameStats;
+    frameStats = RenderStats();
+    renderFrame++;
+}
+
+const RenderStats& getRenderStats()
+{
+    return stats;
+}
+
+uint32_t getRenderFrame()
+{
+    return renderFrame;
+}
+
+static void resetStateCache()
+{
+    currentProgram = UNKNOWN;
+    currentTexture = UNKNOWN;
+    currentVertexArray = UNKNOWN;
+    currentBlend = UNKNOWN;
+    uniformsKnown = false;
+}
+
+static void setUniforms(const RenderCommand &command)
+{
+    const bool colorChanged = command.colorLocation >= 0 && (!uniformsKnown || command.color != currentColor);
+    const bool clipChanged = command.clipLocation >= 0 && (!uniformsKnown || command.clipY != currentClipY);
+    if (colorChanged)
+    {
+        glUniform3f(command.colorLocation, command.color.r, command.color.g, command.color.b);
+        frameStats.uniformChanges++;
+    }
+    if (clipChanged)
+    {
+        glUniform1f(command.clipLocation, command.clipY);
+        frameStats.uniformChanges++;
+    }
+    currentColor = command.color;
+    currentClipY = command.clipY;
+    uniformsKnown = true;
+}
+
+// True if next can be drawn as part of last: the same state throughout, and vertices straight after last's.
+static bool canMerge(const RenderCommand &last, const RenderCommand &next)
+{
+    return last.instances == 0 && next.instances == 0 &&
+        last.program == next.program && last.texture == next.texture && last.vertexArray == next.vertexArray &&
+        last.blend == next.blend && last.mode == next.mode && last.first + last.count == next.first &&
+        last.colorLocation == next.colorLocation && (last.colorLocation < 0 || last.color == next.color) &&
+        last.clipLocation == next.clipLocation && (last.clipLocation < 0 || last.clipY == next.clipY);
+}
+
+static void issue(const RenderCommand &command)
+{
+    useProgram(command.program);
+    bindTexture(command.texture);
+    bindVertexArray(command.vertexArray);
+    setBlend(command.blend);
+    setUniforms(command);
+    if (command.instances == 0)
+    {
+        glDrawArrays(command.mode, command.first, command.count);
+    }
+    else
+    {
+        // GL 3.3 has no base instance, so the instance attributes are pointed at this command's data instead.
+        const GLsizei stride = command.instanceVec4s * STREAM_VERTEX_SIZE;
+        const uintptr_t base = static_cast<uintptr_t>(command.instanceFirst) * STREAM_VERTEX_SIZE;
+        glBindBuffer(GL_ARRAY_BUFFER, getStreamBuffer());
+        for (uint8_t i = 0; i < command.instanceVec4s; i++)
+        {
+            glVertexAttribPointer(i + 1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid*>(base + i * STREAM_VERTEX_SIZE));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDrawArraysInstanced(command.mode, command.first, command.count, command.instances);
+    }
+    frameStats.drawCalls++;
+}
@@ -0,0 +1,90 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "defs.h"
+
+/* Render queue.
+ *
+ * Sprites, text and bubble batches are recorded as RenderCommands rather than drawn straight away. Their
+ * vertices are written to the stream buffer when they are recorded, so a command only holds the state it needs
+ * and the range to draw. flushRenderQueue sorts the commands by key (pass, then program, texture and depth) and
+ * issues them through a state cache, which skips any program, texture, vertex array, blend or uniform change
+ * that is already in place. Neighbouring commands with the same state and contiguous vertices become one draw.
+ *
+ * Commands with equal keys keep the order they were recorded in. Anything that has to cover something in the
+ * same pass drawn with another program or texture needs a greater depth, or a later pass.
+ *
+ * The queue has to be flushed before the draw framebuffer changes and before anything draws to it without
+ * going through the queue. The layers, the render target, the menu effect and frame export all flush.
+ */
+
+enum RenderPass
+{
+    // Full screen images, under everything else.
+    PASS_BACKGROUND,
+    PASS_SPRITES,
+    PASS_TEXT,
+    NUM_RENDER_PASSES
+};
+
+// Commands held before the queue flushes itself. Sequence numbers in the key have 16 bits.
+const uint16_t MAX_RENDER_COMMANDS = 8192;
+
+struct RenderCommand
+{
+    // From makeRenderKey.
+    uint64_t key;
+    GLuint program;
+    // Bound to texture unit 0.
+    GLuint texture;
+    GLuint vertexArray;
+    bool blend;
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+    /*
+     * For an instanced draw, the number of instances, the stream buffer vertex their data starts at and the
+     * number of vec4 attributes each has, from location 1 on. Plain draws have no instances.
+    **/
+    GLsizei instances;
+    GLint instanceFirst;
+    uint8_t instanceVec4s;
+    // Uniforms set for each draw. A location of -1 for a program that doesn't have them.
+    GLint colorLocation;
+    glm::vec3 color;
+    GLint clipLocation;
+    GLfloat clipY;
+};
+
+// What the queue did over the last whole frame.
+struct RenderStats
+{
+    uint32_t commands;
+    uint32_t drawCalls;
+    uint32_t programChanges;
+    uint32_t textureChanges;
+    uint32_t vertexArrayChanges;
+    uint32_t blendChanges;
+    uint32_t uniformChanges;
+};
+
+// Programs and textures are only in the key to group commands, so their names are cut down to fit.
+uint64_t makeRenderKey(const RenderPass pass, const GLuint program, const GLuint texture, const uint16_t depth);
+// A plain draw with no per-draw uniforms, for the caller to fill in the rest of.
+RenderCommand makeRenderCommand(const RenderPass pass, const GLuint program, const GLuint texture, const GLuint vertexArray,
+    const GLenum mode, const GLint first, const GLsizei count);
+void submitRenderCommand(const RenderCommand &command);
+// Sorts and draws every command submitted since the last flush, and empties the queue.
+void flushRenderQueue();
+// For drawing outside the queue straight after a flush. They go through the same cache as the queue's draws.
+void useProgram(const GLuint program);
+void bindTexture(const GLuint texture);
+void bindVertexArray(const GLuint vertexArray);
+void setBlend(const bool blend);
+// Call once per frame, after the last flush.
+void endRenderFrame();
+const RenderStats& getRenderStats();
+// Counts up at each endRenderFrame. Draws queued in the current frame may not have been made yet.
+uint32_t getRenderFrame();
+
+#endif
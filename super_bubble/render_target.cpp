@@ -0,0 +1,136 @@
+#include <algorithm>
+#include "render_target.h"
+#include "render_queue.h"
+
+static GLuint FBO = 0;
+static GLuint texture = 0;
+static float renderScale = 1.0f;
+static int windowWidth = WIDTH;
+static int windowHeight = HEIGHT;
+// Where the game is shown in the window, with bars either side or above and below it.
+static GLint shownX = 0, shownY = 0;
+static GLuint shownWidth = WIDTH, shownHeight = HEIGHT;
+static GLuint renderWidth = WIDTH, renderHeight = HEIGHT;
+// True when the target is the window itself.
+static bool direct = true;
+// Size the texture was last made at.
+static GLuint textureWidth = 0, textureHeight = 0;
+
+static bool updateSize();
+
+void initRenderTarget(const int width, const int height, const float scale)
+{
+    glGenFramebuffers(1, &FBO);
+    glGenTextures(1, &texture);
+    windowWidth = width;
+    windowHeight = height;
+    renderScale = scale;
+    renderWidth = 0;
+    textureWidth = 0;
+    updateSize();
+}
+
+void deleteRenderTarget()
+{
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &texture);
+    FBO = 0;
+    texture = 0;
+    textureWidth = 0;
+    textureHeight = 0;
+}
+
+bool resizeRenderTarget(const int width, const int height)
+{
+    windowWidth = width;
+    windowHeight = height;
+    return updateSize();
+}
+
+bool setRenderScale(const float scale)
+{
+    renderScale = scale;
+    return updateSize();
+}
+
+float getRenderScale()
+{
+    return renderScale;
+}
+
+GLuint getRenderWidth()
+{
+    return renderWidth;
+}
+
+GLuint getRenderHeight()
+{
+    return renderHeight;
+}
+
+void beginRenderTarget()
+{
+    if (direct)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    }
+    glViewport(0, 0, renderWidth, renderHeight);
+}
+
+void presentRenderTarget()
+{
+    flushRenderQueue();
+    if (direct)
+    {
+        return;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+    // Only the bars need it, but a whole clear is cheaper than several small ones.
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBlitFramebuffer(0, 0, renderWidth, renderHeight, shownX, shownY, shownX + shownWidth, shownY + shownHeight,
+        GL_COLOR_BUFFER_BIT, renderWidth == shownWidth ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Fits the game into the window and sizes the target to match. Returns true if the target size changed.
+static bool updateSize()
+{
+    // A minimised window has no size, so keep at least a pixel to draw to.
+    const GLuint width = std::max(windowWidth, 1);
+    const GLuint height = std::max(windowHeight, 1);
+    shownWidth = std::max<GLuint>(std::min<GLuint>(width, height * WIDTH / HEIGHT), 1);
+    shownHeight = std::max<GLuint>(std::min<GLuint>(height, width * HEIGHT / WIDTH), 1);
+    shownX = (width - shownWidth) / 2;
+    shownY = (height - shownHeight) / 2;
+
+    const GLuint newWidth = std::max<GLuint>(static_cast<GLuint>(shownWidth * renderScale + 0.5f), 1);
+    const GLuint newHeight = std::max<GLuint>(static_cast<GLuint>(shownHeight * renderScale + 0.5f), 1);
+    direct = newWidth == width && newHeight == height;
+    if (!direct && (newWidth != textureWidth || newHeight != textureHeight))
+    {
+        textureWidth = newWidth;
+        textureHeight = newHeight;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, textureWidth, textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    if (newWidth == renderWidth && newHeight == renderHeight)
+    {
+        return false;
+    }
+    renderWidth = newWidth;
+    renderHeight = newHeight;
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include "defs.h"
+
+/* The game is laid out in window space, WIDTH x HEIGHT, whatever size it is drawn at. Each frame is drawn
+ * into an offscreen target at a fraction of the size it is shown at, then scaled up to the window with linear
+ * filtering. The window can be any shape: the game keeps its 4:3 aspect ratio and is centred, with black bars
+ * filling the rest. When the target would be exactly the window, frames are drawn straight to the window.
+ */
+
+// The render scales the scale key steps through, largest first.
+const float RENDER_SCALES[] = { 1.0f, 0.75f, 0.5f };
+const uint8_t NUM_RENDER_SCALES = 3;
+
+// Call with a current context. The sizes are in pixels of the window's framebuffer.
+void initRenderTarget(const int windowWidth, const int windowHeight, const float scale);
+void deleteRenderTarget();
+// Both return true if the size drawn at has changed, so anything made at that size has to be made again.
+bool resizeRenderTarget(const int windowWidth, const int windowHeight);
+bool setRenderScale(const float scale);
+float getRenderScale();
+// Size of the target drawn to, in pixels.
+GLuint getRenderWidth();
+GLuint getRenderHeight();
+// Binds the target and sets the viewport to it.
+void beginRenderTarget();
+// Draws what is left in the render queue, then scales the frame up to the window and leaves the window bound.
+void presentRenderTarget();
+
+#endif
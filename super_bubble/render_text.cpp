@@ -7,6 +7,9 @@
 ** option) any later version.
 ******************************************************************/
 #include <iostream>
+#include <vector>
+#include <string>
+#include <string.h>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <ft2build.h>
@@ -14,30 +17,41 @@
 
 #include "render_text.h"
 #include "resource_manager.h"
+#include "shader_sources.h"
+#include "stream_buffer.h"
+#include "render_queue.h"
+#include "profiler.h"
 
 
 TextRenderer::TextRenderer(GLuint width, GLuint height)
 {
     // Load and configure shader
-    this->TextShader = ResourceManager::LoadShader("../shaders/text.vs", "../shaders/text.frag", nullptr, "text");
+    this->TextShader = ResourceManager::LoadShader(TEXT_VERTEX_SOURCE, TEXT_FRAGMENT_SOURCE, nullptr, "text");
     this->TextShader.SetMatrix4("projection", glm::ortho(0.0f, static_cast<GLfloat>(width), static_cast<GLfloat>(height), 0.0f), GL_TRUE);
     this->TextShader.SetInteger("text", 0);
-    // Configure VAO/VBO for texture quads
+    this->ColorLocation = glGetUniformLocation(this->TextShader.ID, "textColor");
+    // Configure VAO for texture quads, which are written to the stream buffer
     glGenVertexArrays(1, &this->VAO);
-    glGenBuffers(1, &this->VBO);
     glBindVertexArray(this->VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, getStreamBuffer());
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, STREAM_VERTEX_SIZE, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    this->Glyphs.loaded = false;
+}
+
+TextRenderer::~TextRenderer()
+{
+    deleteGlyphCache(this->Glyphs);
 }
 
 void TextRenderer::Load(std::string font, GLuint fontSize)
 {
     // First clear the previously loaded Characters
     this->Characters.clear();
+    deleteGlyphCache(this->Glyphs);
+    initGlyphCache(this->Glyphs, font, fontSize);
     // Then initialize and load the FreeType library
     FT_Library ft;    
     if (FT_Init_FreeType(&ft)) // All functions return a value different than 0 whenever an error occurred
@@ -48,8 +62,7 @@ void TextRenderer::Load(std::string font, GLuint fontSize)
         std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
     // Set size to load glyphs as
     FT_Set_Pixel_Sizes(face, 0, fontSize);
-    // Disable byte-alignment restriction
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); 
+    this->GlyphPrefix = font + "/" + std::to_string(fontSize) + "/";
     // Then for the first 128 ASCII characters, pre-load/compile their characters and store them
     for (GLubyte c = 0; c < 128; c++) // lol see what I did there 
     {
@@ -59,83 +72,227 @@ void TextRenderer::Load(std::string font, GLuint fontSize)
             std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
             continue;
         }
-        // Generate texture
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-            );
-        // Set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-       
+        // Queue the glyph for the atlas, as white with the coverage in alpha
+        const GLuint width = face->glyph->bitmap.width;
+        const GLuint rows = face->glyph->bitmap.rows;
+        if (width > 0 && rows > 0)
+        {
+            std::vector<unsigned char> pixels(width * rows * 4, 255);
+            for (GLuint y = 0; y < rows; y++)
+            {
+                for (GLuint x = 0; x < width; x++)
+                {
+                    pixels[(y * width + x) * 4 + 3] = face->glyph->bitmap.buffer[y * face->glyph->bitmap.pitch + x];
+                }
+            }
+            ResourceManager::QueueAtlasPixels(this->GlyphPrefix + std::to_string(c), width, rows, pixels.data());
+        }
+
         // Now store character for later use
         Character character = {
-            texture,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
+            0,
+            glm::vec2(0.0f),
+            glm::vec2(0.0f),
+            glm::ivec2(width, rows),
             glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
             face->glyph->advance.x
         };
         Characters.insert(std::pair<GLchar, Character>(c, character));
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
     // Destroy FreeType once we're finished
     FT_Done_Face(face);
     FT_Done_FreeType(ft);
 }
 
+void TextRenderer::FindGlyphs()
+{
+    for (auto &iter : this->Characters)
+    {
+        Character &ch = iter.second;
+        if (ch.Size.x > 0 && ch.Size.y > 0)
+        {
+            AtlasRegion region = ResourceManager::GetRegion(this->GlyphPrefix + std::to_string(static_cast<GLubyte>(iter.first)));
+            ch.TextureID = region.Texture.ID;
+            ch.UVOrigin = region.Origin;
+            ch.UVSize = region.Size;
+        }
+    }
+}
+
 void TextRenderer::RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
 {
-    // Activate corresponding render state	
-    this->TextShader.Use();
-    this->TextShader.SetVector3f("textColor", color);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(this->VAO);
+    this->QueueText(text, x, y, scale);
+    this->FlushText(color);
+}
 
-    // Iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++)
+void TextRenderer::QueueText(std::string text, GLfloat x, GLfloat y, GLfloat scale)
+{
+    size_t index = 0;
+    while (index < text.length())
     {
-        Character ch = Characters[*c];
+        const uint32_t codepoint = decodeUtf8(text, index);
+        Character ch;
+        if (codepoint < 128)
+        {
+            ch = this->Characters[static_cast<GLchar>(codepoint)];
+        }
+        else if (!findGlyph(this->Glyphs, codepoint, ch))
+        {
+            // No room left in the glyph cache this frame, or no glyph in the font
+            ch = this->Characters['?'];
+        }
 
         GLfloat xpos = x + ch.Bearing.x * scale;
         GLfloat ypos = y + (this->Characters['H'].Bearing.y - ch.Bearing.y) * scale;
 
         GLfloat w = ch.Size.x * scale;
         GLfloat h = ch.Size.y * scale;
-        // Update VBO for each character
-        GLfloat vertices[6][4] = {
-            { xpos,     ypos + h,   0.0, 1.0 },
-            { xpos + w, ypos,       1.0, 0.0 },
-            { xpos,     ypos,       0.0, 0.0 },
-
-            { xpos,     ypos + h,   0.0, 1.0 },
-            { xpos + w, ypos + h,   1.0, 1.0 },
-            { xpos + w, ypos,       1.0, 0.0 }
+        GLfloat u0 = ch.UVOrigin.x, v0 = ch.UVOrigin.y;
+        GLfloat u1 = u0 + ch.UVSize.x, v1 = v0 + ch.UVSize.y;
+        GLfloat quad[6][4] = {
+            { xpos,     ypos + h,   u0, v1 },
+            { xpos + w, ypos,       u1, v0 },
+            { xpos,     ypos,       u0, v0 },
+
+            { xpos,     ypos + h,   u0, v1 },
+            { xpos + w, ypos + h,   u1, v1 },
+            { xpos + w, ypos,       u1, v0 }
         };
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // Be sure to use glBufferSubData and not glBufferData
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // Render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        this->BatchVertices.insert(this->BatchVertices.end(), &quad[0][0], &quad[0][0] + 6 * 4);
+        this->BatchTextures.push_back(ch.TextureID);
         // Now advance cursors for next glyph
         x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (1/64th times 2^6 = 64)
     }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
\ No newline at end of file
+}
+
+void TextRenderer::FlushText(glm::vec3 color)
+{
+    if (this->BatchTextures.empty())
+        return;
+    ProfileScope profile(PROFILE_TEXT);
+    // Copy the quads for every queued glyph into the stream buffer
+    const GLint glyphs = static_cast<GLint>(this->BatchTextures.size());
+    GLint first;
+    GLfloat *vertices = allocateStreamVertices(glyphs * 6, first);
+    memcpy(vertices, this->BatchVertices.data(), this->BatchVertices.size() * sizeof(GLfloat));
+    finishStreamVertices();
+
+    // Queue the batch, one draw for each run of glyphs in the same atlas. Empty glyphs (spaces) go with any run.
+    GLuint runTexture = 0;
+    GLint runStart = 0;
+    for (GLint glyph = 0; glyph < glyphs; glyph++)
+    {
+        GLuint texture = this->BatchTextures[glyph];
+        if (texture != 0 && texture != runTexture)
+        {
+            if (runTexture != 0)
+            {
+                this->queueRun(runTexture, first + runStart * 6, (glyph - runStart) * 6, color);
+                runStart = glyph;
+            }
+            runTexture = texture;
+        }
+    }
+    if (runTexture != 0)
+    {
+        this->queueRun(runTexture, first + runStart * 6, (glyphs - runStart) * 6, color);
+    }
+    this->BatchVertices.clear();
+    this->BatchTextures.clear();
+}
+
+void TextRenderer::queueRun(GLuint texture, GLint first, GLsizei count, glm::vec3 color)
+{
+    RenderCommand command = makeRenderCommand(PASS_TEXT, this->TextShader.ID, texture, this->VAO, GL_TRIANGLES, first, count);
+    command.colorLocation = this->ColorLocation;
+    command.color = color;
+    submitRenderCommand(command);
+}
+
+uint32_t decodeUtf8(const std::string &text, size_t &index)
+{
+    const uint8_t lead = static_cast<uint8_t>(text[index++]);
+    if (lead < 0x80)
+    {
+        return lead;
+    }
+    uint8_t length;
+    uint32_t codepoint;
+    // The least each length can encode, as anything less is an overlong form.
+    uint32_t minimum;
+    if ((lead & 0xE0) == 0xC0)
+    {
+        length = 2;
+        codepoint = lead & 0x1F;
+        minimum = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        length = 3;
+        codepoint = lead & 0x0F;
+        minimum = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        length = 4;
+        codepoint = lead & 0x07;
+        minimum = 0x10000;
+    }
+    else
+    {
+        return REPLACEMENT_CHARACTER;
+    }
+    for (uint8_t i = 1; i < length; i++)
+    {
+        // A truncated sequence only takes the bytes that belong to it.
+        if (index >= text.length() || (static_cast<uint8_t>(text[index]) & 0xC0) != 0x80)
+        {
+            return REPLACEMENT_CHARACTER;
+        }
+        codepoint = (codepoint << 6) | (static_cast<uint8_t>(text[index++]) & 0x3F);
+    }
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+    {
+        return REPLACEMENT_CHARACTER;
+    }
+    return codepoint;
+}
+
+void appendUtf8(std::string &text, const uint32_t codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        text.append(1, static_cast<char>(codepoint));
+    }
+    else if (codepoint < 0x800)
+    {
+        text.append(1, static_cast<char>(0xC0 | (codepoint >> 6)));
+        text.append(1, static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+    else if (codepoint < 0x10000)
+    {
+        text.append(1, static_cast<char>(0xE0 | (codepoint >> 12)));
+        text.append(1, static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        text.append(1, static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+    else
+    {
+        text.append(1, static_cast<char>(0xF0 | (codepoint >> 18)));
+        text.append(1, static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        text.append(1, static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        text.append(1, static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+void popUtf8(std::string &text)
+{
+    // Continuation bytes go, then the byte that leads them.
+    while (!text.empty() && (static_cast<uint8_t>(text.back()) & 0xC0) == 0x80)
+    {
+        text.pop_back();
+    }
+    if (!text.empty())
+    {
+        text.pop_back();
+    }
+}
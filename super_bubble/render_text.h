@@ -10,42 +10,63 @@
 #define TEXT_RENDERER_H
 
 #include <map>
+#include <string>
+#include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include "texture.h"
 #include "shader.h"
+#include "glyph_cache.h"
 
 
-/// Holds all state information relevant to a character as loaded using FreeType
-struct Character {
-    GLuint TextureID;   // ID handle of the glyph texture
-    glm::ivec2 Size;    // Size of glyph
-    glm::ivec2 Bearing; // Offset from baseline to left/top of glyph
-    GLuint Advance;     // Horizontal offset to advance to next glyph
-};
 
+// Replaces each malformed sequence in UTF-8 text, when decoding it, with this.
+const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+// Decodes the code point starting at index, and moves index past it.
+uint32_t decodeUtf8(const std::string &text, size_t &index);
+void appendUtf8(std::string &text, const uint32_t codepoint);
+// Removes the last code point, however many bytes it takes.
+void popUtf8(std::string &text);
 
 // A renderer class for rendering text displayed by a font loaded using the 
 // FreeType library. A single font is loaded, processed into a list of Character
-// items for later rendering.
+// items for later rendering. ASCII is loaded up front, anything else on first use.
 class TextRenderer
 {
 public:
     // Holds a list of pre-compiled Characters
     std::map<GLchar, Character> Characters; 
+    // Every other code point, rasterised when first drawn
+    GlyphCache Glyphs;
     // Shader used for text rendering
     Shader TextShader;
     // Constructor
     TextRenderer(GLuint width, GLuint height);
-    // Pre-compiles a list of characters from the given font
+    ~TextRenderer();
+    // Pre-compiles a list of characters from the given font and queues their glyphs for the texture atlas
     void Load(std::string font, GLuint fontSize);
-    // Renders a string of text using the precompiled list of characters
+    // Looks up where the glyphs were packed. Call after ResourceManager::BuildAtlases
+    void FindGlyphs();
+    // Renders a string of UTF-8 text
     void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color = glm::vec3(1.0f));
+    // Adds a string to the batch, to be drawn with every other queued string by FlushText
+    void QueueText(std::string text, GLfloat x, GLfloat y, GLfloat scale);
+    // Queues the batched strings in one colour, with a draw for each atlas texture they use, and empties the batch
+    void FlushText(glm::vec3 color = glm::vec3(1.0f));
 private:
     // Render state
-    GLuint VAO, VBO;
+    GLuint VAO;
+    GLint ColorLocation;
+    // Queued glyph quads, 6 vertices each, and the atlas texture of each glyph (0 for glyphs with nothing to draw)
+    std::vector<GLfloat> BatchVertices;
+    std::vector<GLuint> BatchTextures;
+    // Queues a draw of glyphs already in the stream buffer
+    void queueRun(GLuint texture, GLint first, GLsizei count, glm::vec3 color);
+    // Atlas names of the glyphs are this followed by the character code
+    std::string GlyphPrefix;
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include <iostream>
+#include <string.h>
+#include <time.h>
+#include "replay.h"
+
+// Longest record: tag, 5 byte tick delta, 5 byte score, result.
+static const uint8_t MAX_RECORD_SIZE = 12;
+
+static FILE *recordFile = nullptr;
+static uint32_t recordTick = 0;
+static uint8_t recordedControls = 0;
+
+static void writeRecord(const ReplayEventType type, const uint8_t tagBits, const uint32_t tick, const uint8_t *payload, const uint8_t payloadSize);
+static uint8_t putVarint(uint8_t *out, uint32_t value);
+static bool readByte(ReplayReader &reader, uint8_t &value);
+static bool readVarint(ReplayReader &reader, uint32_t &value);
+static bool readHeader(ReplayReader &reader, ReplayHeader &header);
+static bool seekFile(FILE *file, const uint64_t offset);
+static uint64_t tellFile(FILE *file);
+static uint8_t packControls(const Controls &controls);
+static void unpackControls(const uint8_t bits, Controls &controls);
+template<typename Rules> static void getModeRules(ReplayRules &rules);
+
+void getReplayRules(const MatchMode mode, ReplayRules &rules)
+{
+    memset(&rules, 0, sizeof(rules));
+    switch (mode)
+    {
+    case MODE_THREE_MATCH:
+        getModeRules<ThreeMatchRules>(rules);
+        break;
+    case MODE_WIDE:
+        getModeRules<WideRules>(rules);
+        break;
+    default:
+        getModeRules<ClassicRules>(rules);
+        break;
+    }
+    rules.bounceHeight = BOUNCE_HEIGHT;
+    rules.fastFallAmount = FAST_FALL_AMOUNT;
+    rules.bubbleFrames = BUBBLE_FRAMES;
+    rules.maxSpawnColor = MAX_SPAWN_COLOR;
+    rules.gridSize = GRID_SIZE;
+    rules.targetFps = static_cast<uint16_t>(TARGET_FPS);
+    rules.bubbleFrameTicks = BUBBLE_FRAME_TICKS;
+}
+
+bool findReplayMode(const ReplayRules &rules, MatchMode &mode)
+{
+    for (uint8_t i = 0; i < NUM_MATCH_MODES; i++)
+    {
+        ReplayRules modeRules;
+        getReplayRules(static_cast<MatchMode>(i), modeRules);
+        if (memcmp(&modeRules, &rules, sizeof(rules)) == 0)
+        {
+            mode = static_cast<MatchMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+ReplayResult getReplayResult(const GameState state)
+{
+    if (state == GameState::GAME_OVER)
+    {
+        return REPLAY_LOST;
+    }
+    else if (state == GameState::WIN)
+    {
+        return REPLAY_WON;
+    }
+    return REPLAY_ABANDONED;
+}
+
+bool startRecording(const char *fileName, const uint32_t seed, const MatchMode mode, const uint8_t flags)
+{
+    if (recordFile != nullptr)
+    {
+        stopRecording(recordTick, 0, REPLAY_ABANDONED);
+    }
+
+    recordFile = fopen(fileName, "ab");
+    if (recordFile == nullptr)
+    {
+        std::cout << "Failed to open replay file " << fileName << std::endl;
+        return false;
+    }
+
+    ReplayHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.flags = flags;
+    header.seed = seed;
+    header.startTime = static_cast<uint32_t>(time(NULL));
+    getReplayRules(mode, header.rules);
+
+    fputc(REPLAY_MATCH_TAG, recordFile);
+    fwrite(&header, sizeof(header), 1, recordFile);
+    recordTick = 0;
+    recordedControls = 0;
+    return true;
+}
+
+void recordControls(const uint32_t tick, const Controls &controls)
+{
+    const uint8_t bits = packControls(controls);
+    if (recordFile == nullptr || bits == recordedControls)
+    {
+        return;
+    }
+    recordedControls = bits;
+    writeRecord(REPLAY_CONTROLS, bits, tick, nullptr, 0);
+}
+
+void recordControlsUsed(const Controls &controls)
+{
+    recordedControls = packControls(controls);
+}
+
+void recordNetMessage(const uint32_t tick, const NetMessage &message)
+{
+    if (recordFile == nullptr)
+    {
+        return;
+    }
+    if (message.type == NetMessageType::NUM_BUBBLES)
+    {
+        writeRecord(REPLAY_NUM_BUBBLES, 0, tick, &message.numBubbles, 1);
+    }
+    else if (message.type == NetMessageType::REMOTE_GAME_OVER)
+    {
+        writeRecord(REPLAY_REMOTE_GAME_OVER, 0, tick, nullptr, 0);
+    }
+}
+
+void recordBubblesSent(const uint32_t tick, const uint8_t numBubbles)
+{
+    if (recordFile == nullptr)
+    {
+        return;
+    }
+    writeRecord(REPLAY_BUBBLES_SENT, 0, tick, &numBubbles, 1);
+}
+
+void stopRecording(const uint32_t tick, const uint32_t score, const ReplayResult result)
+{
+    if (recordFile == nullptr)
+    {
+        return;
+    }
+    uint8_t payload[MAX_RECORD_SIZE];
+    uint8_t size = putVarint(payload, score);
+    payload[size++] = static_cast<uint8_t>(result);
+    writeRecord(REPLAY_END, 0, tick, payload, size);
+    fclose(recordFile);
+    recordFile = nullptr;
+}
+
+bool isRecording()
+{
+    return recordFile != nullptr;
+}
+
+bool openReplayFile(const char *fileName, ReplayReader &reader)
+{
+    reader.file = fopen(fileName, "rb");
+    reader.matchOffset = 0;
+    reader.tick = 0;
+    reader.inMatch = false;
+    return reader.file != nullptr;
+}
+
+bool nextReplayMatch(ReplayReader &reader, ReplayHeader &header)
+{
+    ReplayEvent event;
+    while (reader.inMatch)
+    {
+        readReplayEvent(reader, event);
+    }
+
+    uint8_t tag;
+    if (!readByte(reader, tag))
+    {
+        return false;
+    }
+    reader.matchOffset = tellFile(reader.file) - 1;
+    if (tag != REPLAY_MATCH_TAG)
+    {
+        std::cout << "Replay file is corrupt at offset " << reader.matchOffset << std::endl;
+        return false;
+    }
+    return readHeader(reader, header);
+}
+
+bool seekReplayMatch(ReplayReader &reader, const uint64_t offset, ReplayHeader &header)
+{
+    reader.inMatch = false;
+    if (!seekFile(reader.file, offset))
+    {
+        return false;
+    }
+    return nextReplayMatch(reader, header);
+}
+
+bool readReplayEvent(ReplayReader &reader, ReplayEvent &event)
+{
+    if (!reader.inMatch)
+    {
+        return false;
+    }
+
+    int tag = fgetc(reader.file);
+    if (tag == EOF || tag == REPLAY_MATCH_TAG)
+    {
+        // Cut off before its end record. Leave the next match to be read.
+        if (tag != EOF)
+        {
+            ungetc(tag, reader.file);
+        }
+        reader.inMatch = false;
+        return false;
+    }
+
+    uint32_t delta;
+    if (!readVarint(reader, delta))
+    {
+        reader.inMatch = false;
+        return false;
+    }
+    reader.tick += delta;
+
+    memset(&event, 0, sizeof(event));
+    event.type = static_cast<ReplayEventType>(tag & 0x07);
+    event.tick = reader.tick;
+    bool valid = true;
+    switch (event.type)
+    {
+    case REPLAY_CONTROLS:
+        unpackControls(static_cast<uint8_t>(tag >> 3), event.controls);
+        break;
+    case REPLAY_NUM_BUBBLES:
+    case REPLAY_BUBBLES_SENT:
+        valid = readByte(reader, event.numBubbles);
+        break;
+    case REPLAY_REMOTE_GAME_OVER:
+        break;
+    case REPLAY_END:
+    {
+        uint8_t result = REPLAY_ABANDONED;
+        valid = readVarint(reader, event.score) && readByte(reader, result);
+        event.result = static_cast<ReplayResult>(result);
+        reader.inMatch = false;
+        break;
+    }
+    default:
+        valid = false;
+        break;
+    }
+    if (!valid)
+    {
+        reader.inMatch = false;
+    }
+    return valid;
+}
+
+void closeReplayFile(ReplayReader &reader)
+{
+    if (reader.file != nullptr)
+    {
+        fclose(reader.file);
+        reader.file = nullptr;
+    }
+    reader.inMatch = false;
+}
+
+static void writeRecord(const ReplayEventType type, const uint8_t tagBits, const uint32_t tick, const uint8_t *payload, const uint8_t payloadSize)
+{
+    uint8_t record[MAX_RECORD_SIZE];
+    uint8_t size = 0;
+    record[size++] = static_cast<uint8_t>(type | (tagBits << 3));
+    size += putVarint(record + size, tick - recordTick);
+    if (payloadSize > 0)
+    {
+        memcpy(record + size, payload, payloadSize);
+        size += payloadSize;
+    }
+    fwrite(record, size, 1, recordFile);
+    recordTick = tick;
+}
+
+static uint8_t putVarint(uint8_t *out, uint32_t value)
+{
+    uint8_t size = 0;
+    while (value >= 0x80)
+    {
+        out[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+static bool readByte(ReplayReader &reader, uint8_t &value)
+{
+    int c = fgetc(reader.file);
+    if (c == EOF)
+    {
+        return false;
+    }
+    value = static_cast<uint8_t>(c);
+    return true;
+}
+
+static bool readVarint(ReplayReader &reader, uint32_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        uint8_t byte;
+        if (!readByte(reader, byte))
+        {
+            return false;
+        }
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readHeader(ReplayReader &reader, ReplayHeader &header)
+{
+    if (fread(&header, sizeof(header), 1, reader.file) != 1 ||
+        memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0)
+    {
+        std::cout << "Replay header is corrupt at offset " << reader.matchOffset << std::endl;
+        return false;
+    }
+    if (header.version == 0 || header.version > REPLAY_VERSION)
+    {
+        std::cout << "Replay version " << header.version << " is not supported" << std::endl;
+        return false;
+    }
+    if (header.version < 3 && header.rules.bubbleFrameTicks == REPLAY_V2_BUBBLE_FPS)
+    {
+        header.rules.bubbleFrameTicks = REPLAY_V2_BUBBLE_FRAME_TICKS;
+    }
+    reader.tick = 0;
+    reader.inMatch = true;
+    return true;
+}
+
+static bool seekFile(FILE *file, const uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t tellFile(FILE *file)
+{
+#ifdef _WIN32
+    return static_cast<uint64_t>(_ftelli64(file));
+#else
+    return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+static uint8_t packControls(const Controls &controls)
+{
+    return (controls.left ? REPLAY_CONTROL_LEFT : 0) |
+        (controls.right ? REPLAY_CONTROL_RIGHT : 0) |
+        (controls.rotateCW ? REPLAY_CONTROL_ROTATE_CW : 0) |
+        (controls.rotateACW ? REPLAY_CONTROL_ROTATE_ACW : 0) |
+        (controls.drop ? REPLAY_CONTROL_DROP : 0);
+}
+
+static void unpackControls(const uint8_t bits, Controls &controls)
+{
+    controls.left = (bits & REPLAY_CONTROL_LEFT) != 0;
+    controls.right = (bits & REPLAY_CONTROL_RIGHT) != 0;
+    controls.rotateCW = (bits & REPLAY_CONTROL_ROTATE_CW) != 0;
+    controls.rotateACW = (bits & REPLAY_CONTROL_ROTATE_ACW) != 0;
+    controls.drop = (bits & REPLAY_CONTROL_DROP) != 0;
+}
+
+template<typename Rules>
+static void getModeRules(ReplayRules &rules)
+{
+    rules.gridColumns = Rules::COLUMNS;
+    rules.gridRows = Rules::ROWS;
+    rules.chainDeathLength = Rules::CHAIN_DEATH_LENGTH;
+    rules.chainMinSendLength = Rules::CHAIN_MIN_SEND_LENGTH;
+}
@@ -0,0 +1,153 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "defs.h"
+#include "match_rules.h"
+#include "bubble_net.h"
+
+/* Match recording and playback.
+ *
+ * The game logic steps at a fixed TARGET_FRAME_SECONDS and the spawn colours come from the MatchState's own
+ * random state, seeded at the start of the match, so a match can be played again from its seed, the controls
+ * the state machine saw on each tick and the network messages that changed its state. The only other thing stored is the garbage the
+ * player sent, so that what a client claimed to send can be checked against what the match really produced.
+ *
+ * Files are append only and may hold any number of matches, one after another:
+ *
+ *  REPLAY_MATCH_TAG, ReplayHeader
+ *  record, record, ... REPLAY_END record
+ *  REPLAY_MATCH_TAG, ReplayHeader
+ *  ...
+ *
+ * Each record is a tag byte, the varint number of ticks since the previous record, then any payload.
+ * The low 3 bits of the tag are the ReplayEventType. For REPLAY_CONTROLS the other 5 bits are the controls
+ * held (see REPLAY_CONTROL_* below), so a change of controls costs 2 bytes. A match that was cut off
+ * (the game crashed or was killed) has no REPLAY_END record and reads as abandoned. All values are little endian.
+ */
+
+const uint8_t REPLAY_MATCH_TAG = 0xFF;
+const char REPLAY_MAGIC[4] = { 'S', 'B', 'R', 'P' };
+// Version 2 added REPLAY_BUBBLES_SENT. Version 3 records the ticks each bubble animation frame lasts in place of
+// the animation rate. Version 1 and 2 files can still be played.
+const uint16_t REPLAY_VERSION = 3;
+// The animation rate in rules recorded before version 3, and the ticks each frame lasted at that rate.
+const uint16_t REPLAY_V2_BUBBLE_FPS = 20;
+const uint16_t REPLAY_V2_BUBBLE_FRAME_TICKS = 4;
+
+// ReplayHeader flags.
+const uint8_t REPLAY_FLAG_MULTIPLAYER = 1 << 0;
+const uint8_t REPLAY_FLAG_BOT = 1 << 1;
+
+// Controls bits in a REPLAY_CONTROLS tag.
+const uint8_t REPLAY_CONTROL_LEFT = 1 << 0;
+const uint8_t REPLAY_CONTROL_RIGHT = 1 << 1;
+const uint8_t REPLAY_CONTROL_ROTATE_CW = 1 << 2;
+const uint8_t REPLAY_CONTROL_ROTATE_ACW = 1 << 3;
+const uint8_t REPLAY_CONTROL_DROP = 1 << 4;
+
+enum ReplayEventType
+{
+    // Tag holds the controls.
+    REPLAY_CONTROLS,
+    // Payload is one byte, the number of bubbles sent by the other player.
+    REPLAY_NUM_BUBBLES,
+    // The other player lost.
+    REPLAY_REMOTE_GAME_OVER,
+    // Payload is the varint final score then one byte ReplayResult.
+    REPLAY_END,
+    // Payload is one byte, the number of bubbles this player's chains sent to the other player on this tick.
+    // Written when playing alone too, so every match can be checked.
+    REPLAY_BUBBLES_SENT
+};
+
+enum ReplayResult
+{
+    REPLAY_LOST,
+    REPLAY_WON,
+    // Left from the game, lost connection or the recording was cut off.
+    REPLAY_ABANDONED
+};
+
+// Rules from defs.h and the match mode that change how a match plays out. Replays recorded under other rules can't be played.
+struct ReplayRules
+{
+    uint8_t gridColumns;
+    uint8_t gridRows;
+    uint8_t chainDeathLength;
+    uint8_t chainMinSendLength;
+    int8_t bounceHeight;
+    int8_t fastFallAmount;
+    int8_t bubbleFrames;
+    uint8_t maxSpawnColor;
+    uint16_t gridSize;
+    uint16_t targetFps;
+    uint16_t bubbleFrameTicks;
+    uint16_t reserved;
+};
+
+struct ReplayHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t seed;
+    // Unix time the match started.
+    uint32_t startTime;
+    ReplayRules rules;
+};
+
+struct ReplayEvent
+{
+    ReplayEventType type;
+    uint32_t tick;
+    // Only valid for REPLAY_CONTROLS.
+    Controls controls;
+    // Only valid for REPLAY_NUM_BUBBLES and REPLAY_BUBBLES_SENT.
+    uint8_t numBubbles;
+    // Only valid for REPLAY_END.
+    uint32_t score;
+    ReplayResult result;
+};
+
+struct ReplayReader
+{
+    FILE *file;
+    // Offset of the REPLAY_MATCH_TAG of the current match.
+    uint64_t matchOffset;
+    // Tick of the last record read.
+    uint32_t tick;
+    bool inMatch;
+};
+
+void getReplayRules(const MatchMode mode, ReplayRules &rules);
+// Finds the mode a match was recorded under. False if no mode in this build has its rules.
+bool findReplayMode(const ReplayRules &rules, MatchMode &mode);
+// How a match in this state would be recorded as ending.
+ReplayResult getReplayResult(const GameState state);
+
+// Recording. Only one match is recorded at a time. The file is appended to.
+bool startRecording(const char *fileName, const uint32_t seed, const MatchMode mode, const uint8_t flags);
+// Writes a record only when the controls differ from what playback would have at this point.
+void recordControls(const uint32_t tick, const Controls &controls);
+// Call once the game logic has used the controls, as it clears them after acting on a press.
+void recordControlsUsed(const Controls &controls);
+// Only messages that change the match (NUM_BUBBLES and REMOTE_GAME_OVER) are written.
+void recordNetMessage(const uint32_t tick, const NetMessage &message);
+// The tick is the one the bubbles were sent on: the game logic update that found the chain.
+void recordBubblesSent(const uint32_t tick, const uint8_t numBubbles);
+void stopRecording(const uint32_t tick, const uint32_t score, const ReplayResult result);
+bool isRecording();
+
+// Playback.
+bool openReplayFile(const char *fileName, ReplayReader &reader);
+// Moves to the next match in the file, skipping what is left of the current one. Returns false at the end of the file.
+bool nextReplayMatch(ReplayReader &reader, ReplayHeader &header);
+bool seekReplayMatch(ReplayReader &reader, const uint64_t offset, ReplayHeader &header);
+// Returns false when the match has no more records. REPLAY_END is always the last record returned.
+bool readReplayEvent(ReplayReader &reader, ReplayEvent &event);
+void closeReplayFile(ReplayReader &reader);
+
+#endif
@@ -0,0 +1,607 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include "replay.h"
+#include "replay_index.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Width in bytes of each column.
+static const uint8_t MATCH_COLUMN_WIDTHS[NUM_MATCH_COLUMNS] = { 2, 8, 4, 4, 1, 1, 4, 4, 2, 1, 2, 2, 1, 1, 1 };
+static const uint8_t MOVE_COLUMN_WIDTHS[NUM_MOVE_COLUMNS] = { 4, 4, 1, 2, 1, 1 };
+static const uint8_t TABLE_COLUMNS[NUM_REPLAY_INDEX_TABLES] = { NUM_MATCH_COLUMNS, NUM_MOVE_COLUMNS };
+static const uint8_t *TABLE_WIDTHS[NUM_REPLAY_INDEX_TABLES] = { MATCH_COLUMN_WIDTHS, MOVE_COLUMN_WIDTHS };
+
+struct IndexWriter
+{
+    FILE *file;
+    uint64_t offset;
+    // Rows of the current block of each table, column by column.
+    std::vector<uint8_t> columns[NUM_REPLAY_INDEX_TABLES][NUM_MATCH_COLUMNS];
+    uint32_t blockRows[NUM_REPLAY_INDEX_TABLES];
+    uint64_t tableRows[NUM_REPLAY_INDEX_TABLES];
+    std::vector<ReplayIndexBlock> blocks;
+};
+
+struct MappedFile
+{
+    const uint8_t *data;
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int file;
+#endif
+};
+
+static IndexWriter writer;
+
+static void append(std::vector<uint8_t> &column, const void *data, const size_t size);
+static void writeBytes(const void *data, const size_t size);
+static void flushBlock(const ReplayIndexTable table);
+static bool mapFile(const char *fileName, MappedFile &mapped);
+static void unmapFile(MappedFile &mapped);
+static void printQueryOptions();
+static bool parseNumber(const char *arg, const uint64_t max, uint64_t &value);
+
+template <typename T>
+static const T *getColumn(const MappedFile &mapped, const ReplayIndexBlock &block, const uint8_t column)
+{
+    return reinterpret_cast<const T*>(mapped.data + block.columnOffsets[column]);
+}
+
+// Clears keep[i] for every row whose value is below min. Returns the bytes scanned.
+// The bound is clamped to the range of the column so the comparison is done at the column's width, which vectorises well.
+template <typename T>
+static uint64_t keepAtLeast(const T *values, const uint32_t numRows, const int64_t min, uint8_t *keep)
+{
+    if (min > static_cast<int64_t>(std::numeric_limits<T>::max()))
+    {
+        memset(keep, 0, numRows);
+        return 0;
+    }
+    const T bound = static_cast<T>(std::max<int64_t>(min, 0));
+    for (uint32_t i = 0; i < numRows; i++)
+    {
+        keep[i] &= values[i] >= bound;
+    }
+    return numRows * sizeof(T);
+}
+
+template <typename T>
+static uint64_t keepAtMost(const T *values, const uint32_t numRows, const int64_t max, uint8_t *keep)
+{
+    if (max < 0)
+    {
+        memset(keep, 0, numRows);
+        return 0;
+    }
+    const T bound = static_cast<T>(std::min<int64_t>(max, std::numeric_limits<T>::max()));
+    for (uint32_t i = 0; i < numRows; i++)
+    {
+        keep[i] &= values[i] <= bound;
+    }
+    return numRows * sizeof(T);
+}
+
+bool openReplayIndex(const char *fileName, const std::vector<std::string> &replayFiles)
+{
+    writer.file = fopen(fileName, "wb");
+    if (writer.file == nullptr)
+    {
+        std::cout << "Failed to open index file " << fileName << std::endl;
+        return false;
+    }
+    writer.offset = 0;
+    writer.blocks.clear();
+    for (uint8_t table = 0; table < NUM_REPLAY_INDEX_TABLES; table++)
+    {
+        writer.blockRows[table] = 0;
+        writer.tableRows[table] = 0;
+        for (uint8_t column = 0; column < TABLE_COLUMNS[table]; column++)
+        {
+            writer.columns[table][column].clear();
+        }
+    }
+
+    ReplayIndexHeader header;
+    memcpy(header.magic, REPLAY_INDEX_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_INDEX_VERSION;
+    header.numFiles = static_cast<uint16_t>(replayFiles.size());
+    writeBytes(&header, sizeof(header));
+    for (const std::string &replayFile : replayFiles)
+    {
+        const uint16_t length = static_cast<uint16_t>(replayFile.length());
+        writeBytes(&length, sizeof(length));
+        writeBytes(replayFile.data(), length);
+    }
+    return true;
+}
+
+uint64_t addIndexedMatch(const IndexedMatch &match)
+{
+    std::vector<uint8_t> (&columns)[NUM_MATCH_COLUMNS] = writer.columns[TABLE_MATCHES];
+    append(columns[MATCH_FILE], &match.file, 2);
+    append(columns[MATCH_OFFSET], &match.offset, 8);
+    append(columns[MATCH_SEED], &match.seed, 4);
+    append(columns[MATCH_START_TIME], &match.startTime, 4);
+    append(columns[MATCH_FLAGS], &match.flags, 1);
+    append(columns[MATCH_RESULT], &match.result, 1);
+    append(columns[MATCH_SCORE], &match.score, 4);
+    append(columns[MATCH_TICKS], &match.ticks, 4);
+    append(columns[MATCH_MOVES], &match.moves, 2);
+    append(columns[MATCH_MAX_CHAIN], &match.maxChain, 1);
+    append(columns[MATCH_GARBAGE_SENT], &match.garbageSent, 2);
+    append(columns[MATCH_GARBAGE_RECEIVED], &match.garbageReceived, 2);
+    append(columns[MATCH_END_GHOSTS], &match.endGhosts, 1);
+    append(columns[MATCH_GHOST_TOP_OUT], &match.ghostTopOut, 1);
+    append(columns[MATCH_MISMATCH], &match.mismatch, 1);
+
+    const uint64_t row = writer.tableRows[TABLE_MATCHES]++;
+    if (++writer.blockRows[TABLE_MATCHES] == REPLAY_INDEX_ROWS_PER_BLOCK)
+    {
+        flushBlock(TABLE_MATCHES);
+    }
+    return row;
+}
+
+void addIndexedMove(const uint32_t matchRow, const IndexedMove &move)
+{
+    std::vector<uint8_t> (&columns)[NUM_MATCH_COLUMNS] = writer.columns[TABLE_MOVES];
+    append(columns[MOVE_MATCH], &matchRow, 4);
+    append(columns[MOVE_TICK], &move.tick, 4);
+    append(columns[MOVE_CHAIN], &move.chain, 1);
+    append(columns[MOVE_SCORE], &move.score, 2);
+    append(columns[MOVE_GARBAGE], &move.garbage, 1);
+    append(columns[MOVE_HEIGHT], &move.height, 1);
+
+    writer.tableRows[TABLE_MOVES]++;
+    if (++writer.blockRows[TABLE_MOVES] == REPLAY_INDEX_ROWS_PER_BLOCK)
+    {
+        flushBlock(TABLE_MOVES);
+    }
+}
+
+bool closeReplayIndex()
+{
+    if (writer.file == nullptr)
+    {
+        return false;
+    }
+    flushBlock(TABLE_MATCHES);
+    flushBlock(TABLE_MOVES);
+
+    ReplayIndexFooter footer;
+    footer.indexOffset = writer.offset;
+    footer.numMatches = writer.tableRows[TABLE_MATCHES];
+    footer.numMoves = writer.tableRows[TABLE_MOVES];
+    footer.numBlocks = static_cast<uint32_t>(writer.blocks.size());
+    memcpy(footer.magic, REPLAY_INDEX_FOOTER_MAGIC, sizeof(footer.magic));
+    if (!writer.blocks.empty())
+    {
+        writeBytes(writer.blocks.data(), writer.blocks.size() * sizeof(ReplayIndexBlock));
+    }
+    writeBytes(&footer, sizeof(footer));
+
+    const bool ok = ferror(writer.file) == 0;
+    fclose(writer.file);
+    writer.file = nullptr;
+    std::cout << "Indexed " << footer.numMatches << " matches and " << footer.numMoves << " moves in " << footer.numBlocks << " blocks." << std::endl;
+    return ok;
+}
+
+bool parseReplayQuery(const int argc, char *argv[], ReplayQuery &query)
+{
+    memset(&query, 0, sizeof(query));
+    query.maxScore = INT64_MAX;
+    query.result = -1;
+
+    for (int i = 0; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        uint64_t value = 0;
+        if (strcmp(argv[i], "--moves") == 0)
+        {
+            query.moves = true;
+        }
+        else if (strcmp(argv[i], "--min-chain") == 0 && hasValue && parseNumber(argv[i + 1], INT32_MAX, value))
+        {
+            query.minChain = static_cast<int32_t>(value);
+            i++;
+        }
+        else if (strcmp(argv[i], "--min-score") == 0 && hasValue && parseNumber(argv[i + 1], INT64_MAX, value))
+        {
+            query.minScore = static_cast<int64_t>(value);
+            i++;
+        }
+        else if (strcmp(argv[i], "--max-score") == 0 && hasValue && parseNumber(argv[i + 1], INT64_MAX, value))
+        {
+            query.maxScore = static_cast<int64_t>(value);
+            i++;
+        }
+        else if (strcmp(argv[i], "--min-garbage") == 0 && hasValue && parseNumber(argv[i + 1], INT32_MAX, value))
+        {
+            query.minGarbage = static_cast<int32_t>(value);
+            i++;
+        }
+        else if (strcmp(argv[i], "--result") == 0 && hasValue)
+        {
+            i++;
+            if (strcmp(argv[i], "lost") == 0)
+            {
+                query.result = REPLAY_LOST;
+            }
+            else if (strcmp(argv[i], "won") == 0)
+            {
+                query.result = REPLAY_WON;
+            }
+            else if (strcmp(argv[i], "abandoned") == 0)
+            {
+                query.result = REPLAY_ABANDONED;
+            }
+            else
+            {
+                printQueryOptions();
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--ghost-top-out") == 0)
+        {
+            query.ghostTopOut = true;
+        }
+        else if (strcmp(argv[i], "--mismatch") == 0)
+        {
+            query.mismatch = true;
+        }
+        else if (strcmp(argv[i], "--bot") == 0)
+        {
+            query.flags |= REPLAY_FLAG_BOT;
+        }
+        else if (strcmp(argv[i], "--multiplayer") == 0)
+        {
+            query.flags |= REPLAY_FLAG_MULTIPLAYER;
+        }
+        else if (strcmp(argv[i], "--limit") == 0 && hasValue && parseNumber(argv[i + 1], UINT64_MAX, value))
+        {
+            query.limit = value;
+            i++;
+        }
+        else
+        {
+            printQueryOptions();
+            return false;
+        }
+    }
+    // The move table only has columns for --min-chain, --min-score and --min-garbage.
+    if (query.moves && (query.maxScore < INT64_MAX || query.result >= 0 || query.ghostTopOut || query.mismatch || query.flags != 0))
+    {
+        std::cout << "--moves can only be combined with --min-chain, --min-score, --min-garbage and --limit" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool queryReplayIndex(const char *fileName, const ReplayQuery &query)
+{
+    MappedFile mapped;
+    if (!mapFile(fileName, mapped))
+    {
+        std::cout << "Failed to map index file " << fileName << std::endl;
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const ReplayIndexHeader *header = reinterpret_cast<const ReplayIndexHeader*>(mapped.data);
+    const ReplayIndexFooter *footer = reinterpret_cast<const ReplayIndexFooter*>(mapped.data + mapped.size - sizeof(ReplayIndexFooter));
+    if (mapped.size < sizeof(ReplayIndexHeader) + sizeof(ReplayIndexFooter) ||
+        memcmp(header->magic, REPLAY_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        memcmp(footer->magic, REPLAY_INDEX_FOOTER_MAGIC, sizeof(footer->magic)) != 0 ||
+        header->version != REPLAY_INDEX_VERSION ||
+        footer->indexOffset + (footer->numBlocks * sizeof(ReplayIndexBlock)) + sizeof(ReplayIndexFooter) != mapped.size)
+    {
+        std::cout << "Index file " << fileName << " is corrupt." << std::endl;
+        unmapFile(mapped);
+        return false;
+    }
+
+    // File names.
+    std::vector<std::string> fileNames;
+    uint64_t offset = sizeof(ReplayIndexHeader);
+    for (uint16_t i = 0; i < header->numFiles && offset + 2 <= footer->indexOffset; i++)
+    {
+        uint16_t length;
+        memcpy(&length, mapped.data + offset, sizeof(length));
+        offset += sizeof(length);
+        fileNames.push_back(std::string(reinterpret_cast<const char*>(mapped.data + offset), length));
+        offset += length;
+    }
+
+    const ReplayIndexBlock *blocks = reinterpret_cast<const ReplayIndexBlock*>(mapped.data + footer->indexOffset);
+    // Match blocks in row order, to find the match of a move.
+    std::vector<const ReplayIndexBlock*> matchBlocks;
+    for (uint32_t b = 0; b < footer->numBlocks; b++)
+    {
+        const uint8_t table = blocks[b].table < NUM_REPLAY_INDEX_TABLES ? static_cast<uint8_t>(blocks[b].table) : static_cast<uint8_t>(TABLE_MATCHES);
+        for (uint8_t column = 0; column < TABLE_COLUMNS[table]; column++)
+        {
+            if (blocks[b].columnOffsets[column] + (static_cast<uint64_t>(blocks[b].numRows) * TABLE_WIDTHS[table][column]) > footer->indexOffset)
+            {
+                std::cout << "Index file " << fileName << " is corrupt." << std::endl;
+                unmapFile(mapped);
+                return false;
+            }
+        }
+        if (blocks[b].table == TABLE_MATCHES)
+        {
+            matchBlocks.push_back(&blocks[b]);
+        }
+    }
+
+    std::vector<uint8_t> keep(REPLAY_INDEX_ROWS_PER_BLOCK);
+    uint64_t bytesScanned = 0;
+    uint64_t rowsScanned = 0;
+    uint64_t found = 0;
+    const ReplayIndexTable queryTable = query.moves ? TABLE_MOVES : TABLE_MATCHES;
+    for (uint32_t b = 0; b < footer->numBlocks && (query.limit == 0 || found < query.limit); b++)
+    {
+        const ReplayIndexBlock &block = blocks[b];
+        if (block.table != queryTable)
+        {
+            continue;
+        }
+        const uint32_t rows = block.numRows;
+        std::fill(keep.begin(), keep.begin() + rows, 1);
+        rowsScanned += rows;
+
+        uint8_t *rowsKept = keep.data();
+        if (query.moves)
+        {
+            if (query.minChain > 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint8_t>(mapped, block, MOVE_CHAIN), rows, query.minChain, rowsKept);
+            }
+            if (query.minScore > 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint16_t>(mapped, block, MOVE_SCORE), rows, query.minScore, rowsKept);
+            }
+            if (query.minGarbage > 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint8_t>(mapped, block, MOVE_GARBAGE), rows, query.minGarbage, rowsKept);
+            }
+        }
+        else
+        {
+            if (query.minChain > 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint8_t>(mapped, block, MATCH_MAX_CHAIN), rows, query.minChain, rowsKept);
+            }
+            if (query.minScore > 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint32_t>(mapped, block, MATCH_SCORE), rows, query.minScore, rowsKept);
+            }
+            if (query.maxScore < INT64_MAX)
+            {
+                bytesScanned += keepAtMost(getColumn<uint32_t>(mapped, block, MATCH_SCORE), rows, query.maxScore, rowsKept);
+            }
+            if (query.minGarbage > 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint16_t>(mapped, block, MATCH_GARBAGE_SENT), rows, query.minGarbage, rowsKept);
+            }
+            if (query.result >= 0)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint8_t>(mapped, block, MATCH_RESULT), rows, query.result, rowsKept);
+                bytesScanned += keepAtMost(getColumn<uint8_t>(mapped, block, MATCH_RESULT), rows, query.result, rowsKept);
+            }
+            if (query.ghostTopOut)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint8_t>(mapped, block, MATCH_GHOST_TOP_OUT), rows, 1, rowsKept);
+            }
+            if (query.mismatch)
+            {
+                bytesScanned += keepAtLeast(getColumn<uint8_t>(mapped, block, MATCH_MISMATCH), rows, 1, rowsKept);
+            }
+            if (query.flags != 0)
+            {
+                const uint8_t *flags = getColumn<uint8_t>(mapped, block, MATCH_FLAGS);
+                for (uint32_t i = 0; i < rows; i++)
+                {
+                    rowsKept[i] &= (flags[i] & query.flags) == query.flags;
+                }
+                bytesScanned += rows;
+            }
+        }
+
+        for (uint32_t i = 0; i < rows && (query.limit == 0 || found < query.limit); i++)
+        {
+            // Most rows are usually filtered out, so skip to the next kept one.
+            const uint8_t *next = static_cast<const uint8_t*>(memchr(rowsKept + i, 1, rows - i));
+            if (next == nullptr)
+            {
+                break;
+            }
+            i = static_cast<uint32_t>(next - rowsKept);
+            // Look up the match row for a move, then where the match is stored.
+            uint64_t matchRow = block.firstRow + i;
+            uint32_t tick = 0;
+            if (query.moves)
+            {
+                matchRow = getColumn<uint32_t>(mapped, block, MOVE_MATCH)[i];
+                tick = getColumn<uint32_t>(mapped, block, MOVE_TICK)[i];
+            }
+            const uint64_t matchBlock = matchRow / REPLAY_INDEX_ROWS_PER_BLOCK;
+            if (matchBlock >= matchBlocks.size())
+            {
+                continue;
+            }
+            const ReplayIndexBlock &match = *matchBlocks[matchBlock];
+            const uint32_t matchIndex = matchRow % REPLAY_INDEX_ROWS_PER_BLOCK;
+            const uint16_t file = getColumn<uint16_t>(mapped, match, MATCH_FILE)[matchIndex];
+            std::cout << (file < fileNames.size() ? fileNames[file] : "?") << " "
+                << getColumn<uint64_t>(mapped, match, MATCH_OFFSET)[matchIndex] << " "
+                << getColumn<uint32_t>(mapped, match, MATCH_SCORE)[matchIndex];
+            if (query.moves)
+            {
+                std::cout << " tick " << tick;
+            }
+            std::cout << "\n";
+            found++;
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << found << " found in " << rowsScanned << (query.moves ? " moves" : " matches") << ", " << bytesScanned / (1024 * 1024) << "MB scanned in "
+        << seconds * 1000.0 << "ms (" << (seconds > 0.0 ? (bytesScanned / seconds) / (1024.0 * 1024.0 * 1024.0) : 0.0) << "GB/s)" << std::endl;
+    unmapFile(mapped);
+    return true;
+}
+
+static void append(std::vector<uint8_t> &column, const void *data, const size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    column.insert(column.end(), bytes, bytes + size);
+}
+
+static void writeBytes(const void *data, const size_t size)
+{
+    fwrite(data, size, 1, writer.file);
+    writer.offset += size;
+}
+
+// Writes the buffered rows of a table as a block, each column starting on an 8 byte boundary.
+static void flushBlock(const ReplayIndexTable table)
+{
+    if (writer.blockRows[table] == 0)
+    {
+        return;
+    }
+
+    ReplayIndexBlock block;
+    memset(&block, 0, sizeof(block));
+    block.firstRow = writer.tableRows[table] - writer.blockRows[table];
+    block.numRows = writer.blockRows[table];
+    block.table = table;
+    for (uint8_t column = 0; column < TABLE_COLUMNS[table]; column++)
+    {
+        static const uint8_t PADDING[8] = {};
+        if (writer.offset % 8 != 0)
+        {
+            writeBytes(PADDING, 8 - (writer.offset % 8));
+        }
+        block.columnOffsets[column] = writer.offset;
+        writeBytes(writer.columns[table][column].data(), writer.columns[table][column].size());
+        writer.columns[table][column].clear();
+    }
+    writer.blocks.push_back(block);
+    writer.blockRows[table] = 0;
+}
+
+static bool mapFile(const char *fileName, MappedFile &mapped)
+{
+    mapped.data = nullptr;
+    mapped.size = 0;
+#ifdef _WIN32
+    mapped.file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mapped.file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(mapped.file, &size);
+    mapped.size = static_cast<uint64_t>(size.QuadPart);
+    mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapped.mapping == nullptr)
+    {
+        CloseHandle(mapped.file);
+        return false;
+    }
+    mapped.data = static_cast<const uint8_t*>(MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mapped.data == nullptr)
+    {
+        CloseHandle(mapped.mapping);
+        CloseHandle(mapped.file);
+        return false;
+    }
+#else
+    mapped.file = open(fileName, O_RDONLY);
+    if (mapped.file < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(mapped.file, &info) != 0 || info.st_size == 0)
+    {
+        close(mapped.file);
+        return false;
+    }
+    mapped.size = static_cast<uint64_t>(info.st_size);
+    void *data = mmap(nullptr, mapped.size, PROT_READ, MAP_SHARED, mapped.file, 0);
+    if (data == MAP_FAILED)
+    {
+        close(mapped.file);
+        return false;
+    }
+    mapped.data = static_cast<const uint8_t*>(data);
+#endif
+    return true;
+}
+
+static void unmapFile(MappedFile &mapped)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(mapped.data);
+    CloseHandle(mapped.mapping);
+    CloseHandle(mapped.file);
+#else
+    munmap(const_cast<uint8_t*>(mapped.data), mapped.size);
+    close(mapped.file);
+#endif
+    mapped.data = nullptr;
+}
+
+static void printQueryOptions()
+{
+    std::cout << "Query options:" << std::endl
+        << "  --min-chain N        longest chain reaction at least N" << std::endl
+        << "  --min-score N        score at least N" << std::endl
+        << "  --max-score N        score at most N" << std::endl
+        << "  --min-garbage N      bubbles sent at least N" << std::endl
+        << "  --result R           lost, won or abandoned" << std::endl
+        << "  --ghost-top-out      lost to a ghost bubble reaching the top" << std::endl
+        << "  --mismatch           replay did not end as recorded" << std::endl
+        << "  --bot                played by the bot" << std::endl
+        << "  --multiplayer        multiplayer matches" << std::endl
+        << "  --moves              filter single moves (--min-chain, --min-score, --min-garbage) instead of matches" << std::endl
+        << "  --limit N            stop after N results" << std::endl;
+}
+
+// Reads a query value. False unless arg is all digits and no more than max, so a typo can't become a filter of 0.
+static bool parseNumber(const char *arg, const uint64_t max, uint64_t &value)
+{
+    if (arg[0] < '0' || arg[0] > '9')
+    {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    const unsigned long long parsed = strtoull(arg, &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed > max)
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
@@ -0,0 +1,179 @@
+#ifndef REPLAY_INDEX_H
+#define REPLAY_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Replay corpus index.
+ *
+ * Summary stats for every match (and every move) in a set of replay files, worked out by playing each match
+ * back once. The index is stored column by column so a query only touches the columns it filters on, and it
+ * is memory mapped rather than read so it can be far bigger than RAM:
+ *
+ *  ReplayIndexHeader
+ *  replay file names, each a uint16 length then the characters
+ *  block, block, ...
+ *  ReplayIndexBlock[numBlocks]
+ *  ReplayIndexFooter
+ *
+ * A block holds up to REPLAY_INDEX_ROWS_PER_BLOCK rows of either the match table or the move table. Its columns
+ * are stored one after another, each as a plain array of fixed width values starting on an 8 byte boundary,
+ * so they can be scanned in place. All values are little endian.
+ */
+
+const char REPLAY_INDEX_MAGIC[4] = { 'S', 'B', 'R', 'X' };
+const char REPLAY_INDEX_FOOTER_MAGIC[4] = { 'S', 'B', 'R', 'F' };
+const uint16_t REPLAY_INDEX_VERSION = 1;
+const uint32_t REPLAY_INDEX_ROWS_PER_BLOCK = 65536;
+
+enum ReplayIndexTable
+{
+    TABLE_MATCHES,
+    TABLE_MOVES,
+    NUM_REPLAY_INDEX_TABLES
+};
+
+enum MatchColumn
+{
+    // uint16, index into the file name table.
+    MATCH_FILE,
+    // uint64, offset of the match in its replay file (see seekReplayMatch).
+    MATCH_OFFSET,
+    // uint32.
+    MATCH_SEED,
+    // uint32, unix time.
+    MATCH_START_TIME,
+    // uint8, ReplayHeader flags.
+    MATCH_FLAGS,
+    // uint8, ReplayResult.
+    MATCH_RESULT,
+    // uint32.
+    MATCH_SCORE,
+    // uint32, length of the match in ticks.
+    MATCH_TICKS,
+    // uint16, pairs placed.
+    MATCH_MOVES,
+    // uint8, longest chain reaction of any move.
+    MATCH_MAX_CHAIN,
+    // uint16, bubbles sent to the other player.
+    MATCH_GARBAGE_SENT,
+    // uint16, bubbles received from the other player.
+    MATCH_GARBAGE_RECEIVED,
+    // uint8, ghost bubbles on the board when the match ended.
+    MATCH_END_GHOSTS,
+    // uint8, 1 if the match was lost to a ghost bubble landing on the top row.
+    MATCH_GHOST_TOP_OUT,
+    // uint8, 1 if replaying the match gave a different score or result from the one recorded.
+    MATCH_MISMATCH,
+    NUM_MATCH_COLUMNS
+};
+
+enum MoveColumn
+{
+    // uint32, row in the match table.
+    MOVE_MATCH,
+    // uint32, tick the pair spawned on.
+    MOVE_TICK,
+    // uint8, number of chain reaction steps.
+    MOVE_CHAIN,
+    // uint16, score gained.
+    MOVE_SCORE,
+    // uint8, bubbles sent to the other player.
+    MOVE_GARBAGE,
+    // uint8, tallest column once the move had settled.
+    MOVE_HEIGHT,
+    NUM_MOVE_COLUMNS
+};
+
+struct ReplayIndexHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t numFiles;
+};
+
+struct ReplayIndexBlock
+{
+    // Byte offset of each column from the start of the file. Only the first NUM_MATCH_COLUMNS or NUM_MOVE_COLUMNS are used.
+    uint64_t columnOffsets[NUM_MATCH_COLUMNS];
+    uint64_t firstRow;
+    uint32_t numRows;
+    uint32_t table;
+};
+
+struct ReplayIndexFooter
+{
+    uint64_t indexOffset;
+    uint64_t numMatches;
+    uint64_t numMoves;
+    uint32_t numBlocks;
+    char magic[4];
+};
+
+struct IndexedMatch
+{
+    uint16_t file;
+    uint64_t offset;
+    uint32_t seed;
+    uint32_t startTime;
+    uint8_t flags;
+    uint8_t result;
+    uint32_t score;
+    uint32_t ticks;
+    uint16_t moves;
+    uint8_t maxChain;
+    uint16_t garbageSent;
+    uint16_t garbageReceived;
+    uint8_t endGhosts;
+    uint8_t ghostTopOut;
+    uint8_t mismatch;
+};
+
+struct IndexedMove
+{
+    uint32_t tick;
+    uint8_t chain;
+    uint16_t score;
+    uint8_t garbage;
+    uint8_t height;
+};
+
+// Filters for queryReplayIndex. Every filter that is set must match.
+struct ReplayQuery
+{
+    // When set, moves are filtered (on minChain, minScore and minGarbage) and a match is listed for each move found.
+    bool moves;
+    int32_t minChain;
+    int64_t minScore;
+    int64_t maxScore;
+    int32_t minGarbage;
+    // ReplayResult, or -1 for any.
+    int32_t result;
+    bool ghostTopOut;
+    bool mismatch;
+    // Only matches with all of these ReplayHeader flags.
+    uint8_t flags;
+    // Stop after this many results. 0 for no limit.
+    uint64_t limit;
+};
+
+// Writing. Rows are buffered a block at a time, so only a block of each table is ever held in memory.
+bool openReplayIndex(const char *fileName, const std::vector<std::string> &replayFiles);
+// Returns the row of the match, for its moves.
+uint64_t addIndexedMatch(const IndexedMatch &match);
+void addIndexedMove(const uint32_t matchRow, const IndexedMove &move);
+bool closeReplayIndex();
+
+/*
+ * Parses query filters from the command line, e.g. --min-chain 5 --result lost --limit 100.
+ * Returns false, after printing the options, if any are not understood.
+**/
+bool parseReplayQuery(const int argc, char *argv[], ReplayQuery &query);
+/*
+ * Memory maps the index and prints the replay file and offset of every match that passes the filters,
+ * then the count and scan rate. Returns false if the index could not be read.
+**/
+bool queryReplayIndex(const char *fileName, const ReplayQuery &query);
+
+#endif
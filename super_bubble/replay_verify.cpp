@@ -0,0 +1,672 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <string.h>
+#include "game_logic.h"
+#include "board.h"
+#include "replay_verify.h"
+
+// Matches handed to the workers at once while a file is being read.
+static const size_t VERIFY_BATCH_SIZE = 256;
+
+// A match to verify, or for the indexer a whole file.
+struct VerifyJob
+{
+    // Points into VerifyQueue::fileNames.
+    const std::string *fileName;
+    // Position of the file in the list given, for the index's file column.
+    uint16_t file;
+    // Unused by the indexer, which reads the file from the start.
+    uint64_t offset;
+    // Jobs queued before this one.
+    uint64_t number;
+};
+
+// A match played back for the index, waiting for the ones queued before it to be written.
+struct IndexedResult
+{
+    IndexedMatch match;
+    std::vector<IndexedMove> moves;
+    // Marks the end of a file's matches rather than a match.
+    bool endOfFile;
+};
+
+// The file's job number, then the match's place in the file.
+typedef std::pair<uint64_t, uint32_t> IndexKey;
+
+// Index rows are written in the order the files were queued and the matches appear in them, whichever worker finishes first.
+struct IndexOutput
+{
+    std::map<IndexKey, IndexedResult> waiting;
+    IndexKey next;
+};
+
+// The pair being played, for ReplayMatchStats.
+struct MoveWatch
+{
+    IndexedMove move;
+    bool started;
+    uint32_t startScore;
+    uint16_t startGarbage;
+};
+
+// Shared by the reader, the workers and the progress report. Only touched with the mutex held, apart from the counters.
+struct VerifyQueue
+{
+    std::mutex mutex;
+    std::condition_variable jobsReady;
+    std::condition_variable jobsTaken;
+    // A row was added to the index, for workers waiting on the ones before theirs.
+    std::condition_variable indexWritten;
+    std::condition_variable finished;
+    std::deque<VerifyJob> jobs;
+    // A deque so the names stay where they are as more files are added.
+    std::deque<std::string> fileNames;
+    // Set once every file has been read.
+    bool closed;
+    bool done;
+    uint64_t numQueued;
+    // Most matches queued, and most index rows waiting, at once. Reading the files is far faster than playing them back,
+    // so without this the whole list would end up in memory.
+    size_t maxBacklog;
+    // Set when building the index rather than only verifying.
+    IndexOutput *index;
+    std::atomic<uint64_t> verified;
+    std::atomic<uint64_t> failed;
+    std::atomic<uint64_t> cutOff;
+    std::atomic<uint64_t> ticks;
+};
+
+static void initQueue(VerifyQueue &queue);
+static uint32_t runJobs(VerifyQueue &queue, const std::vector<std::string> &replayFiles, const uint32_t numThreads);
+static void queueFile(VerifyQueue &queue, const std::string &fileName);
+static void submitJobs(VerifyQueue &queue, std::vector<VerifyJob> &batch);
+static bool takeJob(VerifyQueue &queue, VerifyJob &job);
+static void verifyJobs(VerifyQueue &queue);
+static void countResult(VerifyQueue &queue, const ReplayVerification &verification, const bool passed);
+static void indexFile(VerifyQueue &queue, const VerifyJob &job, ReplayMatchStats &stats);
+static void writeIndexed(VerifyQueue &queue, const IndexKey key, IndexedResult &result);
+static void reportProgress(VerifyQueue &queue);
+static void printFailure(const std::string &fileName, const uint64_t offset, const ReplayVerification &verification);
+static void watchTick(const MatchState &match, const GameState previousState, MoveWatch &watch, ReplayMatchStats &stats);
+static void endMove(const MatchState &match, MoveWatch &watch, ReplayMatchStats &stats);
+
+bool verifyReplayMatch(ReplayReader &reader, const ReplayHeader &header, ReplayVerification &verification, ReplayMatchStats *stats)
+{
+    memset(&verification, 0, sizeof(verification));
+    verification.claimedResult = REPLAY_ABANDONED;
+    verification.result = REPLAY_ABANDONED;
+    verification.garbageMismatchTick = UINT32_MAX;
+    if (stats != nullptr)
+    {
+        stats->moves.clear();
+        stats->maxChain = 0;
+        stats->garbageReceived = 0;
+        stats->endGhosts = 0;
+        stats->ghostTopOut = false;
+    }
+
+    MatchMode mode;
+    if (!findReplayMode(header.rules, mode))
+    {
+        verification.failures = VERIFY_RULES;
+        return false;
+    }
+
+    MatchState match;
+    initMatchState(match, header.seed, mode);
+    Controls controls;
+    memset(&controls, 0, sizeof(controls));
+    // Version 1 replays have no record of the bubbles sent.
+    const bool checkGarbage = header.version >= 2;
+    MoveWatch watch;
+    watch.started = false;
+
+    ReplayEvent event;
+    bool hasEvent = readReplayEvent(reader, event);
+    if (!hasEvent)
+    {
+        verification.failures = VERIFY_CORRUPT;
+        return false;
+    }
+
+    // The same steps as update() in main.cpp: the records for this tick, then one tick of the match.
+    for (;;)
+    {
+        const GameState previousState = match.state;
+        while (hasEvent && event.tick <= match.tick && event.type != REPLAY_END)
+        {
+            switch (event.type)
+            {
+            case REPLAY_CONTROLS:
+                controls = event.controls;
+                break;
+            case REPLAY_NUM_BUBBLES:
+                match.numEnemyBubbles += event.numBubbles;
+                if (stats != nullptr)
+                {
+                    stats->garbageReceived += event.numBubbles;
+                }
+                break;
+            case REPLAY_REMOTE_GAME_OVER:
+                match.state = GameState::WIN;
+                break;
+            case REPLAY_BUBBLES_SENT:
+                verification.claimedGarbage += event.numBubbles;
+                break;
+            default:
+                break;
+            }
+            hasEvent = readReplayEvent(reader, event);
+        }
+
+        stepMatch(match, controls, TARGET_FRAME_SECONDS);
+        match.garbageToSend = 0;
+        if (checkGarbage && match.garbageSent != verification.claimedGarbage && verification.garbageMismatchTick == UINT32_MAX)
+        {
+            verification.garbageMismatchTick = match.tick - 1;
+        }
+        if (stats != nullptr)
+        {
+            watchTick(match, previousState, watch, *stats);
+        }
+
+        if (!hasEvent || (event.type == REPLAY_END && event.tick <= match.tick))
+        {
+            break;
+        }
+        if (match.state == GameState::GAME_OVER || match.state == GameState::WIN)
+        {
+            // Recordings end on the tick the match does, so anything after this was not played.
+            // Read on to the end record to see what was claimed.
+            while (hasEvent && event.type != REPLAY_END)
+            {
+                if (event.type == REPLAY_BUBBLES_SENT)
+                {
+                    verification.claimedGarbage += event.numBubbles;
+                }
+                hasEvent = readReplayEvent(reader, event);
+            }
+            if (hasEvent)
+            {
+                verification.failures |= VERIFY_RESULT;
+            }
+            break;
+        }
+    }
+
+    if (stats != nullptr)
+    {
+        // Playback ran out part way through a move.
+        endMove(match, watch, *stats);
+        const GridShape &shape = MODE_GRIDS[match.mode];
+        for (uint8_t col = 0; col < shape.columns; col++)
+        {
+            for (uint8_t row = 0; row < shape.rows; row++)
+            {
+                if (cellState(match.grid[col][row]) != BubbleState::DEAD && cellColor(match.grid[col][row]) == GHOST)
+                {
+                    stats->endGhosts++;
+                }
+            }
+        }
+    }
+
+    verification.ticks = match.tick;
+    verification.score = match.score;
+    verification.result = getReplayResult(match.state);
+    verification.garbage = match.garbageSent;
+    if (checkGarbage && (verification.garbageMismatchTick != UINT32_MAX || verification.garbage != verification.claimedGarbage))
+    {
+        verification.failures |= VERIFY_GARBAGE;
+    }
+    if (!hasEvent)
+    {
+        verification.cutOff = true;
+    }
+    else
+    {
+        verification.claimedScore = event.score;
+        verification.claimedResult = event.result;
+        if (verification.claimedScore != verification.score)
+        {
+            verification.failures |= VERIFY_SCORE;
+        }
+        if (verification.claimedResult != verification.result)
+        {
+            verification.failures |= VERIFY_RESULT;
+        }
+    }
+    return verification.failures == 0;
+}
+
+uint64_t runReplayVerifier(const std::vector<std::string> &replayFiles, const uint32_t numThreads)
+{
+    VerifyQueue queue;
+    initQueue(queue);
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    const uint32_t numWorkers = runJobs(queue, replayFiles, numThreads);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << queue.verified << " matches verified on " << numWorkers << " threads in " << seconds << "s ("
+        << (seconds > 0.0 ? queue.verified / seconds : 0.0) << " matches/s, "
+        << (seconds > 0.0 ? (queue.ticks * TARGET_FRAME_SECONDS) / seconds : 0.0) << "x real time). "
+        << queue.failed << " failed, " << queue.cutOff << " cut off." << std::endl;
+    return queue.failed;
+}
+
+bool runReplayIndexer(const char *indexFile, const std::vector<std::string> &replayFiles, const uint32_t numThreads)
+{
+    if (!openReplayIndex(indexFile, replayFiles))
+    {
+        return false;
+    }
+
+    IndexOutput index;
+    index.next = IndexKey(0, 0);
+    VerifyQueue queue;
+    initQueue(queue);
+    queue.index = &index;
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    const uint32_t numWorkers = runJobs(queue, replayFiles, numThreads);
+
+    const bool ok = closeReplayIndex();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Indexing took " << seconds << "s on " << numWorkers << " threads ("
+        << (seconds > 0.0 ? queue.verified / seconds : 0.0) << " matches/s). " << queue.failed << " did not replay as recorded." << std::endl;
+    return ok;
+}
+
+static void initQueue(VerifyQueue &queue)
+{
+    queue.closed = false;
+    queue.done = false;
+    queue.numQueued = 0;
+    queue.maxBacklog = 0;
+    queue.index = nullptr;
+    queue.verified = 0;
+    queue.failed = 0;
+    queue.cutOff = 0;
+    queue.ticks = 0;
+}
+
+// Queues every match in the replay files (or in the files named on stdin) and waits for the workers to finish them. Returns the number of workers.
+static uint32_t runJobs(VerifyQueue &queue, const std::vector<std::string> &replayFiles, const uint32_t numThreads)
+{
+    const uint32_t numWorkers = std::max(numThreads, 1u);
+    queue.maxBacklog = numWorkers * VERIFY_BATCH_SIZE * 2;
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < numWorkers; i++)
+    {
+        workers.push_back(std::thread(verifyJobs, std::ref(queue)));
+    }
+    std::thread reporter(reportProgress, std::ref(queue));
+
+    if (replayFiles.empty())
+    {
+        std::string fileName;
+        while (std::getline(std::cin, fileName))
+        {
+            if (!fileName.empty())
+            {
+                queueFile(queue, fileName);
+            }
+        }
+    }
+    else
+    {
+        for (const std::string &fileName : replayFiles)
+        {
+            queueFile(queue, fileName);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.closed = true;
+    }
+    queue.jobsReady.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.done = true;
+    }
+    queue.finished.notify_all();
+    reporter.join();
+    return numWorkers;
+}
+
+// Lists the matches in a replay file and hands them to the workers. The indexer hands over the whole file instead.
+static void queueFile(VerifyQueue &queue, const std::string &fileName)
+{
+    // The name is kept even if the file can't be opened, so the index's file numbers match the list given.
+    VerifyJob job;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.fileNames.push_back(fileName);
+        job.fileName = &queue.fileNames.back();
+        job.file = static_cast<uint16_t>(queue.fileNames.size() - 1);
+    }
+    job.offset = 0;
+
+    std::vector<VerifyJob> batch;
+    if (queue.index != nullptr)
+    {
+        // Every match in the file is indexed, so one worker reads it straight through rather than it being read here
+        // to list the matches and then again to play them.
+        batch.push_back(job);
+        submitJobs(queue, batch);
+        return;
+    }
+
+    ReplayReader reader;
+    if (!openReplayFile(fileName.c_str(), reader))
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        std::cout << "Failed to open replay file " << fileName << std::endl;
+        return;
+    }
+
+    ReplayHeader header;
+    while (nextReplayMatch(reader, header))
+    {
+        job.offset = reader.matchOffset;
+        batch.push_back(job);
+        if (batch.size() == VERIFY_BATCH_SIZE)
+        {
+            submitJobs(queue, batch);
+        }
+    }
+    submitJobs(queue, batch);
+    closeReplayFile(reader);
+}
+
+static void submitJobs(VerifyQueue &queue, std::vector<VerifyJob> &batch)
+{
+    if (batch.empty())
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.jobsTaken.wait(lock, [&]() { return queue.jobs.size() < queue.maxBacklog; });
+        for (VerifyJob &job : batch)
+        {
+            job.number = queue.numQueued++;
+        }
+        queue.jobs.insert(queue.jobs.end(), batch.begin(), batch.end());
+    }
+    queue.jobsReady.notify_all();
+    batch.clear();
+}
+
+// Waits for a match to verify. Returns false once there are no more to come.
+static bool takeJob(VerifyQueue &queue, VerifyJob &job)
+{
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.jobsReady.wait(lock, [&]() { return !queue.jobs.empty() || queue.closed; });
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+    job = queue.jobs.front();
+    queue.jobs.pop_front();
+    lock.unlock();
+    queue.jobsTaken.notify_one();
+    return true;
+}
+
+// Worker thread. Keeps its own reader open on the file of the last match it verified.
+static void verifyJobs(VerifyQueue &queue)
+{
+    ReplayReader reader = { nullptr, 0, 0, false };
+    const std::string *openFileName = nullptr;
+    ReplayMatchStats stats;
+    VerifyJob job;
+    while (takeJob(queue, job))
+    {
+        if (queue.index != nullptr)
+        {
+            indexFile(queue, job, stats);
+            continue;
+        }
+        if (job.fileName != openFileName)
+        {
+            closeReplayFile(reader);
+            openReplayFile(job.fileName->c_str(), reader);
+            openFileName = job.fileName;
+        }
+
+        ReplayHeader header;
+        ReplayVerification verification;
+        bool passed;
+        const bool found = reader.file != nullptr && seekReplayMatch(reader, job.offset, header);
+        if (found)
+        {
+            passed = verifyReplayMatch(reader, header, verification, nullptr);
+        }
+        else
+        {
+            memset(&verification, 0, sizeof(verification));
+            verification.failures = VERIFY_CORRUPT;
+            passed = false;
+        }
+
+        countResult(queue, verification, passed);
+        if (!passed)
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            printFailure(*job.fileName, job.offset, verification);
+        }
+    }
+    closeReplayFile(reader);
+}
+
+static void countResult(VerifyQueue &queue, const ReplayVerification &verification, const bool passed)
+{
+    queue.verified++;
+    queue.ticks += verification.ticks;
+    if (verification.cutOff)
+    {
+        queue.cutOff++;
+    }
+    if (!passed)
+    {
+        queue.failed++;
+    }
+}
+
+// Plays back every match in the job's file for the index, reading it once from start to end.
+static void indexFile(VerifyQueue &queue, const VerifyJob &job, ReplayMatchStats &stats)
+{
+    IndexedResult result;
+    memset(&result.match, 0, sizeof(result.match));
+    result.endOfFile = false;
+    uint32_t matchNumber = 0;
+    ReplayReader reader;
+    if (openReplayFile(job.fileName->c_str(), reader))
+    {
+        ReplayHeader header;
+        while (nextReplayMatch(reader, header))
+        {
+            ReplayVerification verification;
+            const bool passed = verifyReplayMatch(reader, header, verification, &stats);
+            countResult(queue, verification, passed);
+
+            IndexedMatch &indexed = result.match;
+            memset(&indexed, 0, sizeof(indexed));
+            indexed.file = job.file;
+            indexed.offset = reader.matchOffset;
+            indexed.seed = header.seed;
+            indexed.startTime = header.startTime;
+            indexed.flags = header.flags;
+            indexed.result = verification.result;
+            indexed.score = verification.score;
+            indexed.ticks = verification.ticks;
+            indexed.moves = static_cast<uint16_t>(std::min<size_t>(stats.moves.size(), UINT16_MAX));
+            indexed.maxChain = stats.maxChain;
+            indexed.garbageSent = verification.garbage;
+            indexed.garbageReceived = stats.garbageReceived;
+            indexed.endGhosts = stats.endGhosts;
+            indexed.ghostTopOut = stats.ghostTopOut ? 1 : 0;
+            // Bubbles sent are left to --verify, as version 1 replays don't record them.
+            indexed.mismatch = (verification.failures & ~VERIFY_GARBAGE) != 0 ? 1 : 0;
+            result.moves.swap(stats.moves);
+            writeIndexed(queue, IndexKey(job.number, matchNumber++), result);
+        }
+        closeReplayFile(reader);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        std::cout << "Failed to open replay file " << *job.fileName << std::endl;
+    }
+
+    // Lets the files queued after this one be written.
+    result.endOfFile = true;
+    result.moves.clear();
+    writeIndexed(queue, IndexKey(job.number, matchNumber), result);
+}
+
+// Adds the match to the index once every match queued before it has been, along with any that were waiting on it.
+static void writeIndexed(VerifyQueue &queue, const IndexKey key, IndexedResult &result)
+{
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    IndexOutput &index = *queue.index;
+    // Don't get too far ahead of the match holding up the index. Files are taken in order and their matches written in
+    // order, so the worker on that one never waits here.
+    queue.indexWritten.wait(lock, [&]() { return index.waiting.size() < queue.maxBacklog || key == index.next; });
+    const IndexKey first = index.next;
+    IndexedResult &waiting = index.waiting[key];
+    waiting.match = result.match;
+    waiting.moves.swap(result.moves);
+    waiting.endOfFile = result.endOfFile;
+    std::map<IndexKey, IndexedResult>::iterator next;
+    while ((next = index.waiting.find(index.next)) != index.waiting.end())
+    {
+        if (next->second.endOfFile)
+        {
+            index.next = IndexKey(index.next.first + 1, 0);
+        }
+        else
+        {
+            const uint64_t row = addIndexedMatch(next->second.match);
+            for (const IndexedMove &move : next->second.moves)
+            {
+                addIndexedMove(static_cast<uint32_t>(row), move);
+            }
+            index.next.second++;
+        }
+        index.waiting.erase(next);
+    }
+    if (index.next != first)
+    {
+        lock.unlock();
+        queue.indexWritten.notify_all();
+    }
+}
+
+// Progress thread. Prints the rate over the last report period and how many matches are waiting.
+static void reportProgress(VerifyQueue &queue)
+{
+    uint64_t lastVerified = 0;
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    while (!queue.finished.wait_for(lock, std::chrono::duration<double>(VERIFY_REPORT_SECONDS), [&]() { return queue.done; }))
+    {
+        const uint64_t verified = queue.verified;
+        std::cout << (queue.index != nullptr ? "Indexed " : "Verified ") << verified << " (" << (verified - lastVerified) / VERIFY_REPORT_SECONDS << " matches/s), backlog "
+            << queue.jobs.size() << ", failed " << queue.failed << std::endl;
+        lastVerified = verified;
+    }
+}
+
+static void printFailure(const std::string &fileName, const uint64_t offset, const ReplayVerification &verification)
+{
+    std::cout << "FAILED " << fileName << " @" << offset << ":";
+    if (verification.failures & VERIFY_RULES)
+    {
+        std::cout << " recorded with different rules";
+    }
+    if (verification.failures & VERIFY_CORRUPT)
+    {
+        std::cout << " corrupt";
+    }
+    if (verification.failures & VERIFY_SCORE)
+    {
+        std::cout << " score " << verification.score << " (claimed " << verification.claimedScore << ")";
+    }
+    if (verification.failures & VERIFY_RESULT)
+    {
+        std::cout << " result " << verification.result << " at tick " << verification.ticks << " (claimed " << verification.claimedResult << ")";
+    }
+    if (verification.failures & VERIFY_GARBAGE)
+    {
+        std::cout << " bubbles sent " << verification.garbage << " (claimed " << verification.claimedGarbage;
+        if (verification.garbageMismatchTick != UINT32_MAX)
+        {
+            std::cout << ", first wrong on tick " << verification.garbageMismatchTick;
+        }
+        std::cout << ")";
+    }
+    std::cout << std::endl;
+}
+
+// Follows the state machine through one tick to find where each move starts and ends.
+static void watchTick(const MatchState &match, const GameState previousState, MoveWatch &watch, ReplayMatchStats &stats)
+{
+    if (previousState == GameState::BUBBLE_SPAWN && match.state == GameState::PLAYER_CONTROL)
+    {
+        memset(&watch.move, 0, sizeof(watch.move));
+        watch.move.tick = match.tick - 1;
+        watch.started = true;
+        watch.startScore = match.score;
+        watch.startGarbage = match.garbageSent;
+    }
+    else if (previousState == GameState::SCAN_FOR_VICTIMS && match.state == GameState::ANIMATE_DEATHS)
+    {
+        watch.move.chain++;
+    }
+    if (previousState != GameState::GAME_OVER && match.state == GameState::GAME_OVER)
+    {
+        // The bubble that ended the game is on the top row.
+        for (uint8_t col = 0; col < MODE_GRIDS[match.mode].columns; col++)
+        {
+            if (cellState(match.grid[col][0]) != BubbleState::DEAD && cellColor(match.grid[col][0]) == GHOST)
+            {
+                stats.ghostTopOut = true;
+            }
+        }
+    }
+    if (match.state == GameState::BUBBLE_SPAWN || match.state == GameState::GAME_OVER || match.state == GameState::WIN)
+    {
+        endMove(match, watch, stats);
+    }
+}
+
+static void endMove(const MatchState &match, MoveWatch &watch, ReplayMatchStats &stats)
+{
+    if (!watch.started)
+    {
+        return;
+    }
+    Board board;
+    boardFromGrid(match.grid, match.mode, board);
+    for (uint8_t col = 0; col < MODE_GRIDS[board.mode].columns; col++)
+    {
+        watch.move.height = std::max(watch.move.height, columnHeight(board, col));
+    }
+    watch.move.score = static_cast<uint16_t>(std::min<uint32_t>(match.score - watch.startScore, UINT16_MAX));
+    watch.move.garbage = static_cast<uint8_t>(std::min<uint16_t>(match.garbageSent - watch.startGarbage, UINT8_MAX));
+    stats.maxChain = std::max(stats.maxChain, watch.move.chain);
+    stats.moves.push_back(watch.move);
+    watch.started = false;
+}
@@ -0,0 +1,75 @@
+#ifndef REPLAY_VERIFY_H
+#define REPLAY_VERIFY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "replay.h"
+#include "replay_index.h"
+
+/* Replay verification.
+ *
+ * Plays a recorded match again from its inputs, with no window or network, and checks that the score,
+ * the result and every batch of bubbles sent to the other player come out the same as the client said.
+ * Each match is simulated in its own MatchState, so any number can be verified at once on separate threads.
+ * Building the replay index is the same playback with stats gathered along the way, so it runs on the same workers.
+ */
+
+// Bits of ReplayVerification::failures.
+const uint8_t VERIFY_SCORE = 1 << 0;
+const uint8_t VERIFY_RESULT = 1 << 1;
+// The client claimed to send bubbles the match didn't produce (or didn't claim ones it did).
+const uint8_t VERIFY_GARBAGE = 1 << 2;
+// Recorded under different rules, so it can't be checked.
+const uint8_t VERIFY_RULES = 1 << 3;
+// The file is damaged or the match has no records.
+const uint8_t VERIFY_CORRUPT = 1 << 4;
+
+// Time between progress reports from runReplayVerifier.
+const double VERIFY_REPORT_SECONDS = 1.0;
+
+struct ReplayVerification
+{
+    uint8_t failures;
+    // The recording was cut off before its end record, so there was no final score or result to check.
+    bool cutOff;
+    uint32_t ticks;
+    // As recorded by the client.
+    uint32_t claimedScore;
+    ReplayResult claimedResult;
+    uint16_t claimedGarbage;
+    // As played back.
+    uint32_t score;
+    ReplayResult result;
+    uint16_t garbage;
+    // First tick the bubbles sent stopped adding up.
+    uint32_t garbageMismatchTick;
+};
+
+// What the replay index keeps about a match besides its verification.
+struct ReplayMatchStats
+{
+    std::vector<IndexedMove> moves;
+    uint8_t maxChain;
+    uint16_t garbageReceived;
+    // Ghost bubbles on the board when the match ended.
+    uint8_t endGhosts;
+    bool ghostTopOut;
+};
+
+/*
+ * Plays the match the reader has just moved to (with nextReplayMatch or seekReplayMatch) to its end. Returns true if nothing failed.
+ * Fills in stats too when it isn't null.
+**/
+bool verifyReplayMatch(ReplayReader &reader, const ReplayHeader &header, ReplayVerification &verification, ReplayMatchStats *stats = nullptr);
+
+/*
+ * Verifies every match in the replay files on numThreads threads, printing each one that fails and, while
+ * running, the rate and the number of matches waiting. With no files, file names are read from stdin one
+ * per line until it closes, so uploads can be piped in as they arrive. Returns the number of matches that failed.
+**/
+uint64_t runReplayVerifier(const std::vector<std::string> &replayFiles, const uint32_t numThreads);
+// Plays back every match in the replay files on numThreads threads and writes their stats to a new index. Returns false if it couldn't be written.
+bool runReplayIndexer(const char *indexFile, const std::vector<std::string> &replayFiles, const uint32_t numThreads);
+
+#endif
@@ -7,21 +7,84 @@
 ** option) any later version.
 ******************************************************************/
 #include "resource_manager.h"
+#include "texture_compress.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <string.h>
+#include <chrono>
 
 #include <SOIL.h>
 
 // Instantiate static variables
 std::map<std::string, Texture2D>    ResourceManager::Textures;
 std::map<std::string, Shader>       ResourceManager::Shaders;
+std::map<std::string, AtlasRegion>  ResourceManager::Regions;
+std::vector<ResourceManager::QueuedImage> ResourceManager::Queued;
+std::vector<ResourceManager::PendingTexture> ResourceManager::Pending;
+GLuint ResourceManager::UploadBuffer = 0;
 
+// Stands in for images that are still loading.
+static const std::string PLACEHOLDER_TEXTURE = "placeholder";
 
-Shader ResourceManager::LoadShader(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, std::string name)
+// Largest atlas to build, if the GPU allows it. Images bigger than this get an atlas of their own.
+static const GLint ATLAS_MAX_SIZE = 2048;
+// Pixels around each packed image, filled by repeating its edges so filtering never picks up a neighbour.
+static const GLuint ATLAS_PADDING = 1;
+
+// Linked programs are saved here, one file per shader name.
+static const std::string PROGRAM_CACHE_DIR = "../cache/";
+static const char PROGRAM_CACHE_MAGIC[4] = { 'S', 'B', 'P', 'C' };
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+// Far bigger than any real program binary. Anything claiming more is a damaged file.
+static const uint32_t PROGRAM_CACHE_MAX_LENGTH = 16 * 1024 * 1024;
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+// Start of a program cache file, followed by Length bytes of program binary.
+struct ProgramCacheHeader
+{
+    char Magic[4];
+    uint32_t Version;
+    // Hash of the shader source and the driver that compiled it
+    uint64_t Key;
+    GLenum Format;
+    uint32_t Length;
+};
+
+// The top edge of the packed images over one span of an atlas, for skyline packing.
+struct SkylineSpan
+{
+    GLuint X, Y, Width;
+};
+
+// An atlas being packed.
+struct AtlasBin
+{
+    std::vector<SkylineSpan> Skyline;
+    std::vector<unsigned char> Pixels;
+    GLuint Size;
+    GLuint UsedWidth, UsedHeight;
+};
+
+// Where an image was put by BuildAtlases.
+struct AtlasPlacement
+{
+    size_t Bin;
+    GLuint X, Y;
+};
+
+static bool findSkylinePosition(const AtlasBin &bin, GLuint width, GLuint height, size_t &span, GLuint &x, GLuint &y);
+static void addSkylineSpan(AtlasBin &bin, size_t span, GLuint x, GLuint y, GLuint width, GLuint height);
+static uint64_t hashString(uint64_t hash, const GLchar *string);
+static void copyIntoAtlas(AtlasBin &bin, const std::vector<unsigned char> &pixels, GLuint width, GLuint height, GLuint x, GLuint y);
+
+
+Shader ResourceManager::LoadShader(const GLchar *vShaderSource, const GLchar *fShaderSource, const GLchar *gShaderSource, std::string name)
 {
-    Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile);
+    Shaders[name] = loadShaderFromSource(vShaderSource, fShaderSource, gShaderSource, name);
     return Shaders[name];
 }
 
@@ -41,6 +104,200 @@ Texture2D ResourceManager::GetTexture(std::string name)
     return Textures[name];
 }
 
+void ResourceManager::LoadTextureAsync(const GLchar *file, GLboolean alpha, std::string name)
+{
+    if (Textures.find(PLACEHOLDER_TEXTURE) == Textures.end())
+    {
+        const unsigned char black[4] = { 0, 0, 0, 255 };
+        Texture2D placeholder;
+        placeholder.Internal_Format = GL_RGBA;
+        placeholder.Image_Format = GL_RGBA;
+        placeholder.Generate(1, 1, const_cast<unsigned char*>(black));
+        Textures[PLACEHOLDER_TEXTURE] = placeholder;
+    }
+    AtlasRegion region;
+    region.Texture = Textures[PLACEHOLDER_TEXTURE];
+    region.Origin = glm::vec2(0.0f, 0.0f);
+    region.Size = glm::vec2(1.0f, 1.0f);
+    region.CellSize = region.Size;
+    Regions[name] = region;
+
+    PendingTexture pending;
+    pending.Name = name;
+    pending.Alpha = alpha;
+    pending.Decode = std::async(std::launch::async, decodeImage, std::string(file), alpha, GLEW_EXT_texture_compression_s3tc ? GL_TRUE : GL_FALSE);
+    Pending.push_back(std::move(pending));
+}
+
+GLuint ResourceManager::UpdateTextureLoads()
+{
+    GLuint uploaded = 0;
+    for (auto iter = Pending.begin(); iter != Pending.end();)
+    {
+        if (iter->Decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++iter;
+            continue;
+        }
+        uploadTexture(iter->Name, iter->Alpha, iter->Decode.get());
+        iter = Pending.erase(iter);
+        uploaded++;
+    }
+    return uploaded;
+}
+
+void ResourceManager::FinishTextureLoads()
+{
+    for (PendingTexture &pending : Pending)
+    {
+        uploadTexture(pending.Name, pending.Alpha, pending.Decode.get());
+    }
+    Pending.clear();
+}
+
+GLboolean ResourceManager::IsTextureLoaded(std::string name)
+{
+    for (const PendingTexture &pending : Pending)
+    {
+        if (pending.Name == name)
+        {
+            return GL_FALSE;
+        }
+    }
+    return Textures.find(name) != Textures.end();
+}
+
+void ResourceManager::QueueAtlasImage(const GLchar *file, GLboolean alpha, std::string name, GLuint columns, GLuint rows)
+{
+    // Decoded in the background. BuildAtlases waits for it.
+    QueuedImage image;
+    image.Name = name;
+    image.Width = 0;
+    image.Height = 0;
+    image.Columns = columns;
+    image.Rows = rows;
+    // Atlases are packed from pixels, so never compressed.
+    image.Decode = std::async(std::launch::async, decodeImage, std::string(file), alpha, GL_FALSE);
+    Queued.push_back(std::move(image));
+}
+
+void ResourceManager::QueueAtlasPixels(std::string name, GLuint width, GLuint height, const unsigned char *pixels, GLuint columns, GLuint rows)
+{
+    QueuedImage image;
+    image.Name = name;
+    image.Width = width;
+    image.Height = height;
+    image.Columns = columns;
+    image.Rows = rows;
+    image.Pixels.assign(pixels, pixels + width * height * 4);
+    Queued.push_back(std::move(image));
+}
+
+void ResourceManager::BuildAtlases()
+{
+    GLint maxSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const GLuint atlasSize = std::min(maxSize, ATLAS_MAX_SIZE);
+
+    // Collect the images still decoding, dropping any that failed.
+    for (auto iter = Queued.begin(); iter != Queued.end();)
+    {
+        if (iter->Decode.valid())
+        {
+            DecodedImage decoded = iter->Decode.get();
+            if (decoded.Pixels.empty())
+            {
+                iter = Queued.erase(iter);
+                continue;
+            }
+            iter->Width = decoded.Width;
+            iter->Height = decoded.Height;
+            iter->Pixels.swap(decoded.Pixels);
+        }
+        ++iter;
+    }
+
+    // Tallest first packs best with a skyline.
+    std::vector<QueuedImage*> images;
+    for (QueuedImage &image : Queued)
+    {
+        images.push_back(&image);
+    }
+    std::stable_sort(images.begin(), images.end(), [](const QueuedImage *a, const QueuedImage *b) { return a->Height > b->Height; });
+
+    std::vector<AtlasBin> bins;
+    // Which bin each image went in and where.
+    std::map<std::string, AtlasPlacement> placements;
+    for (QueuedImage *image : images)
+    {
+        const GLuint paddedWidth = image->Width + ATLAS_PADDING * 2;
+        const GLuint paddedHeight = image->Height + ATLAS_PADDING * 2;
+        size_t binIndex = 0;
+        size_t span = 0;
+        GLuint x = 0, y = 0;
+        for (; binIndex < bins.size(); binIndex++)
+        {
+            if (findSkylinePosition(bins[binIndex], paddedWidth, paddedHeight, span, x, y))
+            {
+                break;
+            }
+        }
+        if (binIndex == bins.size())
+        {
+            AtlasBin bin;
+            bin.Size = std::max(atlasSize, std::max(paddedWidth, paddedHeight));
+            bin.Skyline.push_back({ 0, 0, bin.Size });
+            bin.Pixels.resize(bin.Size * bin.Size * 4, 0);
+            bin.UsedWidth = 0;
+            bin.UsedHeight = 0;
+            bins.push_back(bin);
+            findSkylinePosition(bins.back(), paddedWidth, paddedHeight, span, x, y);
+        }
+        AtlasBin &bin = bins[binIndex];
+        addSkylineSpan(bin, span, x, y, paddedWidth, paddedHeight);
+        copyIntoAtlas(bin, image->Pixels, image->Width, image->Height, x + ATLAS_PADDING, y + ATLAS_PADDING);
+        bin.UsedWidth = std::max(bin.UsedWidth, x + paddedWidth);
+        bin.UsedHeight = std::max(bin.UsedHeight, y + paddedHeight);
+        placements[image->Name] = { binIndex, x + ATLAS_PADDING, y + ATLAS_PADDING };
+    }
+
+    // Only the used part of each bin is uploaded.
+    std::vector<Texture2D> atlases;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (size_t i = 0; i < bins.size(); i++)
+    {
+        Texture2D texture;
+        texture.Internal_Format = GL_RGBA;
+        texture.Image_Format = GL_RGBA;
+        texture.Wrap_S = GL_CLAMP_TO_EDGE;
+        texture.Wrap_T = GL_CLAMP_TO_EDGE;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, bins[i].Size);
+        texture.Generate(bins[i].UsedWidth, bins[i].UsedHeight, bins[i].Pixels.data());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        Textures["atlas" + std::to_string(i)] = texture;
+        atlases.push_back(texture);
+    }
+
+    for (const QueuedImage &image : Queued)
+    {
+        const AtlasPlacement &placement = placements[image.Name];
+        const Texture2D &atlas = atlases[placement.Bin];
+        AtlasRegion region;
+        region.Texture = atlas;
+        region.Origin = glm::vec2(static_cast<float>(placement.X) / atlas.Width, static_cast<float>(placement.Y) / atlas.Height);
+        region.Size = glm::vec2(static_cast<float>(image.Width) / atlas.Width, static_cast<float>(image.Height) / atlas.Height);
+        region.CellSize = glm::vec2(region.Size.x / image.Columns, region.Size.y / image.Rows);
+        Regions[image.Name] = region;
+    }
+    std::cout << Queued.size() << " images packed into " << bins.size() << " atlases" << std::endl;
+    Queued.clear();
+}
+
+AtlasRegion ResourceManager::GetRegion(std::string name)
+{
+    return Regions[name];
+}
+
 void ResourceManager::Clear()
 {
     // (Properly) delete all shaders	
@@ -49,52 +306,150 @@ void ResourceManager::Clear()
     // (Properly) delete all textures
     for (auto iter : Textures)
         glDeleteTextures(1, &iter.second.ID);
+    // Let any decodes still running finish, as they can't be cancelled
+    Pending.clear();
+    if (UploadBuffer != 0)
+    {
+        glDeleteBuffers(1, &UploadBuffer);
+        UploadBuffer = 0;
+    }
 }
 
-Shader ResourceManager::loadShaderFromFile(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile)
-{
-    // 1. Retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::string geometryCode;
-    try
-    {
-        // Open files
-        std::ifstream vertexShaderFile(vShaderFile);
-        std::ifstream fragmentShaderFile(fShaderFile);
-        std::stringstream vShaderStream, fShaderStream;
-        // Read file's buffer contents into streams
-        vShaderStream << vertexShaderFile.rdbuf();
-        fShaderStream << fragmentShaderFile.rdbuf();
-        // close file handlers
-        vertexShaderFile.close();
-        fragmentShaderFile.close();
-        // Convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-        // If geometry shader path is present, also load a geometry shader
-        if (gShaderFile != nullptr)
-        {
-            std::ifstream geometryShaderFile(gShaderFile);
-            std::stringstream gShaderStream;
-            gShaderStream << geometryShaderFile.rdbuf();
-            geometryShaderFile.close();
-            geometryCode = gShaderStream.str();
-        }
-    }
-    catch (std::exception e)
-    {
-        std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
-    }
-    const GLchar *vShaderCode = vertexCode.c_str();
-    const GLchar *fShaderCode = fragmentCode.c_str();
-    const GLchar *gShaderCode = geometryCode.c_str();
-    // 2. Now create shader object from source code
+Shader ResourceManager::loadShaderFromSource(const GLchar *vShaderSource, const GLchar *fShaderSource, const GLchar *gShaderSource, const std::string &name)
+{
+    // 1. The cached binary is only good for the same source on the same driver
+    const GLchar *keyStrings[] = { vShaderSource, fShaderSource, gShaderSource != nullptr ? gShaderSource : "",
+        reinterpret_cast<const GLchar*>(glGetString(GL_VENDOR)), reinterpret_cast<const GLchar*>(glGetString(GL_RENDERER)),
+        reinterpret_cast<const GLchar*>(glGetString(GL_VERSION)) };
+    uint64_t key = FNV_OFFSET_BASIS;
+    for (const GLchar *keyString : keyStrings)
+    {
+        key = hashString(key, keyString != nullptr ? keyString : "");
+    }
+    const std::string cacheFile = PROGRAM_CACHE_DIR + name + ".bin";
+
+    // 2. Try the cache
     Shader shader;
-    shader.Compile(vShaderCode, fShaderCode, gShaderFile != nullptr ? gShaderCode : nullptr);
+    std::ifstream cached(cacheFile, std::ios::binary);
+    ProgramCacheHeader header;
+    if (cached.read(reinterpret_cast<char*>(&header), sizeof(header)) && memcmp(header.Magic, PROGRAM_CACHE_MAGIC, sizeof(header.Magic)) == 0
+        && header.Version == PROGRAM_CACHE_VERSION && header.Key == key && header.Length <= PROGRAM_CACHE_MAX_LENGTH)
+    {
+        std::vector<unsigned char> binary(header.Length);
+        if (cached.read(reinterpret_cast<char*>(binary.data()), binary.size())
+            && shader.LoadBinary(header.Format, binary.data(), static_cast<GLsizei>(binary.size())))
+        {
+            return shader;
+        }
+    }
+    cached.close();
+
+    // 3. Compile from source, and save the result for next time
+    shader.Compile(vShaderSource, fShaderSource, gShaderSource);
+    std::vector<unsigned char> binary;
+    if (shader.GetBinary(header.Format, binary))
+    {
+        memcpy(header.Magic, PROGRAM_CACHE_MAGIC, sizeof(header.Magic));
+        header.Version = PROGRAM_CACHE_VERSION;
+        header.Key = key;
+        header.Length = static_cast<uint32_t>(binary.size());
+        std::ofstream file(cacheFile, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+            || !file.write(reinterpret_cast<const char*>(binary.data()), binary.size()))
+        {
+            std::cout << "ERROR::SHADER: Failed to write " << cacheFile << std::endl;
+        }
+    }
     return shader;
 }
 
+ResourceManager::DecodedImage ResourceManager::decodeImage(std::string file, GLboolean alpha, GLboolean compressed)
+{
+    DecodedImage decoded;
+    decoded.CompressedFormat = 0;
+    CompressedImage ktx;
+    if (compressed && readKtx(ktxFileName(file).c_str(), ktx))
+    {
+        decoded.Width = ktx.width;
+        decoded.Height = ktx.height;
+        decoded.Pixels.swap(ktx.data);
+        decoded.CompressedFormat = ktx.format;
+        decoded.LevelSizes.swap(ktx.levelSizes);
+        return decoded;
+    }
+    int width, height;
+    // Always RGBA, so every image can share an atlas.
+    unsigned char* image = SOIL_load_image(file.c_str(), &width, &height, 0, SOIL_LOAD_RGBA);
+    if (!image)
+    {
+        std::cout << "ERROR::TEXTURE: Failed to load " << file << std::endl;
+        decoded.Width = 0;
+        decoded.Height = 0;
+        return decoded;
+    }
+    if (!alpha)
+    {
+        for (int i = 0; i < width * height; i++)
+        {
+            image[i * 4 + 3] = 255;
+        }
+    }
+    decoded.Width = width;
+    decoded.Height = height;
+    decoded.Pixels.assign(image, image + width * height * 4);
+    SOIL_free_image_data(image);
+    return decoded;
+}
+
+void ResourceManager::uploadTexture(const std::string &name, GLboolean alpha, const DecodedImage &image)
+{
+    if (image.Pixels.empty())
+    {
+        return;
+    }
+    if (UploadBuffer == 0)
+    {
+        glGenBuffers(1, &UploadBuffer);
+    }
+    // The copy into the buffer is all that happens here. The driver moves it into the texture without stalling the frame.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, UploadBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, image.Pixels.size(), nullptr, GL_STREAM_DRAW);
+    void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.Pixels.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != nullptr)
+    {
+        memcpy(mapped, image.Pixels.data(), image.Pixels.size());
+    }
+    if (mapped == nullptr || !glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+    {
+        // Mapping failed, or the buffer was lost while mapped. Upload straight from memory instead.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    Texture2D texture;
+    texture.Internal_Format = alpha ? GL_RGBA : GL_RGB;
+    texture.Image_Format = GL_RGBA;
+    texture.Wrap_S = GL_CLAMP_TO_EDGE;
+    texture.Wrap_T = GL_CLAMP_TO_EDGE;
+    GLint bound;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &bound);
+    // With the buffer bound the data pointer is an offset into it.
+    unsigned char *data = bound != 0 ? nullptr : const_cast<unsigned char*>(image.Pixels.data());
+    if (image.CompressedFormat != 0)
+    {
+        texture.Internal_Format = image.CompressedFormat;
+        texture.GenerateCompressed(image.Width, image.Height, static_cast<GLuint>(image.LevelSizes.size()), data, image.LevelSizes.data());
+    }
+    else
+    {
+        texture.Generate(image.Width, image.Height, data);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    Textures[name] = texture;
+    AtlasRegion &region = Regions[name];
+    region.Texture = texture;
+}
+
 Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alpha)
 {
     // Create Texture object
@@ -118,4 +473,97 @@ Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alp
         SOIL_free_image_data(image);
         return texture;
     }
-}
\ No newline at end of file
+}
+
+// Finds the lowest place along the skyline a width x height rectangle fits, leftmost on a tie.
+static bool findSkylinePosition(const AtlasBin &bin, GLuint width, GLuint height, size_t &span, GLuint &x, GLuint &y)
+{
+    bool found = false;
+    for (size_t i = 0; i < bin.Skyline.size(); i++)
+    {
+        const GLuint left = bin.Skyline[i].X;
+        if (left + width > bin.Size)
+        {
+            break;
+        }
+        // Resting on the highest span under it.
+        GLuint top = 0;
+        for (size_t j = i; j < bin.Skyline.size() && bin.Skyline[j].X < left + width; j++)
+        {
+            top = std::max(top, bin.Skyline[j].Y);
+        }
+        if (top + height <= bin.Size && (!found || top < y))
+        {
+            found = true;
+            span = i;
+            x = left;
+            y = top;
+        }
+    }
+    return found;
+}
+
+// Raises the skyline over a newly placed rectangle.
+static void addSkylineSpan(AtlasBin &bin, size_t span, GLuint x, GLuint y, GLuint width, GLuint height)
+{
+    std::vector<SkylineSpan> &skyline = bin.Skyline;
+    skyline.insert(skyline.begin() + span, { x, y + height, width });
+    // Trim or remove the spans now underneath it.
+    const GLuint right = x + width;
+    size_t i = span + 1;
+    while (i < skyline.size() && skyline[i].X < right)
+    {
+        const GLuint spanRight = skyline[i].X + skyline[i].Width;
+        if (spanRight <= right)
+        {
+            skyline.erase(skyline.begin() + i);
+        }
+        else
+        {
+            skyline[i].Width = spanRight - right;
+            skyline[i].X = right;
+            break;
+        }
+    }
+    // Join neighbours at the same height.
+    for (i = 0; i + 1 < skyline.size();)
+    {
+        if (skyline[i].Y == skyline[i + 1].Y)
+        {
+            skyline[i].Width += skyline[i + 1].Width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+// Copies an image into the atlas at x, y and repeats its edge pixels into the padding around it.
+static void copyIntoAtlas(AtlasBin &bin, const std::vector<unsigned char> &pixels, GLuint width, GLuint height, GLuint x, GLuint y)
+{
+    const GLuint stride = bin.Size * 4;
+    for (GLuint row = 0; row < height + ATLAS_PADDING * 2; row++)
+    {
+        const GLuint sourceRow = std::min(std::max(row, ATLAS_PADDING) - ATLAS_PADDING, height - 1);
+        unsigned char *destination = &bin.Pixels[(y + row - ATLAS_PADDING) * stride + (x - ATLAS_PADDING) * 4];
+        const unsigned char *source = &pixels[sourceRow * width * 4];
+        for (GLuint i = 0; i < ATLAS_PADDING; i++)
+        {
+            memcpy(destination + i * 4, source, 4);
+            memcpy(destination + (ATLAS_PADDING + width + i) * 4, source + (width - 1) * 4, 4);
+        }
+        memcpy(destination + ATLAS_PADDING * 4, source, width * 4);
+    }
+}
+
+// FNV-1a, including the terminator so that the strings hashed one after another can't run together.
+static uint64_t hashString(uint64_t hash, const GLchar *string)
+{
+    do
+    {
+        hash = (hash ^ static_cast<unsigned char>(*string)) * FNV_PRIME;
+    } while (*string++ != '\0');
+    return hash;
+}
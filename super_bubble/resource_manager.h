@@ -11,13 +11,29 @@
 
 #include <map>
 #include <string>
+#include <vector>
+#include <future>
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
 
 #include "texture.h"
 #include "shader.h"
 
 
+// Where an image was packed into an atlas. UVs have 0,0 at the top left of the atlas.
+struct AtlasRegion
+{
+    // The atlas texture holding the image
+    Texture2D Texture;
+    // UV of the top left of the image
+    glm::vec2 Origin;
+    // UV size of the whole image
+    glm::vec2 Size;
+    // UV size of one cell, for images that are a grid of animation frames
+    glm::vec2 CellSize;
+};
+
 // A static singleton ResourceManager class that hosts several
 // functions to load Textures and Shaders. Each loaded texture
 // and/or shader is also stored for future reference by string
@@ -29,23 +45,75 @@ public:
     // Resource storage
     static std::map<std::string, Shader>    Shaders;
     static std::map<std::string, Texture2D> Textures;
-    // Loads (and generates) a shader program from file loading vertex, fragment (and geometry) shader's source code. If gShaderFile is not nullptr, it also loads a geometry shader
-    static Shader   LoadShader(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, std::string name);
+    static std::map<std::string, AtlasRegion> Regions;
+    // Generates a shader program from vertex, fragment (and geometry) shader source code. If gShaderSource is not nullptr, it also compiles a geometry shader.
+    // The linked program is cached on disk and loaded from there on later runs, until the source or the driver changes
+    static Shader   LoadShader(const GLchar *vShaderSource, const GLchar *fShaderSource, const GLchar *gShaderSource, std::string name);
     // Retrieves a stored sader
     static Shader   GetShader(std::string name);
     // Loads (and generates) a texture from file
     static Texture2D LoadTexture(const GLchar *file, GLboolean alpha, std::string name);
     // Retrieves a stored texture
     static Texture2D GetTexture(std::string name);
+    // Starts decoding an image on a worker thread, from its compressed .ktx when there is one and the GPU supports it. Its region is a placeholder of one black pixel until UpdateTextureLoads uploads it
+    static void      LoadTextureAsync(const GLchar *file, GLboolean alpha, std::string name);
+    // Uploads the images that have finished decoding. Call once a frame on the GL thread. Returns how many were uploaded
+    static GLuint    UpdateTextureLoads();
+    // Waits for every image started by LoadTextureAsync and uploads them
+    static void      FinishTextureLoads();
+    // Whether an image started by LoadTextureAsync has been uploaded
+    static GLboolean IsTextureLoaded(std::string name);
+    // Loads an image to be packed into an atlas by BuildAtlases. The image is split into a grid of columns x rows cells
+    static void      QueueAtlasImage(const GLchar *file, GLboolean alpha, std::string name, GLuint columns = 1, GLuint rows = 1);
+    // Queues an image already in memory (RGBA, top row first) to be packed into an atlas by BuildAtlases
+    static void      QueueAtlasPixels(std::string name, GLuint width, GLuint height, const unsigned char *pixels, GLuint columns = 1, GLuint rows = 1);
+    // Packs every queued image into as few textures as will hold them and makes their regions available
+    static void      BuildAtlases();
+    // Retrieves where a queued image was packed
+    static AtlasRegion GetRegion(std::string name);
     // Properly de-allocates all loaded resources
     static void      Clear();
 private:
+    // RGBA pixels decoded from an image file, top row first. No pixels if the file couldn't be read
+    struct DecodedImage
+    {
+        GLuint Width, Height;
+        std::vector<unsigned char> Pixels;
+        // When not 0, Pixels holds mipmap levels of this compressed format instead, from the image's .ktx file
+        GLenum CompressedFormat;
+        std::vector<GLuint> LevelSizes;
+    };
+    // An image waiting for BuildAtlases
+    struct QueuedImage
+    {
+        std::string Name;
+        GLuint Width, Height;
+        GLuint Columns, Rows;
+        std::vector<unsigned char> Pixels;
+        // Set while the image is still being decoded
+        std::future<DecodedImage> Decode;
+    };
+    static std::vector<QueuedImage> Queued;
+    // An image from LoadTextureAsync that hasn't been uploaded yet
+    struct PendingTexture
+    {
+        std::string Name;
+        GLboolean Alpha;
+        std::future<DecodedImage> Decode;
+    };
+    static std::vector<PendingTexture> Pending;
+    // Pixel buffer that decoded images are uploaded through
+    static GLuint UploadBuffer;
     // Private constructor, that is we do not want any actual resource manager objects. Its members and functions should be publicly available (static).
     ResourceManager() { }
-    // Loads and generates a shader from file
-    static Shader    loadShaderFromFile(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile = nullptr);
+    // Loads a shader from the program cache, or compiles it and adds it to the cache
+    static Shader    loadShaderFromSource(const GLchar *vShaderSource, const GLchar *fShaderSource, const GLchar *gShaderSource, const std::string &name);
     // Loads a single texture from file
     static Texture2D loadTextureFromFile(const GLchar *file, GLboolean alpha);
+    // Decodes an image file to RGBA, with the alpha set opaque unless alpha is true. If compressed, reads the image's .ktx instead when there is one. Runs on worker threads
+    static DecodedImage decodeImage(std::string file, GLboolean alpha, GLboolean compressed);
+    // Uploads a decoded image through the pixel buffer and replaces its placeholder
+    static void      uploadTexture(const std::string &name, GLboolean alpha, const DecodedImage &image);
 };
 
 #endif
\ No newline at end of file
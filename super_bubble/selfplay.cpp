@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "selfplay.h"
+#include "board.h"
+#include "evaluator.h"
+
+// Self-play matches are classic, so the board column and the header hold the classic grid.
+typedef ClassicRules SelfPlayRules;
+
+// A match that reaches this many pairs per player is stopped and recorded as unfinished.
+static const uint16_t MAX_MOVES_PER_PLAYER = 1000;
+// Chance (out of 100) that a player makes a random move, so the data covers more than one style of play.
+static const uint32_t RANDOM_MOVE_PERCENT = 5;
+
+struct ColumnSpec
+{
+    // Bytes per row.
+    uint8_t elementSize;
+    SelfPlayEncoding encoding;
+};
+
+static const ColumnSpec COLUMN_SPECS[NUM_SELFPLAY_COLUMNS] =
+{
+    { 4, ENCODING_DELTA_VARINT },            // COLUMN_MATCH
+    { 2, ENCODING_DELTA_VARINT },            // COLUMN_MOVE
+    { 1, ENCODING_XOR_RLE },                 // COLUMN_PLAYER
+    { SelfPlayRules::COLUMNS * SelfPlayRules::ROWS, ENCODING_PLAYER_XOR_RLE }, // COLUMN_BOARD
+    { 1, ENCODING_RAW },                     // COLUMN_PAIR
+    { 1, ENCODING_RAW },                     // COLUMN_NEXT
+    { 1, ENCODING_RLE },                     // COLUMN_ENEMY_BUBBLES
+    { 1, ENCODING_RAW },                     // COLUMN_PLACEMENT
+    { 1, ENCODING_RLE },                     // COLUMN_CHAIN
+    { 4, ENCODING_VARINT },                  // COLUMN_SCORE
+    { 1, ENCODING_RLE },                     // COLUMN_GARBAGE
+    { 1, ENCODING_PLAYER_XOR_RLE }           // COLUMN_RESULT
+};
+
+static const char *COLUMN_NAMES[NUM_SELFPLAY_COLUMNS] = {
+    "match", "move", "player", "board", "pair", "next", "enemy bubbles", "placement", "chain", "score", "garbage", "result"
+};
+static const char *ENCODING_NAMES[] = { "raw", "rle", "varint", "delta varint", "xor rle", "player xor rle" };
+
+// Rows owned by one worker thread until they are written out as a block.
+struct ColumnBuffers
+{
+    std::vector<uint8_t> raw[NUM_SELFPLAY_COLUMNS];
+    uint32_t numRows;
+};
+
+// Shared by all workers. Only touched with the mutex held.
+struct SelfPlayWriter
+{
+    FILE *file;
+    std::mutex mutex;
+    uint64_t offset;
+    uint64_t numRows;
+    std::vector<SelfPlayBlockIndex> index;
+    bool failed;
+};
+
+static void playMatch(const uint32_t matchId, const uint32_t seed, ColumnBuffers &buffers);
+static uint8_t choosePlacement(const Board &board, const std::pair<BubbleColor, BubbleColor> &colors, const uint8_t numEnemyBubbles, uint32_t &rng);
+static void flushBlock(SelfPlayWriter &writer, ColumnBuffers &buffers);
+static SelfPlayEncoding encodeColumn(const std::vector<uint8_t> &raw, const ColumnSpec &spec, const std::vector<uint8_t> &players, std::vector<uint8_t> &out);
+static bool decodeColumn(const std::vector<uint8_t> &in, const SelfPlayColumnChunk &chunk, const ColumnSpec &spec, const std::vector<uint8_t> &players, std::vector<uint8_t> &out);
+static void xorSources(const SelfPlayEncoding encoding, const std::vector<uint8_t> &players, const uint32_t numRows, std::vector<int32_t> &sources);
+static void append(std::vector<uint8_t> &column, const void *data, const size_t size);
+static void writeVarint(std::vector<uint8_t> &out, uint32_t value);
+static bool readVarint(const std::vector<uint8_t> &in, size_t &pos, uint32_t &value);
+static void encodeRle(const std::vector<uint8_t> &raw, std::vector<uint8_t> &out);
+static bool decodeRle(const std::vector<uint8_t> &in, const size_t rawSize, std::vector<uint8_t> &out);
+static bool seekFile(FILE *file, const uint64_t offset);
+
+bool runSelfPlay(const char *outputFile, const uint32_t numMatches, const uint32_t numThreads, const uint32_t seed)
+{
+    SelfPlayWriter writer;
+    writer.file = fopen(outputFile, "wb");
+    if (writer.file == nullptr)
+    {
+        std::cout << "Failed to open " << outputFile << std::endl;
+        return false;
+    }
+
+    SelfPlayFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SELFPLAY_FILE_MAGIC, sizeof(header.magic));
+    header.version = SELFPLAY_VERSION;
+    header.numColumns = NUM_SELFPLAY_COLUMNS;
+    header.gridColumns = SelfPlayRules::COLUMNS;
+    header.gridRows = SelfPlayRules::ROWS;
+    writer.failed = fwrite(&header, sizeof(header), 1, writer.file) != 1;
+    writer.offset = sizeof(header);
+    writer.numRows = 0;
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    std::atomic<uint32_t> nextMatch(0);
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < std::max(numThreads, 1u); i++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            ColumnBuffers buffers;
+            buffers.numRows = 0;
+            for (uint32_t matchId = nextMatch++; matchId < numMatches; matchId = nextMatch++)
+            {
+                playMatch(matchId, seed, buffers);
+                if (buffers.numRows >= SELFPLAY_ROWS_PER_BLOCK)
+                {
+                    flushBlock(writer, buffers);
+                }
+            }
+            flushBlock(writer, buffers);
+        }));
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    SelfPlayFileFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.indexOffset = writer.offset;
+    footer.numRows = writer.numRows;
+    footer.numBlocks = static_cast<uint32_t>(writer.index.size());
+    memcpy(footer.magic, SELFPLAY_INDEX_MAGIC, sizeof(footer.magic));
+    if (!writer.index.empty() && fwrite(writer.index.data(), sizeof(SelfPlayBlockIndex), writer.index.size(), writer.file) != writer.index.size())
+    {
+        writer.failed = true;
+    }
+    if (fwrite(&footer, sizeof(footer), 1, writer.file) != 1)
+    {
+        writer.failed = true;
+    }
+    fclose(writer.file);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Self-play: " << numMatches << " matches, " << writer.numRows << " positions, "
+        << footer.indexOffset << " bytes in " << seconds << "s ("
+        << static_cast<uint64_t>(writer.numRows / std::max(seconds, 0.001) * 60.0) << " positions/min)" << std::endl;
+
+    if (writer.failed)
+    {
+        std::cout << "Failed writing " << outputFile << std::endl;
+    }
+    return !writer.failed;
+}
+
+bool openSelfPlayFile(const char *fileName, SelfPlayReader &reader)
+{
+    reader.blocks.clear();
+    reader.file = fopen(fileName, "rb");
+    if (reader.file == nullptr)
+    {
+        return false;
+    }
+
+    bool ok = fread(&reader.header, sizeof(reader.header), 1, reader.file) == 1
+        && memcmp(reader.header.magic, SELFPLAY_FILE_MAGIC, sizeof(reader.header.magic)) == 0
+        && reader.header.version == SELFPLAY_VERSION
+        && reader.header.numColumns == NUM_SELFPLAY_COLUMNS
+        && reader.header.gridColumns == SelfPlayRules::COLUMNS
+        && reader.header.gridRows == SelfPlayRules::ROWS
+        && fseek(reader.file, -static_cast<long>(sizeof(reader.footer)), SEEK_END) == 0
+        && fread(&reader.footer, sizeof(reader.footer), 1, reader.file) == 1
+        && memcmp(reader.footer.magic, SELFPLAY_INDEX_MAGIC, sizeof(reader.footer.magic)) == 0
+        && seekFile(reader.file, reader.footer.indexOffset);
+    if (ok)
+    {
+        reader.blocks.resize(reader.footer.numBlocks);
+        ok = reader.blocks.empty() || fread(reader.blocks.data(), sizeof(SelfPlayBlockIndex), reader.blocks.size(), reader.file) == reader.blocks.size();
+    }
+    if (!ok)
+    {
+        closeSelfPlayFile(reader);
+    }
+    return ok;
+}
+
+void closeSelfPlayFile(SelfPlayReader &reader)
+{
+    if (reader.file != nullptr)
+    {
+        fclose(reader.file);
+        reader.file = nullptr;
+    }
+    reader.blocks.clear();
+}
+
+bool readSelfPlayColumn(SelfPlayReader &reader, const uint32_t block, const SelfPlayColumn column, std::vector<uint8_t> &rows)
+{
+    if (block >= reader.blocks.size())
+    {
+        return false;
+    }
+    const SelfPlayBlockIndex &index = reader.blocks[block];
+    const SelfPlayColumnChunk &chunk = index.columns[column];
+    const ColumnSpec &spec = COLUMN_SPECS[column];
+    if (chunk.rawSize != index.numRows * spec.elementSize)
+    {
+        return false;
+    }
+
+    // Rows XORed against the same player's previous row need the player column first.
+    std::vector<uint8_t> players;
+    if (chunk.encoding == ENCODING_PLAYER_XOR_RLE && !readSelfPlayColumn(reader, block, COLUMN_PLAYER, players))
+    {
+        return false;
+    }
+    std::vector<uint8_t> encoded(chunk.compressedSize);
+    if (!seekFile(reader.file, chunk.offset) || (!encoded.empty() && fread(encoded.data(), 1, encoded.size(), reader.file) != encoded.size()))
+    {
+        return false;
+    }
+    return decodeColumn(encoded, chunk, spec, players, rows);
+}
+
+bool printSelfPlayStats(const char *fileName)
+{
+    SelfPlayReader reader;
+    if (!openSelfPlayFile(fileName, reader))
+    {
+        std::cout << "Failed to read self-play file " << fileName << std::endl;
+        return false;
+    }
+
+    uint64_t rawSizes[NUM_SELFPLAY_COLUMNS] = {};
+    uint64_t compressedSizes[NUM_SELFPLAY_COLUMNS] = {};
+    uint64_t encodingBlocks[NUM_SELFPLAY_COLUMNS][ENCODING_PLAYER_XOR_RLE + 1] = {};
+    uint64_t numRows = 0;
+    bool ok = true;
+    std::vector<uint8_t> rows;
+    for (uint32_t block = 0; block < reader.blocks.size(); block++)
+    {
+        const SelfPlayBlockIndex &index = reader.blocks[block];
+        ok = ok && index.firstRow == numRows;
+        numRows += index.numRows;
+        for (uint8_t col = 0; col < NUM_SELFPLAY_COLUMNS; col++)
+        {
+            const SelfPlayColumnChunk &chunk = index.columns[col];
+            if (!readSelfPlayColumn(reader, block, static_cast<SelfPlayColumn>(col), rows))
+            {
+                std::cout << "Block " << block << " column " << COLUMN_NAMES[col] << " failed to decode" << std::endl;
+                ok = false;
+                continue;
+            }
+            rawSizes[col] += chunk.rawSize;
+            compressedSizes[col] += chunk.compressedSize;
+            encodingBlocks[col][chunk.encoding]++;
+        }
+    }
+    ok = ok && numRows == reader.footer.numRows;
+
+    std::cout << fileName << ": " << reader.footer.numRows << " positions in " << reader.blocks.size() << " blocks" << std::endl;
+    for (uint8_t col = 0; col < NUM_SELFPLAY_COLUMNS; col++)
+    {
+        std::cout << "  " << COLUMN_NAMES[col] << ": " << compressedSizes[col] << " of " << rawSizes[col] << " bytes ("
+            << (rawSizes[col] > 0 ? 100.0 * compressedSizes[col] / rawSizes[col] : 0.0) << "%)";
+        for (uint8_t encoding = 0; encoding <= ENCODING_PLAYER_XOR_RLE; encoding++)
+        {
+            if (encodingBlocks[col][encoding] > 0)
+            {
+                std::cout << ", " << ENCODING_NAMES[encoding] << " in " << encodingBlocks[col][encoding] << " blocks";
+            }
+        }
+        std::cout << std::endl;
+    }
+    if (!ok)
+    {
+        std::cout << "File is damaged." << std::endl;
+    }
+    closeSelfPlayFile(reader);
+    return ok;
+}
+
+static void playMatch(const uint32_t matchId, const uint32_t seed, ColumnBuffers &buffers)
+{
+    uint32_t rng = (seed ^ (matchId * 0x9E3779B9)) | 1;
+    Board boards[2];
+    uint8_t numEnemyBubbles[2] = { 0, 0 };
+    std::pair<BubbleColor, BubbleColor> colors[2];
+    std::pair<BubbleColor, BubbleColor> nextColors[2];
+    for (uint8_t player = 0; player < 2; player++)
+    {
+        clearBoard(boards[player], MODE_CLASSIC);
+        colors[player] = std::make_pair(randomColor(rng), randomColor(rng));
+        nextColors[player] = std::make_pair(randomColor(rng), randomColor(rng));
+    }
+
+    std::vector<uint8_t> rowPlayers;
+    int8_t loser = -1;
+    for (uint16_t move = 0; move < MAX_MOVES_PER_PLAYER && loser < 0; move++)
+    {
+        for (uint8_t player = 0; player < 2 && loser < 0; player++)
+        {
+            const uint8_t pair = (colors[player].first << 4) | colors[player].second;
+            const uint8_t next = (nextColors[player].first << 4) | nextColors[player].second;
+            append(buffers.raw[COLUMN_MATCH], &matchId, sizeof(matchId));
+            append(buffers.raw[COLUMN_MOVE], &move, sizeof(move));
+            append(buffers.raw[COLUMN_PLAYER], &player, sizeof(player));
+            // Only the played corner of the board storage, a column at a time.
+            for (uint8_t col = 0; col < SelfPlayRules::COLUMNS; col++)
+            {
+                append(buffers.raw[COLUMN_BOARD], boards[player].cells[col], SelfPlayRules::ROWS);
+            }
+            append(buffers.raw[COLUMN_PAIR], &pair, sizeof(pair));
+            append(buffers.raw[COLUMN_NEXT], &next, sizeof(next));
+            append(buffers.raw[COLUMN_ENEMY_BUBBLES], &numEnemyBubbles[player], sizeof(uint8_t));
+
+            uint8_t placement = choosePlacement(boards[player], colors[player], numEnemyBubbles[player], rng);
+            MoveResult result;
+            if (!applyPlacement(boards[player], placementFromIndex(boards[player].mode, placement), colors[player], numEnemyBubbles[player], result))
+            {
+                loser = player;
+            }
+            const uint8_t other = 1 - player;
+            numEnemyBubbles[other] = static_cast<uint8_t>(std::min(numEnemyBubbles[other] + result.garbage, 255));
+
+            append(buffers.raw[COLUMN_PLACEMENT], &placement, sizeof(placement));
+            append(buffers.raw[COLUMN_CHAIN], &result.chain, sizeof(result.chain));
+            append(buffers.raw[COLUMN_SCORE], &result.score, sizeof(result.score));
+            append(buffers.raw[COLUMN_GARBAGE], &result.garbage, sizeof(result.garbage));
+            rowPlayers.push_back(player);
+
+            colors[player] = nextColors[player];
+            nextColors[player] = std::make_pair(randomColor(rng), randomColor(rng));
+        }
+    }
+
+    // The result is only known once the match is over.
+    for (uint8_t player : rowPlayers)
+    {
+        const uint8_t result = loser < 0 ? 2 : (player == loser ? 0 : 1);
+        append(buffers.raw[COLUMN_RESULT], &result, sizeof(result));
+    }
+    buffers.numRows += static_cast<uint32_t>(rowPlayers.size());
+}
+
+// Greedy one pair look ahead: points scored plus the board evaluation, with some noise so matches differ.
+static uint8_t choosePlacement(const Board &board, const std::pair<BubbleColor, BubbleColor> &colors, const uint8_t numEnemyBubbles, uint32_t &rng)
+{
+    if (nextRandom(rng) % 100 < RANDOM_MOVE_PERCENT)
+    {
+        return nextRandom(rng) % numPlacements(board.mode);
+    }
+
+    uint8_t best = 0;
+    int32_t bestValue = INT32_MIN;
+    const uint8_t placements = numPlacements(board.mode);
+    for (uint8_t i = 0; i < placements; i++)
+    {
+        Board next = board;
+        uint8_t enemyBubbles = numEnemyBubbles;
+        MoveResult result;
+        int32_t value = -1000000;
+        if (applyPlacement(next, placementFromIndex(board.mode, i), colors, enemyBubbles, result))
+        {
+            value = static_cast<int32_t>(result.score) + (result.garbage * 50) + evaluateBoard(next);
+        }
+        value += nextRandom(rng) % 32;
+        if (value > bestValue)
+        {
+            bestValue = value;
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void flushBlock(SelfPlayWriter &writer, ColumnBuffers &buffers)
+{
+    if (buffers.numRows == 0)
+    {
+        return;
+    }
+
+    // Compress outside the lock so workers only wait for each other while writing.
+    std::vector<uint8_t> encoded[NUM_SELFPLAY_COLUMNS];
+    SelfPlayBlockIndex block;
+    memset(&block, 0, sizeof(block));
+    block.numRows = buffers.numRows;
+    for (uint8_t col = 0; col < NUM_SELFPLAY_COLUMNS; col++)
+    {
+        block.columns[col].encoding = encodeColumn(buffers.raw[col], COLUMN_SPECS[col], buffers.raw[COLUMN_PLAYER], encoded[col]);
+        block.columns[col].compressedSize = static_cast<uint32_t>(encoded[col].size());
+        block.columns[col].rawSize = static_cast<uint32_t>(buffers.raw[col].size());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        block.firstRow = writer.numRows;
+        for (uint8_t col = 0; col < NUM_SELFPLAY_COLUMNS; col++)
+        {
+            block.columns[col].offset = writer.offset;
+            if (fwrite(encoded[col].data(), 1, encoded[col].size(), writer.file) != encoded[col].size())
+            {
+                writer.failed = true;
+            }
+            writer.offset += encoded[col].size();
+        }
+        writer.numRows += buffers.numRows;
+        writer.index.push_back(block);
+    }
+
+    for (uint8_t col = 0; col < NUM_SELFPLAY_COLUMNS; col++)
+    {
+        buffers.raw[col].clear();
+    }
+    buffers.numRows = 0;
+}
+
+/*
+ * Returns the encoding actually used, which is ENCODING_RAW if the preferred one did not save any space.
+**/
+static SelfPlayEncoding encodeColumn(const std::vector<uint8_t> &raw, const ColumnSpec &spec, const std::vector<uint8_t> &players, std::vector<uint8_t> &out)
+{
+    out.clear();
+    if (spec.encoding == ENCODING_RLE)
+    {
+        encodeRle(raw, out);
+    }
+    else if (spec.encoding == ENCODING_XOR_RLE || spec.encoding == ENCODING_PLAYER_XOR_RLE)
+    {
+        // Matches can end on either player's move, so the same player's last row comes from the player column rather than a fixed stride.
+        std::vector<int32_t> sources;
+        xorSources(spec.encoding, players, static_cast<uint32_t>(raw.size() / spec.elementSize), sources);
+        std::vector<uint8_t> delta(raw);
+        for (size_t row = 0; row < sources.size(); row++)
+        {
+            if (sources[row] >= 0)
+            {
+                for (size_t i = 0; i < spec.elementSize; i++)
+                {
+                    delta[row * spec.elementSize + i] ^= raw[sources[row] * spec.elementSize + i];
+                }
+            }
+        }
+        encodeRle(delta, out);
+    }
+    else if (spec.encoding == ENCODING_VARINT || spec.encoding == ENCODING_DELTA_VARINT)
+    {
+        uint32_t previous = 0;
+        for (size_t i = 0; i + spec.elementSize <= raw.size(); i += spec.elementSize)
+        {
+            uint32_t value = 0;
+            memcpy(&value, &raw[i], spec.elementSize);
+            if (spec.encoding == ENCODING_DELTA_VARINT)
+            {
+                const int32_t delta = static_cast<int32_t>(value - previous);
+                previous = value;
+                value = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+            }
+            writeVarint(out, value);
+        }
+    }
+
+    if (spec.encoding == ENCODING_RAW || out.size() >= raw.size())
+    {
+        out = raw;
+        return ENCODING_RAW;
+    }
+    return spec.encoding;
+}
+
+// Undoes encodeColumn. players is the block's decoded COLUMN_PLAYER, which is only read for ENCODING_PLAYER_XOR_RLE.
+static bool decodeColumn(const std::vector<uint8_t> &in, const SelfPlayColumnChunk &chunk, const ColumnSpec &spec, const std::vector<uint8_t> &players, std::vector<uint8_t> &out)
+{
+    out.clear();
+    switch (chunk.encoding)
+    {
+    case ENCODING_RAW:
+        out = in;
+        return out.size() == chunk.rawSize;
+    case ENCODING_RLE:
+        return decodeRle(in, chunk.rawSize, out);
+    case ENCODING_XOR_RLE:
+    case ENCODING_PLAYER_XOR_RLE:
+    {
+        const uint32_t numRows = chunk.rawSize / spec.elementSize;
+        if (!decodeRle(in, chunk.rawSize, out) || (chunk.encoding == ENCODING_PLAYER_XOR_RLE && players.size() != numRows))
+        {
+            return false;
+        }
+        // Sources always come before the row, so each is decoded by the time it is needed.
+        std::vector<int32_t> sources;
+        xorSources(static_cast<SelfPlayEncoding>(chunk.encoding), players, numRows, sources);
+        for (size_t row = 0; row < sources.size(); row++)
+        {
+            if (sources[row] >= 0)
+            {
+                for (size_t i = 0; i < spec.elementSize; i++)
+                {
+                    out[row * spec.elementSize + i] ^= out[sources[row] * spec.elementSize + i];
+                }
+            }
+        }
+        return true;
+    }
+    case ENCODING_VARINT:
+    case ENCODING_DELTA_VARINT:
+    {
+        uint32_t previous = 0;
+        size_t pos = 0;
+        while (pos < in.size())
+        {
+            uint32_t value;
+            if (!readVarint(in, pos, value) || out.size() + spec.elementSize > chunk.rawSize)
+            {
+                return false;
+            }
+            if (chunk.encoding == ENCODING_DELTA_VARINT)
+            {
+                value = previous + ((value >> 1) ^ (0u - (value & 1)));
+                previous = value;
+            }
+            append(out, &value, spec.elementSize);
+        }
+        return out.size() == chunk.rawSize;
+    }
+    default:
+        return false;
+    }
+}
+
+// For each row, the row it is XORed with, or -1 for none.
+static void xorSources(const SelfPlayEncoding encoding, const std::vector<uint8_t> &players, const uint32_t numRows, std::vector<int32_t> &sources)
+{
+    sources.resize(numRows);
+    int32_t lastRows[2] = { -1, -1 };
+    for (uint32_t row = 0; row < numRows; row++)
+    {
+        if (encoding == ENCODING_XOR_RLE)
+        {
+            sources[row] = static_cast<int32_t>(row) - 1;
+        }
+        else
+        {
+            int32_t &lastRow = lastRows[players[row] & 1];
+            sources[row] = lastRow;
+            lastRow = static_cast<int32_t>(row);
+        }
+    }
+}
+
+static void encodeRle(const std::vector<uint8_t> &raw, std::vector<uint8_t> &out)
+{
+    size_t i = 0;
+    while (i < raw.size())
+    {
+        size_t run = 1;
+        while (i + run < raw.size() && raw[i + run] == raw[i])
+        {
+            run++;
+        }
+        writeVarint(out, static_cast<uint32_t>(run));
+        out.push_back(raw[i]);
+        i += run;
+    }
+}
+
+static void append(std::vector<uint8_t> &column, const void *data, const size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    column.insert(column.end(), bytes, bytes + size);
+}
+
+static void writeVarint(std::vector<uint8_t> &out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool readVarint(const std::vector<uint8_t> &in, size_t &pos, uint32_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; shift < 32 && pos < in.size(); shift += 7)
+    {
+        const uint8_t byte = in[pos++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool decodeRle(const std::vector<uint8_t> &in, const size_t rawSize, std::vector<uint8_t> &out)
+{
+    out.clear();
+    size_t pos = 0;
+    while (pos < in.size())
+    {
+        uint32_t run;
+        if (!readVarint(in, pos, run) || pos >= in.size() || out.size() + run > rawSize)
+        {
+            return false;
+        }
+        out.insert(out.end(), run, in[pos++]);
+    }
+    return out.size() == rawSize;
+}
+
+static bool seekFile(FILE *file, const uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
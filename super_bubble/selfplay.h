@@ -0,0 +1,134 @@
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/* Self-play data files.
+ *
+ * Every decision made in a headless match is one row. Rows are grouped into blocks, and each block
+ * stores every column separately so a reader can skip the columns it does not need:
+ *
+ *  SelfPlayFileHeader
+ *  block 0: column 0 chunk, column 1 chunk, ... column N chunk
+ *  block 1: ...
+ *  SelfPlayBlockIndex[numBlocks]
+ *  SelfPlayFileFooter
+ *
+ * The footer is always the last bytes of the file, so a reader can memory map the file, read the footer,
+ * then jump straight to the index. All values are little endian.
+ */
+
+const char SELFPLAY_FILE_MAGIC[4] = { 'S', 'B', 'S', 'P' };
+const char SELFPLAY_INDEX_MAGIC[4] = { 'S', 'B', 'S', 'I' };
+const uint16_t SELFPLAY_VERSION = 2;
+// Blocks are closed on the first match boundary after this many rows.
+const uint32_t SELFPLAY_ROWS_PER_BLOCK = 65536;
+
+enum SelfPlayColumn
+{
+    // uint32, match number.
+    COLUMN_MATCH,
+    // uint16, number of pairs this player has placed before this one.
+    COLUMN_MOVE,
+    // uint8, 0 or 1.
+    COLUMN_PLAYER,
+    // gridColumns * gridRows bytes of Board::cells before the move, a column at a time.
+    COLUMN_BOARD,
+    // uint8, falling pair colours: (main << 4) | buddy.
+    COLUMN_PAIR,
+    // uint8, next pair colours: (main << 4) | buddy.
+    COLUMN_NEXT,
+    // uint8, enemy bubbles waiting to drop after the move.
+    COLUMN_ENEMY_BUBBLES,
+    // uint8, index of the chosen placement (see placementFromIndex).
+    COLUMN_PLACEMENT,
+    // uint8, chain length resulting from the move.
+    COLUMN_CHAIN,
+    // uint32, score gained by the move.
+    COLUMN_SCORE,
+    // uint8, bubbles sent to the other player by the move.
+    COLUMN_GARBAGE,
+    // uint8, match result for this player: 0 lost, 1 won, 2 move limit reached.
+    COLUMN_RESULT,
+    NUM_SELFPLAY_COLUMNS
+};
+
+enum SelfPlayEncoding
+{
+    // Stored as is. Used whenever the other encodings would not make the chunk smaller.
+    ENCODING_RAW,
+    // Runs of (varint length, byte).
+    ENCODING_RLE,
+    // Each value as a LEB128 varint.
+    ENCODING_VARINT,
+    // Zigzag encoded difference from the previous value as a LEB128 varint.
+    ENCODING_DELTA_VARINT,
+    // Each row is XORed with the row before it and the result is run length encoded as ENCODING_RLE.
+    ENCODING_XOR_RLE,
+    // As ENCODING_XOR_RLE, but against the same player's previous row in the block, going by COLUMN_PLAYER.
+    // A player's first row in the block is stored as is.
+    ENCODING_PLAYER_XOR_RLE
+};
+
+struct SelfPlayFileHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint8_t numColumns;
+    uint8_t gridColumns;
+    uint8_t gridRows;
+    uint8_t reserved[3];
+};
+
+struct SelfPlayColumnChunk
+{
+    // Byte offset of the chunk from the start of the file.
+    uint64_t offset;
+    uint32_t compressedSize;
+    // Size of the decoded column in bytes.
+    uint32_t rawSize;
+    uint32_t encoding;
+    uint32_t reserved;
+};
+
+struct SelfPlayBlockIndex
+{
+    uint64_t firstRow;
+    uint32_t numRows;
+    uint32_t reserved;
+    SelfPlayColumnChunk columns[NUM_SELFPLAY_COLUMNS];
+};
+
+struct SelfPlayFileFooter
+{
+    uint64_t indexOffset;
+    uint64_t numRows;
+    uint32_t numBlocks;
+    char magic[4];
+};
+
+/*
+ * Plays numMatches headless matches between two bots spread over numThreads threads and writes every decision to outputFile.
+ * Returns true for success.
+**/
+bool runSelfPlay(const char *outputFile, const uint32_t numMatches, const uint32_t numThreads, const uint32_t seed);
+
+struct SelfPlayReader
+{
+    FILE *file;
+    SelfPlayFileHeader header;
+    SelfPlayFileFooter footer;
+    std::vector<SelfPlayBlockIndex> blocks;
+};
+
+// Reads the header and the block index. Returns false, with the file closed, if either is damaged or from another version.
+bool openSelfPlayFile(const char *fileName, SelfPlayReader &reader);
+void closeSelfPlayFile(SelfPlayReader &reader);
+// Decodes one column of a block into rows of the column's fixed width. Returns false if the chunk is damaged.
+bool readSelfPlayColumn(SelfPlayReader &reader, const uint32_t block, const SelfPlayColumn column, std::vector<uint8_t> &rows);
+// Decodes every column of every block and prints how well each column compressed. Returns false if anything failed to decode.
+bool printSelfPlayStats(const char *fileName);
+
+#endif
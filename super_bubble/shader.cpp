@@ -43,6 +43,9 @@ void Shader::Compile(const GLchar* vertexSource, const GLchar* fragmentSource, c
     glAttachShader(this->ID, sFragment);
     if (geometrySource != nullptr)
         glAttachShader(this->ID, gShader);
+    // Lets the driver keep the binary around for GetBinary
+    if (GLEW_ARB_get_program_binary)
+        glProgramParameteri(this->ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(this->ID);
     checkCompileErrors(this->ID, "PROGRAM");
     // Delete the shaders as they're linked into our program now and no longer necessery
@@ -52,6 +55,37 @@ void Shader::Compile(const GLchar* vertexSource, const GLchar* fragmentSource, c
         glDeleteShader(gShader);
 }
 
+GLboolean Shader::LoadBinary(GLenum format, const void *binary, GLsizei length)
+{
+    if (!GLEW_ARB_get_program_binary)
+        return GL_FALSE;
+    this->ID = glCreateProgram();
+    glProgramBinary(this->ID, format, binary, length);
+    GLint success;
+    glGetProgramiv(this->ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glDeleteProgram(this->ID);
+        this->ID = 0;
+        return GL_FALSE;
+    }
+    return GL_TRUE;
+}
+
+GLboolean Shader::GetBinary(GLenum &format, std::vector<unsigned char> &binary)
+{
+    if (!GLEW_ARB_get_program_binary)
+        return GL_FALSE;
+    GLint length = 0;
+    glGetProgramiv(this->ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    // Some drivers don't support any binary formats, and report no binary
+    if (length <= 0)
+        return GL_FALSE;
+    binary.resize(length);
+    glGetProgramBinary(this->ID, length, nullptr, &format, binary.data());
+    return GL_TRUE;
+}
+
 void Shader::SetFloat(const GLchar *name, GLfloat value, GLboolean useShader)
 {
     if (useShader)
@@ -10,6 +10,7 @@
 #define SHADER_H
 
 #include <string>
+#include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -31,6 +32,10 @@ public:
     // Compiles the shader from given source code
     // Note: geometry source code is optional
     void    Compile(const GLchar *vertexSource, const GLchar *fragmentSource, const GLchar *geometrySource = nullptr);
+    // Loads a program binary from GetBinary. Fails if the driver no longer accepts it, for instance after an update
+    GLboolean LoadBinary(GLenum format, const void *binary, GLsizei length);
+    // Retrieves the linked program in the driver's binary format, to load on a later run
+    GLboolean GetBinary(GLenum &format, std::vector<unsigned char> &binary);
     // Utility functions
     void    SetFloat(const GLchar *name, GLfloat value, GLboolean useShader = false);
     void    SetInteger(const GLchar *name, GLint value, GLboolean useShader = false);
@@ -0,0 +1,26 @@
+#include "shader_sources.h"
+
+const GLchar *SPRITE_VERTEX_SOURCE =
+#include "../shaders/sprite.vs"
+;
+const GLchar *SPRITE_FRAGMENT_SOURCE =
+#include "../shaders/sprite.frag"
+;
+const GLchar *TEXT_VERTEX_SOURCE =
+#include "../shaders/text.vs"
+;
+const GLchar *TEXT_FRAGMENT_SOURCE =
+#include "../shaders/text.frag"
+;
+const GLchar *EFFECT_VERTEX_SOURCE =
+#include "../shaders/effect.vs"
+;
+const GLchar *EFFECT_FRAGMENT_SOURCE =
+#include "../shaders/effect.frag"
+;
+const GLchar *BUBBLE_VERTEX_SOURCE =
+#include "../shaders/bubble.vs"
+;
+const GLchar *BUBBLE_FRAGMENT_SOURCE =
+#include "../shaders/bubble.frag"
+;
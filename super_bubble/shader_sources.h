@@ -0,0 +1,19 @@
+#ifndef SHADER_SOURCES_H
+#define SHADER_SOURCES_H
+
+#include <GL/glew.h>
+
+/* GLSL for every program, built into the executable so nothing is read from ../shaders/ at startup.
+ * Each file in shaders/ is a raw string literal, included into shader_sources.cpp.
+ */
+
+extern const GLchar *SPRITE_VERTEX_SOURCE;
+extern const GLchar *SPRITE_FRAGMENT_SOURCE;
+extern const GLchar *TEXT_VERTEX_SOURCE;
+extern const GLchar *TEXT_FRAGMENT_SOURCE;
+extern const GLchar *EFFECT_VERTEX_SOURCE;
+extern const GLchar *EFFECT_FRAGMENT_SOURCE;
+extern const GLchar *BUBBLE_VERTEX_SOURCE;
+extern const GLchar *BUBBLE_FRAGMENT_SOURCE;
+
+#endif
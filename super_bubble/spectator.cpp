@@ -0,0 +1,271 @@
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include "spectator.h"
+#include "game_logic.h"
+#include "grid.h"
+#include "replay.h"
+#include "bubble_batch.h"
+#include "sprite_renderer.h"
+#include "render_text.h"
+#include "resource_manager.h"
+#include "layers.h"
+#include "profiler.h"
+
+// One match being played back on the wall.
+struct SpectatorBoard
+{
+    // Each board reads the file on its own, so boards never wait on each other's place in it.
+    ReplayReader reader;
+    ReplayEvent event;
+    bool hasEvent;
+    MatchState match;
+    Controls controls;
+    // Still following the recording. Once it has ended the match is only stepped for its game over animation.
+    bool playing;
+    // Ticks left showing the finished match.
+    uint16_t holdTicks;
+    // The file has no more matches for this board.
+    bool finished;
+};
+
+static SpectatorBoard boards[MAX_SPECTATOR_BOARDS];
+static uint8_t numBoards = 0;
+// Boards along each side of the wall.
+static uint8_t boardsPerSide = 0;
+
+static bool nextBoardMatch(SpectatorBoard &board, const uint8_t skip);
+static void updateBoard(SpectatorBoard &board);
+static void batchBoard(const SpectatorBoard &board, const glm::vec2 origin, const float scale, TextRenderer &text);
+
+bool isSpectatorBoardCount(const int32_t count)
+{
+    for (uint8_t i = 0; i < NUM_SPECTATOR_BOARD_COUNTS; i++)
+    {
+        if (SPECTATOR_BOARD_COUNTS[i] == count)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool startSpectatorWall(const char *replayFile, const uint8_t boardCount)
+{
+    boardsPerSide = 0;
+    for (uint8_t i = 0; i < NUM_SPECTATOR_BOARD_COUNTS; i++)
+    {
+        if (SPECTATOR_BOARD_COUNTS[i] == boardCount)
+        {
+            boardsPerSide = i + 2;
+        }
+    }
+    if (boardsPerSide == 0)
+    {
+        std::cout << "A spectator wall has 4, 9 or 16 boards." << std::endl;
+        return false;
+    }
+
+    stopSpectatorWall();
+    numBoards = boardCount;
+    bool anyMatches = false;
+    for (uint8_t i = 0; i < numBoards; i++)
+    {
+        SpectatorBoard &board = boards[i];
+        memset(&board, 0, sizeof(board));
+        if (!openReplayFile(replayFile, board.reader))
+        {
+            std::cout << "Failed to open replay file " << replayFile << std::endl;
+            stopSpectatorWall();
+            return false;
+        }
+        anyMatches |= nextBoardMatch(board, i);
+    }
+    if (!anyMatches)
+    {
+        std::cout << "Replay file has no matches to show." << std::endl;
+        stopSpectatorWall();
+        return false;
+    }
+    return true;
+}
+
+void stopSpectatorWall()
+{
+    for (uint8_t i = 0; i < numBoards; i++)
+    {
+        closeReplayFile(boards[i].reader);
+    }
+    numBoards = 0;
+}
+
+void updateSpectatorWall()
+{
+    for (uint8_t i = 0; i < numBoards; i++)
+    {
+        updateBoard(boards[i]);
+    }
+}
+
+void drawSpectatorWall(TextRenderer &text)
+{
+    const float scale = 1.0f / boardsPerSide;
+    const glm::uvec2 boardSize(WIDTH / boardsPerSide, HEIGHT / boardsPerSide);
+
+    beginProfile(PROFILE_BACKGROUND);
+    if (beginLayer(LAYER_HUD))
+    {
+        for (uint8_t i = 0; i < numBoards; i++)
+        {
+            const glm::uvec2 origin((i % boardsPerSide) * boardSize.x, (i / boardsPerSide) * boardSize.y);
+            drawSprite(ResourceManager::GetRegion("background"), 0, 0, origin, boardSize, 0.0f, glm::vec3(1.0f), 0.0f, PASS_BACKGROUND);
+        }
+        endLayer();
+    }
+    drawLayer(LAYER_HUD);
+    endProfile(PROFILE_BACKGROUND);
+
+    {
+        ProfileScope profile(PROFILE_GRID);
+        for (uint8_t i = 0; i < numBoards; i++)
+        {
+            const glm::vec2 origin(static_cast<float>((i % boardsPerSide) * boardSize.x), static_cast<float>((i / boardsPerSide) * boardSize.y));
+            batchBoard(boards[i], origin, scale, text);
+        }
+        drawBubbleBatch();
+    }
+    text.FlushText(glm::vec3(1.0f, 0.0f, 0.0f));
+}
+
+// Moves the board on past skip matches to the next one it can play. Returns false, and finishes the board, at the end of the file.
+static bool nextBoardMatch(SpectatorBoard &board, const uint8_t skip)
+{
+    ReplayHeader header;
+    MatchMode mode;
+    for (uint8_t i = 0; i < skip; i++)
+    {
+        if (!nextReplayMatch(board.reader, header))
+        {
+            board.finished = true;
+            return false;
+        }
+    }
+    for (;;)
+    {
+        if (!nextReplayMatch(board.reader, header))
+        {
+            board.finished = true;
+            return false;
+        }
+        if (findReplayMode(header.rules, mode))
+        {
+            break;
+        }
+    }
+    initMatchState(board.match, header.seed, mode);
+    memset(&board.controls, 0, sizeof(board.controls));
+    board.hasEvent = readReplayEvent(board.reader, board.event);
+    board.playing = true;
+    board.holdTicks = SPECTATOR_HOLD_TICKS;
+    return true;
+}
+
+// The same steps as update() in main.cpp during playback: the records for this tick, then one tick of the match.
+static void updateBoard(SpectatorBoard &board)
+{
+    if (board.finished)
+    {
+        return;
+    }
+    if (board.playing)
+    {
+        while (board.hasEvent && board.event.tick <= board.match.tick && board.event.type != REPLAY_END)
+        {
+            switch (board.event.type)
+            {
+            case REPLAY_CONTROLS:
+                board.controls = board.event.controls;
+                break;
+            case REPLAY_NUM_BUBBLES:
+                board.match.numEnemyBubbles += board.event.numBubbles;
+                break;
+            case REPLAY_REMOTE_GAME_OVER:
+                board.match.state = GameState::WIN;
+                break;
+            default:
+                break;
+            }
+            board.hasEvent = readReplayEvent(board.reader, board.event);
+        }
+    }
+    stepMatch(board.match, board.controls, TARGET_FRAME_SECONDS);
+    board.match.garbageToSend = 0;
+
+    if (board.playing)
+    {
+        board.playing = board.hasEvent && (board.event.type != REPLAY_END || board.event.tick > board.match.tick) &&
+            board.match.state != GameState::GAME_OVER && board.match.state != GameState::WIN;
+        // Nothing recorded is acted on now, so leave the controls up rather than held.
+        if (!board.playing)
+        {
+            memset(&board.controls, 0, sizeof(board.controls));
+        }
+    }
+    else if (--board.holdTicks == 0)
+    {
+        // Every board reads the same file, so the next match for this one is a whole wall further on.
+        nextBoardMatch(board, numBoards - 1);
+    }
+}
+
+// Adds the board's bubbles to the bubble batch and its text to the text batch, the game screen scaled by scale and moved to origin.
+static void batchBoard(const SpectatorBoard &board, const glm::vec2 origin, const float scale, TextRenderer &text)
+{
+    if (board.finished)
+    {
+        return;
+    }
+    const MatchState &match = board.match;
+    const AtlasRegion &bubbles = ResourceManager::GetRegion("bubbles");
+    const BoardLayout &layout = boardLayout(match.mode);
+    const GridShape &shape = MODE_GRIDS[match.mode];
+    const glm::vec2 playSpace = origin + glm::vec2(layout.position) * scale;
+    // Play space positions are in GRID_SIZE squares, drawn at the layout's size.
+    const float playScale = scale * layout.cellSize / GRID_SIZE;
+    const float size = layout.cellSize * scale;
+    const float nextSize = GRID_SIZE * scale;
+
+    for (uint8_t col = 0; col < shape.columns; col++)
+    {
+        for (uint8_t row = 0; row < shape.rows; row++)
+        {
+            const GridCell cell = match.grid[col][row];
+            if (cellState(cell) != DEAD)
+            {
+                addBatchedBubble(bubbles, cellAnimationFrame(match, cell), cellState(cell) - 1,
+                    playSpace + glm::vec2(cellPlaySpacePosition(match, col, row)) * playScale, size, BUBBLE_COLORS[cellColor(cell)]);
+            }
+        }
+    }
+    // Falling bubbles are clipped to the top of their own board's play space, as in the game.
+    for (uint8_t i = 0; i < match.falling.size; i++)
+    {
+        addBatchedBubble(bubbles, 0, FALLING - 1, playSpace + glm::vec2(fallingPosition(match.falling, i)) * playScale, size,
+            BUBBLE_COLORS[match.falling.colors[i]], playSpace.y);
+    }
+    addBatchedBubble(bubbles, 0, 0, origin + glm::vec2(NEXT_BUBBLE_POS) * scale, nextSize, BUBBLE_COLORS[match.nextColors[0]]);
+    addBatchedBubble(bubbles, 0, 0, origin + glm::vec2(NEXT_BUBBLE_POS + glm::uvec2(0, GRID_SIZE)) * scale, nextSize, BUBBLE_COLORS[match.nextColors[1]]);
+
+    std::ostringstream ss;
+    ss << "Score " << match.score;
+    text.QueueText(ss.str(), origin.x + SCORE_POS.x * scale, origin.y + SCORE_POS.y * scale, SCALE * scale);
+    text.QueueText("NEXT", origin.x + NEXT_BUBBLE_LABEL_POS.x * scale, origin.y + NEXT_BUBBLE_LABEL_POS.y * scale, SCALE * scale);
+    if (match.state == GameState::GAME_OVER)
+    {
+        text.QueueText("GAME OVER!", origin.x + GAME_OVER_POS.x * scale, origin.y + GAME_OVER_POS.y * scale, 3.0f * scale);
+    }
+    else if (match.state == GameState::WIN)
+    {
+        text.QueueText("WIN!", origin.x + GAME_OVER_POS.x * scale, origin.y + GAME_OVER_POS.y * scale, 3.0f * scale);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include "defs.h"
+
+class TextRenderer;
+
+/* Spectator wall.
+ *
+ * Plays recorded matches from a replay file side by side on a square of boards, each a scaled down copy of
+ * the game screen with its grid, falling bubbles, next pair and score. Board i starts on match i of the file.
+ * When its match ends it is held for SPECTATOR_HOLD_TICKS, then the board moves on to match i + boards, and so
+ * on until the file runs out. Matches recorded under rules this build has no mode for are skipped.
+ *
+ * Everything that moves is batched across the whole wall: every bubble goes into one instanced draw and every
+ * string into one text batch. The backgrounds don't move, so they are cached in LAYER_HUD.
+ */
+
+// Boards on a wall: 2x2, 3x3 or 4x4.
+const uint8_t SPECTATOR_BOARD_COUNTS[] = { 4, 9, 16 };
+const uint8_t NUM_SPECTATOR_BOARD_COUNTS = 3;
+const uint8_t MAX_SPECTATOR_BOARDS = 16;
+// Time a finished match stays up before the board moves on.
+const uint16_t SPECTATOR_HOLD_TICKS = static_cast<uint16_t>(3 * TARGET_FPS);
+
+bool isSpectatorBoardCount(const int32_t count);
+// Opens the replay file once for each board and starts their first matches. numBoards must be one of SPECTATOR_BOARD_COUNTS.
+bool startSpectatorWall(const char *replayFile, const uint8_t numBoards);
+void stopSpectatorWall();
+// Steps every board by one tick.
+void updateSpectatorWall();
+// Call with LAYER_HUD dirty on the first frame, as for the game screen.
+void drawSpectatorWall(TextRenderer &text);
+
+#endif
@@ -9,36 +9,49 @@
 ******************************************************************/
 #include "sprite_renderer.h"
 #include "defs.h"
+#include "stream_buffer.h"
 
 // Render state
 static Shader shader;
 static GLuint VAO;
-static GLuint VBO;
-static GLuint EBO;
+static float clipScale = 1.0f;
+static GLint colorLocation = -1;
+static GLint clipLocation = -1;
 
-// Initializes and configures the quad's buffer and vertex attributes
+// Corners of the unit quad, as two triangles.
+static const glm::vec2 QUAD_CORNERS[6] = {
+    glm::vec2(0.0f, 1.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 0.0f),
+    glm::vec2(0.0f, 1.0f), glm::vec2(1.0f, 1.0f), glm::vec2(1.0f, 0.0f)
+};
+
+// Initializes and configures the quad's vertex attributes
 static void initRenderData();
 
 void initSpriteRenderer(Shader &shaderToUse)
 {
     shader = shaderToUse;
+    colorLocation = glGetUniformLocation(shader.ID, "spriteColor");
+    clipLocation = glGetUniformLocation(shader.ID, "clipY");
     initRenderData();
 }
 
 void deleteSpriteVertexArrays() {
     glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteBuffers(1, &VBO);
+}
+
+void setSpriteTargetHeight(const GLuint height)
+{
+    clipScale = static_cast<float>(height) / HEIGHT;
 }
 
 /**
 * Draw sprite from texture atlas.
-*
+* The quad is transformed here and streamed, so there is no per-sprite model matrix or atlas uniform to set.
+* The draw itself is queued, and is made when the render queue is flushed.
 */
-void drawSprite(Texture2D &texture, glm::vec2 uvSize, GLuint atlasColumn, GLuint atlasRow, glm::uvec2 windowPosition, glm::uvec2 size, GLfloat rotate, glm::vec3 color, float clipY)
+void drawSprite(const AtlasRegion &region, GLuint atlasColumn, GLuint atlasRow, glm::uvec2 windowPosition, glm::uvec2 size, GLfloat rotate, glm::vec3 color, float clipY, RenderPass pass)
 {
     // Prepare transformations
-    shader.Use();
     glm::mat4 model;
 
     // First translate 
@@ -54,53 +67,38 @@ void drawSprite(Texture2D &texture, glm::vec2 uvSize, GLuint atlasColumn, GLuint
     // Last scale.
     model = glm::scale(model, glm::vec3(size, 1.0f));
 
-    shader.SetMatrix4("model", model);
-
-    // Render textured quad.
-    shader.SetVector3f("spriteColor", color);
-    shader.SetFloat("clipY", HEIGHT - clipY);
-
-    // Parameters for texture atlas (width, height, column, row)
-    glm::vec4 atlasParams = glm::vec4(uvSize.x, uvSize.y, static_cast<float>(atlasColumn), static_cast<float>(atlasRow));
-    shader.SetVector4f("atlasParams", atlasParams);
+    // Cell of the texture atlas to use.
+    const glm::vec2 uvOrigin = glm::vec2(region.Origin.x + region.CellSize.x * atlasColumn, region.Origin.y + region.CellSize.y * atlasRow);
 
-    glActiveTexture(GL_TEXTURE0);
-    texture.Bind();
+    GLint first;
+    GLfloat *vertices = allocateStreamVertices(6, first);
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        const glm::vec4 position = model * glm::vec4(QUAD_CORNERS[i].x, QUAD_CORNERS[i].y, 0.0f, 1.0f);
+        vertices[i * 4 + 0] = position.x;
+        vertices[i * 4 + 1] = position.y;
+        vertices[i * 4 + 2] = uvOrigin.x + region.CellSize.x * QUAD_CORNERS[i].x;
+        vertices[i * 4 + 3] = uvOrigin.y + region.CellSize.y * QUAD_CORNERS[i].y;
+    }
+    finishStreamVertices();
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    // Queue textured quad.
+    RenderCommand command = makeRenderCommand(pass, shader.ID, region.Texture.ID, VAO, GL_TRIANGLES, first, 6);
+    command.colorLocation = colorLocation;
+    command.color = color;
+    command.clipLocation = clipLocation;
+    command.clipY = (HEIGHT - clipY) * clipScale;
+    submitRenderCommand(command);
 }
 
 void initRenderData()
 {
-    GLfloat vertices[] = {
-        // Top Right
-        1.0f, 0.0f, 1.0f, 0.0f,
-        // Bottom Right
-        1.0f, 1.0f, 1.0f, 1.0f,
-        // Bottom Left
-        0.0f, 1.0f, 0.0f, 1.0f,
-        // Top Left 
-        0.0f, 0.0f, 0.0f, 0.0f
-    };
-    GLuint indices[] = {
-        2, 0, 3,
-        2, 1, 0
-    };
-
+    // Vertices come from the stream buffer, written per sprite.
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, getStreamBuffer());
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, STREAM_VERTEX_SIZE, (GLvoid*)0);
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    // Unbind VAO (NOT the EBO)
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
@@ -15,11 +15,15 @@
 
 #include "texture.h"
 #include "shader.h"
+#include "resource_manager.h"
+#include "render_queue.h"
 
 void initSpriteRenderer(Shader &shaderToUse);
 void deleteSpriteVertexArrays();
+// Height in pixels of what is being drawn to. clipY is given in window space, so it is scaled to match.
+void setSpriteTargetHeight(const GLuint height);
 
-// Renders a defined quad textured with given sprite
-void drawSprite(Texture2D &texture, glm::vec2 uvSize, GLuint atlasColumn, GLuint atlasRow, glm::uvec2 windowPosition, glm::uvec2 size = glm::uvec2(10, 10), GLfloat rotate = 0.0f, glm::vec3 color = glm::vec3(1.0f), float clipY = 0.0f);
+// Queues a defined quad textured with a cell of an atlas region. Full screen images go in PASS_BACKGROUND.
+void drawSprite(const AtlasRegion &region, GLuint atlasColumn, GLuint atlasRow, glm::uvec2 windowPosition, glm::uvec2 size = glm::uvec2(10, 10), GLfloat rotate = 0.0f, glm::vec3 color = glm::vec3(1.0f), float clipY = 0.0f, RenderPass pass = PASS_SPRITES);
 
 #endif
\ No newline at end of file
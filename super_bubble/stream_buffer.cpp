@@ -0,0 +1,134 @@
+#include "stream_buffer.h"
+#include "render_queue.h"
+
+// Longest wait for a region's fence before checking again.
+static const GLuint64 STREAM_FENCE_WAIT_NANOSECONDS = 100000000;
+static const GLsizeiptr STREAM_BUFFER_SIZE = static_cast<GLsizeiptr>(STREAM_REGION_SIZE) * STREAM_BUFFER_REGIONS;
+
+static GLuint VBO = 0;
+// Mapped for the life of the buffer, or nullptr when falling back to mapping each write.
+static GLubyte *persistentData = nullptr;
+static GLsync fences[STREAM_BUFFER_REGIONS] = { nullptr };
+static uint8_t region = 0;
+// Bytes of the current region written this frame.
+static GLuint regionUsed = 0;
+
+static void nextRegion();
+
+void initStreamBuffer()
+{
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, nullptr, flags);
+        persistentData = static_cast<GLubyte*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, STREAM_BUFFER_SIZE, flags));
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    region = 0;
+    regionUsed = 0;
+}
+
+void deleteStreamBuffer()
+{
+    for (uint8_t i = 0; i < STREAM_BUFFER_REGIONS; i++)
+    {
+        if (fences[i] != nullptr)
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+    if (persistentData != nullptr)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        persistentData = nullptr;
+    }
+    glDeleteBuffers(1, &VBO);
+    VBO = 0;
+}
+
+GLuint getStreamBuffer()
+{
+    return VBO;
+}
+
+GLfloat* allocateStreamVertices(const GLuint count, GLint &first)
+{
+    const GLuint size = count * STREAM_VERTEX_SIZE;
+    if (regionUsed + size > STREAM_REGION_SIZE)
+    {
+        // Only happens on a very busy frame. Carry on in the next region, which may mean waiting for it.
+        // Queued draws still read this region, and moving on may orphan it, so they are drawn first.
+        flushRenderQueue();
+        nextRegion();
+    }
+    const GLuint offset = region * STREAM_REGION_SIZE + regionUsed;
+    regionUsed += size;
+    first = offset / STREAM_VERTEX_SIZE;
+    if (persistentData != nullptr)
+    {
+        return reinterpret_cast<GLfloat*>(persistentData + offset);
+    }
+    // The fences already keep this range clear of the GPU, so the driver doesn't need to synchronise.
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    return static_cast<GLfloat*>(glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+}
+
+void finishStreamVertices()
+{
+    // The persistent mapping is coherent, so its writes are already visible.
+    if (persistentData == nullptr)
+    {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void endStreamFrame()
+{
+    nextRegion();
+}
+
+static void nextRegion()
+{
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % STREAM_BUFFER_REGIONS;
+    regionUsed = 0;
+    if (fences[region] == nullptr)
+    {
+        return;
+    }
+
+    if (persistentData != nullptr)
+    {
+        while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_FENCE_WAIT_NANOSECONDS) == GL_TIMEOUT_EXPIRED)
+        {
+        }
+    }
+    else if (glClientWaitSync(fences[region], 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        // Still in use. Orphan the buffer: the driver hands over fresh storage and frees the old when the GPU is done with it.
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        for (uint8_t i = 0; i < STREAM_BUFFER_REGIONS; i++)
+        {
+            if (fences[i] != nullptr && i != region)
+            {
+                glDeleteSync(fences[i]);
+                fences[i] = nullptr;
+            }
+        }
+    }
+    glDeleteSync(fences[region]);
+    fences[region] = nullptr;
+}
@@ -0,0 +1,36 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "defs.h"
+
+/* Streamed vertex data shared by the sprite and text renderers.
+ *
+ * One large vertex buffer is split into a region per frame in flight. Vertices for a frame are written
+ * into that frame's region and the region is fenced when the frame ends; it is only written again once the
+ * GPU has passed the fence, so writing never waits on a draw. With ARB_buffer_storage the buffer is mapped
+ * once, persistently, and written directly. Without it each write maps its range unsynchronized, and a
+ * region the GPU hasn't finished with is dealt with by orphaning the whole buffer.
+ */
+
+// Frames that can be in flight before writing waits for the GPU.
+const uint8_t STREAM_BUFFER_REGIONS = 3;
+// Bytes per region. A sprite or a glyph takes 96.
+const GLuint STREAM_REGION_SIZE = 1 << 20;
+// Every streamed vertex is a vec4 of window position and texture coordinates.
+const GLuint STREAM_VERTEX_SIZE = 4 * sizeof(GLfloat);
+
+void initStreamBuffer();
+void deleteStreamBuffer();
+// The buffer to point vertex attributes at. Allocations are addressed by their first vertex.
+GLuint getStreamBuffer();
+/*
+ * Space for count vertices in this frame's region, to be written before the next call to finishStreamVertices.
+ * first is set to the index of the first vertex, for glDrawArrays.
+**/
+GLfloat* allocateStreamVertices(const GLuint count, GLint &first);
+// Call once the vertices from allocateStreamVertices are written, before drawing them.
+void finishStreamVertices();
+// Fences this frame's region and moves on to the next one. Call once per frame, after the last draw.
+void endStreamFrame();
+
+#endif
@@ -7,6 +7,7 @@
 ** option) any later version.
 ******************************************************************/
 #include <iostream>
+#include <stdint.h>
 
 #include "texture.h"
 
@@ -33,6 +34,29 @@ void Texture2D::Generate(GLuint width, GLuint height, unsigned char* data)
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void Texture2D::GenerateCompressed(GLuint width, GLuint height, GLuint levels, const unsigned char* data, const GLuint* levelSizes)
+{
+    this->Width = width;
+    this->Height = height;
+    glBindTexture(GL_TEXTURE_2D, this->ID);
+    // With a pixel unpack buffer bound, data is an offset into it and may be null
+    uintptr_t offset = reinterpret_cast<uintptr_t>(data);
+    for (GLuint level = 0; level < levels; level++)
+    {
+        const GLuint levelWidth = width >> level > 0 ? width >> level : 1;
+        const GLuint levelHeight = height >> level > 0 ? height >> level : 1;
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, this->Internal_Format, levelWidth, levelHeight, 0, levelSizes[level], reinterpret_cast<const GLvoid*>(offset));
+        offset += levelSizes[level];
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->Wrap_S);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->Wrap_T);
+    // Sample the mipmaps when drawn smaller, as at a reduced render scale
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 && this->Filter_Min == GL_LINEAR ? GL_LINEAR_MIPMAP_LINEAR : this->Filter_Min);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, this->Filter_Max);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void Texture2D::Bind() const
 {
     glBindTexture(GL_TEXTURE_2D, this->ID);
@@ -32,6 +32,8 @@ public:
     Texture2D();
     // Generates texture from image data
     void Generate(GLuint width, GLuint height, unsigned char* data);
+    // Generates texture from data in the compressed Internal_Format, each mipmap level after the one before, largest first
+    void GenerateCompressed(GLuint width, GLuint height, GLuint levels, const unsigned char* data, const GLuint* levelSizes);
     // Binds the texture as the current active GL_TEXTURE_2D texture object
     void Bind() const;
 };
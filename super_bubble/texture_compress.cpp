@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <SOIL.h>
+#include "texture_compress.h"
+
+// Power iterations used to find a block's main colour axis.
+static const uint8_t AXIS_ITERATIONS = 8;
+static const GLuint BC1_BLOCK_BYTES = 8;
+static const GLuint BC3_BLOCK_BYTES = 16;
+
+struct KtxHeader
+{
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+static GLuint levelSize(const GLenum format, const GLuint width, const GLuint height);
+static void compressLevel(const GLuint width, const GLuint height, const unsigned char *pixels, const bool alpha, unsigned char *out);
+static void compressColorBlock(const unsigned char (&block)[16][4], unsigned char *out);
+static void compressAlphaBlock(const unsigned char (&block)[16][4], unsigned char *out);
+static uint16_t packColor(const float *color);
+static void unpackColor(const uint16_t packed, float *color);
+static void halveImage(const GLuint width, const GLuint height, const std::vector<unsigned char> &pixels, std::vector<unsigned char> &half);
+
+void compressImage(const GLuint width, const GLuint height, const unsigned char *pixels, const bool alpha, CompressedImage &image)
+{
+    image.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    image.width = width;
+    image.height = height;
+    image.levelSizes.clear();
+    image.data.clear();
+
+    std::vector<unsigned char> level(pixels, pixels + width * height * 4);
+    std::vector<unsigned char> next;
+    GLuint levelWidth = width, levelHeight = height;
+    while (true)
+    {
+        const GLuint size = levelSize(image.format, levelWidth, levelHeight);
+        const size_t offset = image.data.size();
+        image.data.resize(offset + size);
+        image.levelSizes.push_back(size);
+        compressLevel(levelWidth, levelHeight, level.data(), alpha, &image.data[offset]);
+        if (levelWidth == 1 && levelHeight == 1)
+        {
+            break;
+        }
+        halveImage(levelWidth, levelHeight, level, next);
+        level.swap(next);
+        levelWidth = std::max<GLuint>(levelWidth / 2, 1);
+        levelHeight = std::max<GLuint>(levelHeight / 2, 1);
+    }
+}
+
+bool writeKtx(const char *fileName, const CompressedImage &image)
+{
+    FILE *file = fopen(fileName, "wb");
+    if (file == nullptr)
+    {
+        std::cout << "Failed to open " << fileName << std::endl;
+        return false;
+    }
+    KtxHeader header;
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(header.identifier));
+    header.endianness = KTX_ENDIANNESS;
+    // Compressed formats have no type or format, only an internal format.
+    header.glType = 0;
+    header.glTypeSize = 1;
+    header.glFormat = 0;
+    header.glInternalFormat = image.format;
+    header.glBaseInternalFormat = image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? GL_RGBA : GL_RGB;
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(image.levelSizes.size());
+    header.bytesOfKeyValueData = 0;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    size_t offset = 0;
+    // Blocks are 8 or 16 bytes, so levels never need padding to 4 bytes.
+    for (const GLuint size : image.levelSizes)
+    {
+        written = written && fwrite(&size, sizeof(size), 1, file) == 1 && fwrite(&image.data[offset], size, 1, file) == 1;
+        offset += size;
+    }
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::cout << "Failed to write " << fileName << std::endl;
+    }
+    return written;
+}
+
+bool readKtx(const char *fileName, CompressedImage &image)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    KtxHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.identifier, KTX_IDENTIFIER, sizeof(header.identifier)) == 0
+        && header.endianness == KTX_ENDIANNESS
+        && (header.glInternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header.glInternalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        && header.pixelWidth > 0 && header.pixelHeight > 0 && header.pixelDepth == 0
+        && header.numberOfArrayElements == 0 && header.numberOfFaces == 1
+        && header.numberOfMipmapLevels > 0 && header.numberOfMipmapLevels <= 32
+        && fseek(file, header.bytesOfKeyValueData, SEEK_CUR) == 0;
+
+    image.format = header.glInternalFormat;
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight;
+    image.levelSizes.clear();
+    image.data.clear();
+    GLuint levelWidth = image.width, levelHeight = image.height;
+    for (uint32_t i = 0; valid && i < header.numberOfMipmapLevels; i++)
+    {
+        uint32_t size;
+        // Anything but the exact size for the level means a damaged file.
+        valid = fread(&size, sizeof(size), 1, file) == 1 && size == levelSize(image.format, levelWidth, levelHeight);
+        if (valid)
+        {
+            const size_t offset = image.data.size();
+            image.data.resize(offset + size);
+            valid = fread(&image.data[offset], size, 1, file) == 1;
+            image.levelSizes.push_back(size);
+        }
+        levelWidth = std::max<GLuint>(levelWidth / 2, 1);
+        levelHeight = std::max<GLuint>(levelHeight / 2, 1);
+    }
+    fclose(file);
+    if (!valid)
+    {
+        std::cout << "ERROR::TEXTURE: " << fileName << " is not a supported KTX file" << std::endl;
+    }
+    return valid;
+}
+
+std::string ktxFileName(const std::string &imageFileName)
+{
+    const size_t dot = imageFileName.find_last_of('.');
+    const size_t slash = imageFileName.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return imageFileName + ".ktx";
+    }
+    return imageFileName.substr(0, dot) + ".ktx";
+}
+
+bool compressTextureFiles(char *files[], const int numFiles)
+{
+    bool succeeded = true;
+    for (int i = 0; i < numFiles; i++)
+    {
+        int width, height;
+        unsigned char *pixels = SOIL_load_image(files[i], &width, &height, 0, SOIL_LOAD_RGBA);
+        if (pixels == nullptr)
+        {
+            std::cout << "Failed to load " << files[i] << std::endl;
+            succeeded = false;
+            continue;
+        }
+        bool alpha = false;
+        for (int p = 0; p < width * height && !alpha; p++)
+        {
+            alpha = pixels[p * 4 + 3] != 255;
+        }
+        CompressedImage image;
+        compressImage(width, height, pixels, alpha, image);
+        SOIL_free_image_data(pixels);
+
+        const std::string outputFile = ktxFileName(files[i]);
+        if (!writeKtx(outputFile.c_str(), image))
+        {
+            succeeded = false;
+            continue;
+        }
+        std::cout << files[i] << " -> " << outputFile << ": " << width << "x" << height << " " << (alpha ? "BC3" : "BC1") << ", "
+            << image.levelSizes.size() << " levels, " << image.data.size() << " bytes" << std::endl;
+    }
+    return succeeded;
+}
+
+static GLuint levelSize(const GLenum format, const GLuint width, const GLuint height)
+{
+    const GLuint blocks = ((width + 3) / 4) * ((height + 3) / 4);
+    return blocks * (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? BC3_BLOCK_BYTES : BC1_BLOCK_BYTES);
+}
+
+static void compressLevel(const GLuint width, const GLuint height, const unsigned char *pixels, const bool alpha, unsigned char *out)
+{
+    unsigned char block[16][4];
+    for (GLuint blockY = 0; blockY < height; blockY += 4)
+    {
+        for (GLuint blockX = 0; blockX < width; blockX += 4)
+        {
+            // Blocks hanging off the edge repeat the last row and column.
+            for (GLuint i = 0; i < 16; i++)
+            {
+                const GLuint x = std::min(blockX + i % 4, width - 1);
+                const GLuint y = std::min(blockY + i / 4, height - 1);
+                memcpy(block[i], &pixels[(y * width + x) * 4], 4);
+            }
+            if (alpha)
+            {
+                compressAlphaBlock(block, out);
+                out += 8;
+            }
+            compressColorBlock(block, out);
+            out += 8;
+        }
+    }
+}
+
+/*
+ * Picks the two end colours along the line the block's colours spread along most, then gives each pixel
+ * the nearest of the four colours on that line.
+**/
+static void compressColorBlock(const unsigned char (&block)[16][4], unsigned char *out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        for (uint8_t c = 0; c < 3; c++)
+        {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+    float covariance[3][3] = { { 0.0f } };
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        for (uint8_t a = 0; a < 3; a++)
+        {
+            for (uint8_t b = 0; b < 3; b++)
+            {
+                covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+            }
+        }
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (uint8_t iteration = 0; iteration < AXIS_ITERATIONS; iteration++)
+    {
+        float next[3];
+        for (uint8_t a = 0; a < 3; a++)
+        {
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+        }
+        const float length = std::max(std::max(fabs(next[0]), fabs(next[1])), fabs(next[2]));
+        if (length == 0.0f)
+        {
+            break;
+        }
+        for (uint8_t a = 0; a < 3; a++)
+        {
+            axis[a] = next[a] / length;
+        }
+    }
+
+    uint8_t lowest = 0, highest = 0;
+    float lowestProjection = 0.0f, highestProjection = 0.0f;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        const float projection = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+        if (i == 0 || projection < lowestProjection)
+        {
+            lowest = i;
+            lowestProjection = projection;
+        }
+        if (i == 0 || projection > highestProjection)
+        {
+            highest = i;
+            highestProjection = projection;
+        }
+    }
+    const float highColor[3] = { static_cast<float>(block[highest][0]), static_cast<float>(block[highest][1]), static_cast<float>(block[highest][2]) };
+    const float lowColor[3] = { static_cast<float>(block[lowest][0]), static_cast<float>(block[lowest][1]), static_cast<float>(block[lowest][2]) };
+    uint16_t color0 = packColor(highColor);
+    uint16_t color1 = packColor(lowColor);
+    // color0 must be the larger for the four colour mode. BC1 would read the other order as three colours and transparent.
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        float palette[4][3];
+        unpackColor(color0, palette[0]);
+        unpackColor(color1, palette[1]);
+        for (uint8_t c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            uint32_t best = 0;
+            float bestDistance = 0.0f;
+            for (uint8_t p = 0; p < 4; p++)
+            {
+                float distance = 0.0f;
+                for (uint8_t c = 0; c < 3; c++)
+                {
+                    distance += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+                }
+                if (p == 0 || distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+    // Little endian, as the formats are defined.
+    out[0] = color0 & 0xFF;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF;
+    out[3] = color1 >> 8;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        out[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
+
+// The BC3 alpha block: the highest and lowest alpha with six steps between, three bits a pixel.
+static void compressAlphaBlock(const unsigned char (&block)[16][4], unsigned char *out)
+{
+    unsigned char alpha0 = 0, alpha1 = 255;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        alpha0 = std::max(alpha0, block[i][3]);
+        alpha1 = std::min(alpha1, block[i][3]);
+    }
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        float palette[8];
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        for (uint8_t p = 2; p < 8; p++)
+        {
+            palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7.0f;
+        }
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            uint64_t best = 0;
+            for (uint8_t p = 1; p < 8; p++)
+            {
+                if (fabs(block[i][3] - palette[p]) < fabs(block[i][3] - palette[best]))
+                {
+                    best = p;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+    }
+    out[0] = alpha0;
+    out[1] = alpha1;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        out[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint16_t packColor(const float *color)
+{
+    const uint16_t r = static_cast<uint16_t>(color[0] * 31.0f / 255.0f + 0.5f);
+    const uint16_t g = static_cast<uint16_t>(color[1] * 63.0f / 255.0f + 0.5f);
+    const uint16_t b = static_cast<uint16_t>(color[2] * 31.0f / 255.0f + 0.5f);
+    return (r << 11) | (g << 5) | b;
+}
+
+// The colour a GPU decodes from 5:6:5, with the top bits repeated into the bottom.
+static void unpackColor(const uint16_t packed, float *color)
+{
+    const uint16_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = static_cast<float>((r << 3) | (r >> 2));
+    color[1] = static_cast<float>((g << 2) | (g >> 4));
+    color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+// Box filters RGBA pixels down to the next mipmap level. An odd last row or column is dropped, as the level sizes round down.
+static void halveImage(const GLuint width, const GLuint height, const std::vector<unsigned char> &pixels, std::vector<unsigned char> &half)
+{
+    const GLuint halfWidth = std::max<GLuint>(width / 2, 1);
+    const GLuint halfHeight = std::max<GLuint>(height / 2, 1);
+    half.resize(halfWidth * halfHeight * 4);
+    for (GLuint y = 0; y < halfHeight; y++)
+    {
+        for (GLuint x = 0; x < halfWidth; x++)
+        {
+            const GLuint x0 = x * 2, y0 = y * 2;
+            const GLuint x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+            for (uint8_t c = 0; c < 4; c++)
+            {
+                const GLuint sum = pixels[(y0 * width + x0) * 4 + c] + pixels[(y0 * width + x1) * 4 + c]
+                    + pixels[(y1 * width + x0) * 4 + c] + pixels[(y1 * width + x1) * 4 + c];
+                half[(y * halfWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+}
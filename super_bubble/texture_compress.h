@@ -0,0 +1,40 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+/* GPU compressed textures.
+ *
+ * Images are converted offline into KTX files holding S3TC blocks: BC1 for opaque images and BC3 for images
+ * with alpha, with every mipmap level down to 1x1 built in. The game loads the .ktx next to an image in place
+ * of the image itself when the driver supports S3TC, so nothing is decoded or compressed at load time.
+ *
+ * Only KTX version 1 files with one face, no array elements and one of those two formats are read.
+ */
+
+const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct CompressedImage
+{
+    // GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT.
+    GLenum format;
+    GLuint width, height;
+    // Bytes in each mipmap level, largest first. The levels are stored one after another in data.
+    std::vector<GLuint> levelSizes;
+    std::vector<unsigned char> data;
+};
+
+// Compresses RGBA pixels, top row first, with a full chain of mipmaps. Uses BC3 if alpha, BC1 otherwise.
+void compressImage(const GLuint width, const GLuint height, const unsigned char *pixels, const bool alpha, CompressedImage &image);
+bool writeKtx(const char *fileName, const CompressedImage &image);
+bool readKtx(const char *fileName, CompressedImage &image);
+// The .ktx file the game looks for in place of an image file.
+std::string ktxFileName(const std::string &imageFileName);
+// Converts each image file to a .ktx next to it. Images with any transparent pixel get BC3.
+bool compressTextureFiles(char *files[], const int numFiles);
+
+#endif
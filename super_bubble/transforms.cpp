@@ -1,5 +1,27 @@
+#include <algorithm>
 #include "transforms.h"
 
+// Fits the mode's grid in the classic play area, never drawing bigger than GRID_SIZE, and centres it there.
+template<typename Rules>
+static BoardLayout layoutFor()
+{
+    const uint16_t width = ClassicRules::COLUMNS * GRID_SIZE;
+    const uint16_t height = ClassicRules::ROWS * GRID_SIZE;
+    const uint16_t fitWidth = width / Rules::COLUMNS;
+    const uint16_t fitHeight = height / Rules::ROWS;
+    BoardLayout layout;
+    layout.cellSize = std::min(GRID_SIZE, std::min(fitWidth, fitHeight));
+    layout.position = PLAY_SPACE_POS + glm::uvec2((width - (Rules::COLUMNS * layout.cellSize)) / 2, (height - (Rules::ROWS * layout.cellSize)) / 2);
+    return layout;
+}
+
+static const BoardLayout LAYOUTS[NUM_MATCH_MODES] = { layoutFor<ClassicRules>(), layoutFor<ThreeMatchRules>(), layoutFor<WideRules>() };
+
+const BoardLayout &boardLayout(const MatchMode mode)
+{
+    return LAYOUTS[mode];
+}
+
 bool gridSpaceToPlaySpace(const glm::ivec2 gridPosition, glm::ivec2 &playPosition)
 {
     playPosition.x = gridPosition.x * GRID_SIZE;
@@ -7,11 +29,12 @@ bool gridSpaceToPlaySpace(const glm::ivec2 gridPosition, glm::ivec2 &playPositio
     return true;
 }
 
-bool playSpaceToGridSpace(const glm::ivec2 playPosition, glm::ivec2 &gridPosition)
+bool playSpaceToGridSpace(const MatchMode mode, const glm::ivec2 playPosition, glm::ivec2 &gridPosition)
 {
-    // TODO: Should it be (GRID_COLUMNS - 1) and (GRID_ROWS - 1)?
-    if (playPosition.x > (GRID_COLUMNS * GRID_SIZE) ||
-        playPosition.y > (GRID_ROWS * GRID_SIZE) ||
+    const GridShape &shape = MODE_GRIDS[mode];
+    // TODO: Should it be (columns - 1) and (rows - 1)?
+    if (playPosition.x > (shape.columns * GRID_SIZE) ||
+        playPosition.y > (shape.rows * GRID_SIZE) ||
         playPosition.x % GRID_SIZE != 0 ||
         playPosition.y % GRID_SIZE != 0)
     {
@@ -25,32 +48,37 @@ bool playSpaceToGridSpace(const glm::ivec2 playPosition, glm::ivec2 &gridPositio
     }
 }
 
-bool windowSpaceToPlaySpace(const glm::uvec2 windowPosition, glm::ivec2 &playPosition)
+bool windowSpaceToPlaySpace(const MatchMode mode, const glm::uvec2 windowPosition, glm::ivec2 &playPosition)
 {
-    if (windowPosition.x < PLAY_SPACE_POS.x ||
-        windowPosition.y < PLAY_SPACE_POS.y ||
-        windowPosition.x >(PLAY_SPACE_POS.x + (GRID_COLUMNS * GRID_SIZE)) ||
-        windowPosition.y >(PLAY_SPACE_POS.y + (GRID_ROWS * GRID_SIZE)))
+    const GridShape &shape = MODE_GRIDS[mode];
+    const BoardLayout &layout = boardLayout(mode);
+    if (windowPosition.x < layout.position.x ||
+        windowPosition.y < layout.position.y ||
+        windowPosition.x >(layout.position.x + (shape.columns * layout.cellSize)) ||
+        windowPosition.y >(layout.position.y + (shape.rows * layout.cellSize)))
     {
         // Outside play space bounds.
         return false;
     }
-    playPosition.x = windowPosition.x - PLAY_SPACE_POS.x;
-    playPosition.y = windowPosition.y - PLAY_SPACE_POS.y;
+    playPosition.x = (windowPosition.x - layout.position.x) * GRID_SIZE / layout.cellSize;
+    playPosition.y = (windowPosition.y - layout.position.y) * GRID_SIZE / layout.cellSize;
     return true;
 }
 
-bool playSpaceToWindowSpace(const glm::ivec2 playPosition, glm::uvec2 &windowPosition)
+bool playSpaceToWindowSpace(const MatchMode mode, const glm::ivec2 playPosition, glm::uvec2 &windowPosition)
 {
+    const GridShape &shape = MODE_GRIDS[mode];
+    const BoardLayout &layout = boardLayout(mode);
     // Y can be less than zero to allow bubbles to enter from off-screen, but X cannot.
     if (playPosition.x < 0 ||
-        playPosition.x >(GRID_COLUMNS * GRID_SIZE) ||
-        playPosition.y > (GRID_ROWS * GRID_SIZE))
+        playPosition.x >(shape.columns * GRID_SIZE) ||
+        playPosition.y > (shape.rows * GRID_SIZE))
     {
         return false;
     }
-    windowPosition.x = playPosition.x + PLAY_SPACE_POS.x;
-    windowPosition.y = playPosition.y + PLAY_SPACE_POS.y;
+    // Scaled while still signed, as bubbles entering from above have a negative y.
+    windowPosition.x = layout.position.x + (playPosition.x * layout.cellSize / GRID_SIZE);
+    windowPosition.y = layout.position.y + (playPosition.y * layout.cellSize / GRID_SIZE);
     return true;
 }
 
@@ -2,18 +2,31 @@
 #define TRANSFORMS_H
 
 #include "defs.h"
+#include "match_rules.h"
 
 /* The coordinate spaces in the game are:
  *  Window space - the entire game window - this is the space everything is drawn in.
  *  Play space - the area where the game grid is displayed - this is the space where the bubbles are translated to allow them to move smoothly.
  *  Grid space - the grid where a bubble can be dispayed in each grid square, where the grid squares are GRID_SIZE width (which is specified in play space).
+ *
+ * Play space is in GRID_SIZE squares whatever the mode, so the match plays the same however it is drawn. Each mode's
+ * grid is drawn to fit the classic play area, so a bigger grid is drawn with smaller squares (see BoardLayout).
  */
 
+// Where a mode's grid is drawn in window space, and the size each grid square is drawn at.
+struct BoardLayout
+{
+    glm::uvec2 position;
+    uint16_t cellSize;
+};
+
+const BoardLayout &boardLayout(const MatchMode mode);
+
  // These methods return true if the transformation is valid.
 bool gridSpaceToPlaySpace(const glm::ivec2 gridPosition, glm::ivec2 &playPosition);
-bool playSpaceToGridSpace(const glm::ivec2 playPosition, glm::ivec2 &gridPosition);
-bool windowSpaceToPlaySpace(const glm::uvec2 windowPosition, glm::ivec2 &playPosition);
-bool playSpaceToWindowSpace(const glm::ivec2 playPosition, glm::uvec2 &windowPosition);
+bool playSpaceToGridSpace(const MatchMode mode, const glm::ivec2 playPosition, glm::ivec2 &gridPosition);
+bool windowSpaceToPlaySpace(const MatchMode mode, const glm::uvec2 windowPosition, glm::ivec2 &playPosition);
+bool playSpaceToWindowSpace(const MatchMode mode, const glm::ivec2 playPosition, glm::uvec2 &windowPosition);
 uint8_t playSpaceToNearestVerticalGrid(const glm::ivec2 playPosition, glm::ivec2 &gridPosition0, glm::ivec2 &gridPosition1);
 
-#endif
\ No newline at end of file
+#endif